@@ -1,7 +1,9 @@
 #include "CanBusManager.h"
+#include "PackManager.h"
+#include "LimitManager.h"
+#include <Preferences.h>
 
 // ——————— VARIABLES GLOBALES ———————
-CanFrame canFrame;
 unsigned long lastCanSend = 0;
 
 // Variables de consignes (mode dégradé)
@@ -9,9 +11,10 @@ float chargeCurrentSetpoint = 10.0;    // 10A
 float dischargeCurrentSetpoint = 10.0; // 10A
 
 // Variables pour affichage des trames
-char lastCanFrames[5][50];
 bool canDisplayActive = false;
 
+static void loadCanProtocol();
+
 // ——————— FONCTIONS D'INITIALISATION ———————
 
 bool initCanBus()
@@ -20,10 +23,12 @@ bool initCanBus()
 
     // Configuration des pins et paramètres
     ESP32Can.setPins(CAN_TX_PIN, CAN_RX_PIN);
-    ESP32Can.setRxQueueSize(5);
-    ESP32Can.setTxQueueSize(5);
+    ESP32Can.setRxQueueSize(CAN_RX_QUEUE_SIZE);
+    ESP32Can.setTxQueueSize(CAN_TX_QUEUE_SIZE);
     ESP32Can.setSpeed(ESP32Can.convertSpeed(CAN_SPEED_KBPS));
 
+    loadCanProtocol();
+
     // Démarrage du CAN
     if (!ESP32Can.begin())
     {
@@ -35,6 +40,7 @@ bool initCanBus()
                   CAN_SPEED_KBPS, CAN_TX_PIN, CAN_RX_PIN);
     Serial.printf("Consignes initiales: Charge=%.1fA, Décharge=%.1fA\n",
                   chargeCurrentSetpoint, dischargeCurrentSetpoint);
+    Serial.printf("Protocole CAN: %s\n", getCanProtocolTable().name);
     return true;
 }
 
@@ -72,190 +78,838 @@ float getDischargeCurrentSetpoint()
     return dischargeCurrentSetpoint;
 }
 
-// ——————— FONCTIONS PRINCIPALES ———————
+// ——————— CHAMPS DES TRAMES ———————
+// Valeurs publiées dans l'unité du protocole, lues dans l'instantané du pack
+// et les limites. Les champs sont des types : une trame est la liste de ses
+// champs, et son encodeur est généré à la compilation (CanFrameLayout).
 
-bool shouldSendCan()
+typedef int32_t (*CanValue)();
+
+static int32_t chargeVoltageDv() { return getPackLimits().chargeVoltageDv; }
+static int32_t dischargeVoltageDv() { return getPackLimits().dischargeVoltageDv; }
+static int32_t limitedCurrentDa(int32_t limitDa)
 {
-    return (millis() - lastCanSend >= CAN_SEND_INTERVAL_MS);
+    // Onduleur muet (ou pas encore entendu) : repli sur le courant de sécurité,
+    // si le protocole permet de l'entendre
+    if (isInverterWatchdogActive() && !isInverterPresent())
+        limitDa = min(limitDa, (int32_t)CAN_SAFE_CURRENT_A * 10);
+    return limitDa;
 }
 
-void sendCanData()
+static int32_t chargeCurrentDa() { return limitedCurrentDa(getPackLimits().chargeCurrentDa); }
+static int32_t dischargeCurrentDa() { return limitedCurrentDa(getPackLimits().dischargeCurrentDa); }
+static int32_t packSocPercent() { return (getPackSnapshot().socAvgRaw + 5) / 10; } // Brut BMS : 1000 = 100 %
+static int32_t packSocCentiPercent() { return getPackSnapshot().socAvgRaw * 10; }
+static int32_t packSohPercent() { return 100; }
+static int32_t packVoltageCv() { return getPackSnapshot().voltageDv * 10; }
+static int32_t packCurrentDa() { return -getPackSnapshot().currentDa; } // + = charge côté onduleur
+static int32_t packMaxTempDc() { return getPackSnapshot().extremum[PACK_TEMP_MAX]; }
+static int32_t packModuleCount() { return getPackSnapshot().onlineCount; }
+
+// Entier 16 bits little-endian, saturé à la plage du champ
+template <uint8_t Offset, CanValue Value, bool Signed = false>
+struct Le16
+{
+    static_assert(Offset + 2 <= 8, "Champ 16 bits hors de la trame");
+    static void put(uint8_t *data)
+    {
+        int32_t v = Value();
+        v = Signed ? constrain(v, (int32_t)INT16_MIN, (int32_t)INT16_MAX)
+                   : constrain(v, (int32_t)0, (int32_t)UINT16_MAX);
+        data[Offset] = v & 0xFF;
+        data[Offset + 1] = (v >> 8) & 0xFF;
+    }
+};
+
+template <uint8_t Offset, CanValue Value>
+struct U8
+{
+    static_assert(Offset < 8, "Champ 8 bits hors de la trame");
+    static void put(uint8_t *data)
+    {
+        data[Offset] = (uint8_t)constrain(Value(), (int32_t)0, (int32_t)UINT8_MAX);
+    }
+};
+
+// Texte ASCII, tronqué à la fin de la trame
+template <uint8_t Offset, const char *Text>
+struct Ascii
+{
+    static_assert(Offset < 8, "Texte hors de la trame");
+    static void put(uint8_t *data)
+    {
+        for (uint8_t i = 0; Offset + i < 8 && Text[i]; i++)
+            data[Offset + i] = Text[i];
+    }
+};
+
+// Octet fixe
+template <uint8_t Offset, uint8_t Byte>
+struct Const8
+{
+    static_assert(Offset < 8, "Octet hors de la trame");
+    static void put(uint8_t *data) { data[Offset] = Byte; }
+};
+
+// Trame : octets non décrits à 0, puis chaque champ dans l'ordre
+template <typename... Fields>
+struct CanFrameLayout
+{
+    static void encode(uint8_t *data)
+    {
+        memset(data, 0, 8);
+        int expand[] = {0, (Fields::put(data), 0)...};
+        (void)expand;
+    }
+};
+
+// ——————— TABLES DE PROTOCOLE ———————
+// Données brutes de référence en commentaire (consignes 10 A, SOC 20 %,
+// 42.00 V, 0 A, 27 °C, un module). Ajouter un protocole = une table ici et
+// une entrée dans CAN_PROTOCOLS. Phases étalées sur la période ; limites,
+// alarmes et autorisations sont critiques (jamais sautées).
+
+static const char CAN_MANUFACTURER[] = CAN_MANUFACTURER_NAME;
+
+static const CanFrameSpec PYLONTECH_FRAMES[] = {
+    // 351 : 04 02 64 00 64 00 C9 01 (charge 51.6 V / 10 A, décharge 10 A / 45.7 V)
+    {PYLON_ID_LIMITS, CAN_SEND_INTERVAL_MS, 0, CAN_PRIORITY_CRITICAL, CAN_INPUT_LIMITS, 8,
+     CanFrameLayout<Le16<0, chargeVoltageDv>, Le16<2, chargeCurrentDa>, Le16<4, dischargeCurrentDa>,
+                    Le16<6, dischargeVoltageDv>>::encode},
+    // 355 : 14 00 64 00 D0 07 00 00 (SOC %, SOH %, SOC 0.01 %)
+    {PYLON_ID_SOC_SOH, CAN_SEND_INTERVAL_MS, 200, CAN_PRIORITY_NORMAL, CAN_INPUT_PACK, 8,
+     CanFrameLayout<Le16<0, packSocPercent>, Le16<2, packSohPercent>, Le16<4, packSocCentiPercent>>::encode},
+    // 356 : 68 10 00 00 0E 01 00 00 (0.01 V, 0.1 A signé, 0.1 °C signé)
+    {PYLON_ID_VOLTAGE_CURRENT, CAN_SEND_INTERVAL_MS, 400, CAN_PRIORITY_NORMAL, CAN_INPUT_PACK, 8,
+     CanFrameLayout<Le16<0, packVoltageCv>, Le16<2, packCurrentDa, true>, Le16<4, packMaxTempDc, true>>::encode},
+    // 359 : 00 00 04 00 01 00 00 00 (protections, alarmes bit 2, nombre de modules)
+    {PYLON_ID_ALARMS, CAN_SEND_INTERVAL_MS, 600, CAN_PRIORITY_CRITICAL, CAN_INPUT_PACK, 8,
+     CanFrameLayout<Const8<2, 0x04>, U8<4, packModuleCount>>::encode},
+    // 35C : C0 00 00 00 00 00 00 00 (bits 7+6 : charge + décharge autorisées)
+    {PYLON_ID_REQUESTS, CAN_SEND_INTERVAL_MS, 800, CAN_PRIORITY_CRITICAL, CAN_INPUT_NONE, 8,
+     CanFrameLayout<Const8<0, 0xC0>>::encode},
+    // 35E : 50 59 4C 4F 4E 20 20 20 ("PYLON   ")
+    {PYLON_ID_MANUFACTURER, 5 * CAN_SEND_INTERVAL_MS, 900, CAN_PRIORITY_NORMAL, CAN_INPUT_NONE, 8,
+     CanFrameLayout<Ascii<0, CAN_MANUFACTURER>>::encode},
+};
+
+#define PROTOCOL_TABLE(name, frames, keepalive) {name, frames, sizeof(frames) / sizeof(frames[0]), keepalive}
+
+static const CanProtocolTable CAN_PROTOCOLS[PROTOCOL_COUNT] = {
+    PROTOCOL_TABLE("pylontech", PYLONTECH_FRAMES, PYLON_ID_INVERTER_KEEPALIVE),
+};
+
+static_assert(sizeof(PYLONTECH_FRAMES) / sizeof(PYLONTECH_FRAMES[0]) <= CAN_MAX_PROTOCOL_FRAMES,
+              "Augmenter CAN_MAX_PROTOCOL_FRAMES");
+
+static CanProtocol activeProtocol = CAN_DEFAULT_PROTOCOL;
+static unsigned long frameNextDue[CAN_MAX_PROTOCOL_FRAMES]; // Échéance de chaque trame
+static CanTxStats txStats[CAN_MAX_PROTOCOL_FRAMES];
+
+// Trames prêtes à émettre (ID, longueur et octets), ré-encodées si sales
+static CanFrame frameCache[CAN_MAX_PROTOCOL_FRAMES];
+static bool frameDirty[CAN_MAX_PROTOCOL_FRAMES];
+
+// Valeurs du pack lues par les encodeurs, pour ignorer les publications sans effet
+struct CanPackInputs
+{
+    int32_t currentDa;
+    int32_t maxTempDc;
+    uint16_t voltageDv;
+    uint16_t socAvgRaw;
+    uint8_t onlineCount;
+};
+static CanPackInputs lastPackInputs;
+static uint32_t lastPackSeq = 0;
+
+// Chien de garde onduleur : absent tant qu'aucune trame de présence n'est reçue
+static bool inverterPresent = false;
+static unsigned long inverterLastSeen = 0;
+
+static_assert(CAN_TX_RESERVED_SLOTS < CAN_TX_QUEUE_SIZE, "Aucune place pour les trames normales");
+
+// ——————— SÉLECTION DU PROTOCOLE ———————
+
+static void scheduleAllFrames()
+{
+    // Nouveau protocole : chaque trame part à sa phase, à partir de maintenant,
+    // avec un cache entièrement à encoder
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        frameNextDue[i] = now + table.frames[i].phaseMs;
+        frameCache[i] = {};
+        frameCache[i].identifier = table.frames[i].identifier;
+        frameCache[i].extd = 0;
+        frameCache[i].data_length_code = table.frames[i].length;
+        frameDirty[i] = true;
+    }
+    resetCanTxStats();
+}
+
+static void loadCanProtocol()
+{
+    Preferences prefs;
+    prefs.begin("can", true);
+    uint8_t stored = prefs.getUChar("protocol", CAN_DEFAULT_PROTOCOL);
+    prefs.end();
+    // Valeur hors table (enregistrée par un autre firmware) : protocole par défaut
+    if (stored >= PROTOCOL_COUNT)
+        Serial.printf("Protocole CAN enregistré %d indisponible, %s utilisé\n", stored,
+                      CAN_PROTOCOLS[CAN_DEFAULT_PROTOCOL].name);
+    activeProtocol = stored < PROTOCOL_COUNT ? (CanProtocol)stored : CAN_DEFAULT_PROTOCOL;
+    scheduleAllFrames();
+}
+
+bool setCanProtocol(CanProtocol protocol, bool persist)
+{
+    if (protocol >= PROTOCOL_COUNT)
+        return false;
+
+    // Autre protocole, autre trame de présence : l'onduleur doit se faire entendre
+    if (protocol != activeProtocol)
+        inverterPresent = false;
+    activeProtocol = protocol;
+    scheduleAllFrames();
+    if (persist)
+    {
+        Preferences prefs;
+        prefs.begin("can", false);
+        prefs.putUChar("protocol", protocol);
+        prefs.end();
+    }
+    Serial.printf("Protocole CAN: %s (%d trames)\n", CAN_PROTOCOLS[protocol].name,
+                  CAN_PROTOCOLS[protocol].frameCount);
+    return true;
+}
+
+bool setCanProtocolByName(const char *name)
+{
+    for (uint8_t p = 0; p < PROTOCOL_COUNT; p++)
+    {
+        if (strcmp(name, CAN_PROTOCOLS[p].name) == 0)
+            return setCanProtocol((CanProtocol)p, true);
+    }
+    return false;
+}
+
+CanProtocol getCanProtocol()
+{
+    return activeProtocol;
+}
+
+const CanProtocolTable &getCanProtocolTable()
+{
+    return CAN_PROTOCOLS[activeProtocol];
+}
+
+// ——————— PILOTE D'ÉMISSION ———————
+
+static bool twaiWrite(const CanFrame &frame)
+{
+    return ESP32Can.writeFrame(frame, 0); // Sans attente : la file est surveillée
+}
+
+static uint32_t twaiTxPending()
+{
+    return ESP32Can.inTxQueue();
+}
+
+static bool twaiRead(CanFrame &frame)
+{
+    return ESP32Can.readFrame(frame, 0);
+}
+
+static bool twaiStatus(twai_status_info_t &info)
+{
+    return twai_get_status_info(&info) == ESP_OK;
+}
+
+static bool twaiRecover()
+{
+    return twai_initiate_recovery() == ESP_OK;
+}
+
+static bool twaiRestart()
+{
+    return twai_start() == ESP_OK;
+}
+
+static const CanDriver TWAI_DRIVER = {twaiWrite, twaiTxPending, twaiRead,
+                                      twaiStatus, twaiRecover, twaiRestart};
+static const CanDriver *canDriver = &TWAI_DRIVER;
+
+// Santé : échantillon courant et bits vus sur le bus depuis le dernier
+static CanHealth health = {};
+static uint32_t windowBits = 0;
+
+static uint32_t frameBits(const CanFrame &frame)
+{
+    return CAN_FRAME_OVERHEAD_BITS + 8 * frame.data_length_code;
+}
+
+void setCanDriver(const CanDriver *driver)
+{
+    canDriver = driver ? driver : &TWAI_DRIVER;
+}
+
+// ——————— ORDONNANCEUR D'ÉMISSION ———————
+
+static bool isFrameDue(uint8_t frame, unsigned long now)
+{
+    return (long)(now - frameNextDue[frame]) >= 0;
+}
+
+static int8_t pickDueFrame(const CanProtocolTable &table, unsigned long now)
+{
+    // Priorité la plus haute d'abord, puis la plus en retard
+    int8_t best = -1;
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        if (!isFrameDue(i, now))
+            continue;
+        if (best < 0 || table.frames[i].priority < table.frames[best].priority ||
+            (table.frames[i].priority == table.frames[best].priority &&
+             (long)(frameNextDue[i] - frameNextDue[best]) < 0))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static void advanceFrame(uint8_t frame, const CanFrameSpec &spec, unsigned long now)
 {
-    if (!shouldSendCan())
+    // Échéance suivante calée sur la phase ; après un long retard, repartir
+    // de maintenant plutôt que d'émettre les périodes manquées en rafale
+    frameNextDue[frame] += spec.periodMs;
+    if (isFrameDue(frame, now))
+        frameNextDue[frame] = now + spec.periodMs;
+}
+
+static void recordSent(uint8_t frame, const CanFrameSpec &spec, unsigned long now)
+{
+    CanTxStats &stats = txStats[frame];
+    if (stats.sent)
     {
+        stats.achievedPeriodMs = now - stats.lastSentMs;
+        unsigned long jitter = stats.achievedPeriodMs > spec.periodMs
+                                   ? stats.achievedPeriodMs - spec.periodMs
+                                   : spec.periodMs - stats.achievedPeriodMs;
+        stats.maxJitterMs = max(stats.maxJitterMs, jitter);
+        stats.jitterSumMs += jitter;
+    }
+    stats.lastSentMs = now;
+    stats.sent++;
+}
+
+static void deferDueFrames(const CanProtocolTable &table, unsigned long now)
+{
+    // File pleine : une critique reste due (réessai), une normale saute sa période
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        if (!isFrameDue(i, now))
+            continue;
+        if (table.frames[i].priority == CAN_PRIORITY_CRITICAL)
+        {
+            txStats[i].retries++;
+        }
+        else
+        {
+            txStats[i].dropped++;
+            advanceFrame(i, table.frames[i], now);
+        }
+    }
+}
+
+static bool writeCanFrame(const CanFrame &frame)
+{
+    bool sent = canDriver->write(frame);
+    traceRecord(TRACE_CAN_TX, 0, 0, frame.identifier, frame.data, frame.data_length_code,
+                sent ? TRACE_OK : TRACE_TX_FAILED);
+    if (sent)
+        windowBits += frameBits(frame);
+    else
+        health.writeFailures++;
+    return sent;
+}
+
+// ——————— CACHE DES TRAMES ———————
+
+void markCanInputsChanged(uint8_t inputs)
+{
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        if (table.frames[i].inputs & inputs)
+            frameDirty[i] = true;
+    }
+}
+
+static void checkPackInputs()
+{
+    // Nouvelle publication du pack : comparer les seules valeurs encodées
+    const PackSnapshot &pack = getPackSnapshot();
+    if (pack.seq == lastPackSeq)
         return;
+    lastPackSeq = pack.seq;
+
+    CanPackInputs inputs;
+    memset(&inputs, 0, sizeof(inputs)); // Octets de bourrage comparés par memcmp
+    inputs.currentDa = pack.currentDa;
+    inputs.maxTempDc = pack.extremum[PACK_TEMP_MAX];
+    inputs.voltageDv = pack.voltageDv;
+    inputs.socAvgRaw = pack.socAvgRaw;
+    inputs.onlineCount = pack.onlineCount;
+    if (memcmp(&inputs, &lastPackInputs, sizeof(inputs)) != 0)
+    {
+        lastPackInputs = inputs;
+        markCanInputsChanged(CAN_INPUT_PACK);
     }
+}
 
-    lastCanSend = millis();
+static const CanFrame &encodeCachedFrame(uint8_t frame)
+{
+    if (frameDirty[frame])
+    {
+        CAN_PROTOCOLS[activeProtocol].frames[frame].encode(frameCache[frame].data);
+        frameDirty[frame] = false;
+        txStats[frame].encodes++;
+    }
+    return frameCache[frame];
+}
 
-    // Envoyer toutes les trames
-    sendChargeLimits();       // 0x351
-    sendSocSoh();             // 0x355
-    sendVoltageCurrentTemp(); // 0x356
-    sendAlarms();             // 0x359
-    sendRequests();           // 0x35C
+const CanFrame &getCachedCanFrame(uint8_t frame)
+{
+    static const CanFrame none = {};
+    return frame < CAN_PROTOCOLS[activeProtocol].frameCount ? frameCache[frame] : none;
+}
 
-    // ⭐ Mettre à jour l'affichage des trames si actif
-    if (canDisplayActive)
+void printCanFrameCache()
+{
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    Serial.printf("\n=== CACHE CAN (%s) ===\n", table.name);
+    for (uint8_t i = 0; i < table.frameCount; i++)
     {
-        updateCanFrameDisplay();
+        const CanFrame &frame = frameCache[i];
+        Serial.printf("%03lX:", (unsigned long)frame.identifier);
+        for (uint8_t b = 0; b < frame.data_length_code; b++)
+            Serial.printf(" %02X", frame.data[b]);
+        Serial.printf("%s encodages=%lu/%lu\n", frameDirty[i] ? " (à ré-encoder)" : "",
+                      (unsigned long)txStats[i].encodes, (unsigned long)txStats[i].sent);
     }
-    Serial.println("Trames CAN envoyées");
+    Serial.println("======================");
 }
 
-// ——————— ENVOI DE TRAMES SPÉCIFIQUES ———————
+// ——————— FONCTIONS PRINCIPALES ———————
 
-void sendChargeLimits()
+bool shouldSendCan()
 {
-    // Données Brutes : 04 02 64 00 64 00 C9 01
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        if (isFrameDue(i, now))
+            return true;
+    }
+    return false;
+}
 
-    canFrame = {0};
-    canFrame.identifier = CAN_ID_LIMITS;
-    canFrame.extd = 0;
-    canFrame.data_length_code = 8;
+void sendCanData()
+{
+    // Trames dues du protocole actif, au plus CAN_TX_FRAMES_PER_CALL par appel
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    unsigned long now = millis();
+    bool sent = false;
 
-    // Tension de charge max: 51.6V = 516 = 0x0204
-    uint16_t vchg = 516;
+    // Contrôleur hors marche (bus-off, reprise) : les trames restent dues
+    if (health.valid && health.state != TWAI_STATE_RUNNING)
+        return;
 
-    // Courants en 0.1A (consignes variables 0-600A)
-    uint16_t ichg = (uint16_t)(chargeCurrentSetpoint * 10);    // x10 pour 0.1A
-    uint16_t idis = (uint16_t)(dischargeCurrentSetpoint * 10); // x10 pour 0.1A
+    // Nouvelles limites (pack publié, consignes, pente) : 0x351 à ré-encoder
+    checkPackInputs();
+    if (updateLimits())
+        markCanInputsChanged(CAN_INPUT_LIMITS);
+    for (uint8_t n = 0; n < CAN_TX_FRAMES_PER_CALL; n++)
+    {
+        int8_t frame = pickDueFrame(table, now);
+        if (frame < 0)
+            break;
+
+        const CanFrameSpec &spec = table.frames[frame];
+        bool critical = spec.priority == CAN_PRIORITY_CRITICAL;
+        uint32_t limit = critical ? CAN_TX_QUEUE_SIZE : CAN_TX_QUEUE_SIZE - CAN_TX_RESERVED_SLOTS;
+
+        bool written = false;
+        if (canDriver->txPending() < limit)
+            written = writeCanFrame(encodeCachedFrame(frame));
+
+        if (written)
+        {
+            recordSent(frame, spec, now);
+            advanceFrame(frame, spec, now);
+            sent = true;
+            continue;
+        }
+
+        deferDueFrames(table, now);
+        break;
+    }
 
-    // Format little-endian selon la doc
-    canFrame.data[0] = lowByte(vchg);  // 0x04
-    canFrame.data[1] = highByte(vchg); // 0x02
-    canFrame.data[2] = lowByte(ichg);  // Variable selon consigne
-    canFrame.data[3] = highByte(ichg); // Variable selon consigne
-    canFrame.data[4] = lowByte(idis);  // Variable selon consigne
-    canFrame.data[5] = highByte(idis); // Variable selon consigne
-    canFrame.data[6] = 0xC9;           // Fixe
-    canFrame.data[7] = 0x01;           // Fixe
+    if (sent)
+        lastCanSend = now;
+}
 
-    ESP32Can.writeFrame(canFrame);
-    Serial.printf("CAN 0x351: V=51.6V, Ich=%.1fA, Idch=%.1fA\n",
-                  chargeCurrentSetpoint, dischargeCurrentSetpoint);
+// ——————— STATISTIQUES D'ÉMISSION ———————
+
+const CanTxStats &getCanTxStats(uint8_t frame)
+{
+    static const CanTxStats none = {};
+    return frame < CAN_PROTOCOLS[activeProtocol].frameCount ? txStats[frame] : none;
+}
+
+void resetCanTxStats()
+{
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    memset(txStats, 0, sizeof(txStats));
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        txStats[i].identifier = table.frames[i].identifier;
+    }
 }
 
-void sendSocSoh()
+void printCanTxStats()
 {
-    // Données Brutes : 14 00 64 00 D0 07 00 00
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    Serial.printf("\n=== ÉMISSION CAN (%s) ===\n", table.name);
+    for (uint8_t i = 0; i < table.frameCount; i++)
+    {
+        const CanFrameSpec &spec = table.frames[i];
+        const CanTxStats &stats = txStats[i];
+        float meanJitter = stats.sent > 1 ? (float)stats.jitterSumMs / (stats.sent - 1) : 0.0f;
+        Serial.printf("%03lX %s période=%ums+%ums réel=%lums gigue moy=%.1fms max=%lums "
+                      "envoyées=%lu encodées=%lu réessais=%lu sautées=%lu\n",
+                      (unsigned long)spec.identifier,
+                      spec.priority == CAN_PRIORITY_CRITICAL ? "crit" : "norm", spec.periodMs,
+                      spec.phaseMs, stats.achievedPeriodMs, meanJitter, stats.maxJitterMs,
+                      (unsigned long)stats.sent, (unsigned long)stats.encodes,
+                      (unsigned long)stats.retries, (unsigned long)stats.dropped);
+    }
+    Serial.printf("File d'émission: %lu/%d\n", (unsigned long)canDriver->txPending(),
+                  CAN_TX_QUEUE_SIZE);
+    Serial.println("==========================");
+}
+
+// ——————— RÉCEPTION ———————
 
-    canFrame = {0};
-    canFrame.identifier = CAN_ID_SOC_SOH;
-    canFrame.extd = 0;
-    canFrame.data_length_code = 8;
+static_assert((CAN_RX_RING_SIZE & (CAN_RX_RING_SIZE - 1)) == 0, "CAN_RX_RING_SIZE doit être une puissance de 2");
 
-    // SOC: 20% = 20 = 0x0014, SOH: 100% = 100 = 0x0064
-    uint16_t soc = 20;  // 20%
-    uint16_t soh = 100; // 100%
+// Ring sans verrou : rxHead n'est écrit que par le producteur (vidage de la
+// file TWAI), rxTail que par le consommateur (routage). Compteurs libres,
+// publiés après la copie de la trame.
+static CanFrame rxRing[CAN_RX_RING_SIZE];
+static uint32_t rxHead = 0;
+static uint32_t rxTail = 0;
+static uint32_t rxRingOverflows = 0; // Ring plein : trames laissées dans la file TWAI
 
-    // Format little-endian selon la doc
-    canFrame.data[0] = lowByte(soc);  // 0x14
-    canFrame.data[1] = highByte(soc); // 0x00
-    canFrame.data[2] = lowByte(soh);  // 0x64
-    canFrame.data[3] = highByte(soh); // 0x00
-    canFrame.data[4] = 0xD0;          // Fixe
-    canFrame.data[5] = 0x07;          // Fixe
-    canFrame.data[6] = 0x00;          // Fixe
-    canFrame.data[7] = 0x00;          // Fixe
+static CanRxStats rxStats[CAN_RX_TRACKED_IDS];
+static uint8_t rxStatsCount = 0;
+static uint32_t rxUntracked = 0; // Identifiants au-delà de CAN_RX_TRACKED_IDS
+static uint32_t rxUnhandled = 0; // Trames sans traitement dans la table
 
-    ESP32Can.writeFrame(canFrame);
-    Serial.printf("CAN 0x355: SOC=%d%%, SOH=%d%%\n", soc, soh);
+static void drainCanRx()
+{
+    CanFrame frame;
+    while (true)
+    {
+        uint32_t head = rxHead;
+        if (head - __atomic_load_n(&rxTail, __ATOMIC_ACQUIRE) >= CAN_RX_RING_SIZE)
+        {
+            rxRingOverflows++;
+            return;
+        }
+        if (!canDriver->read(frame))
+            return;
+        rxRing[head & (CAN_RX_RING_SIZE - 1)] = frame;
+        __atomic_store_n(&rxHead, head + 1, __ATOMIC_RELEASE);
+    }
 }
 
-void sendVoltageCurrentTemp()
+static bool popCanRx(CanFrame &frame)
 {
-    // Données Brutes : 68 10 00 00 0E 01 00 00
+    uint32_t tail = rxTail;
+    if (tail == __atomic_load_n(&rxHead, __ATOMIC_ACQUIRE))
+        return false;
+    frame = rxRing[tail & (CAN_RX_RING_SIZE - 1)];
+    __atomic_store_n(&rxTail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
 
-    canFrame = {0};
-    canFrame.identifier = CAN_ID_VOLTAGE_CURRENT;
-    canFrame.extd = 0;
-    canFrame.data_length_code = 8;
+static void recordRx(uint32_t identifier, unsigned long now)
+{
+    for (uint8_t i = 0; i < rxStatsCount; i++)
+    {
+        CanRxStats &stats = rxStats[i];
+        if (stats.identifier != identifier)
+            continue;
+        stats.intervalMs = now - stats.lastMs;
+        stats.maxIntervalMs = max(stats.maxIntervalMs, stats.intervalMs);
+        stats.lastMs = now;
+        stats.count++;
+        return;
+    }
+    if (rxStatsCount >= CAN_RX_TRACKED_IDS)
+    {
+        rxUntracked++;
+        return;
+    }
+    CanRxStats &stats = rxStats[rxStatsCount++];
+    stats.identifier = identifier;
+    stats.count = 1;
+    stats.lastMs = now;
+    stats.intervalMs = 0;
+    stats.maxIntervalMs = 0;
+}
 
-    // Tension: 42.00V = 4200 = 0x1068
-    // Courant: 0.0A = 0 = 0x0000
-    // Température: 27.0°C = 270 = 0x010E
-    uint16_t voltage = 4200; // 42.00V en 0.01V
-    uint16_t current = 0;    // 0.0A
-    uint16_t temp = 270;     // 27.0°C en 0.1°C
+static void onInverterKeepalive(const CanFrame &frame)
+{
+    (void)frame;
+    inverterLastSeen = millis();
+    if (!inverterPresent)
+    {
+        inverterPresent = true;
+        markCanInputsChanged(CAN_INPUT_LIMITS);
+        Serial.println("Onduleur présent: consignes normales");
+    }
+}
 
-    // Format little-endian selon la doc
-    canFrame.data[0] = lowByte(voltage);  // 0x68
-    canFrame.data[1] = highByte(voltage); // 0x10
-    canFrame.data[2] = lowByte(current);  // 0x00
-    canFrame.data[3] = highByte(current); // 0x00
-    canFrame.data[4] = lowByte(temp);     // 0x0E
-    canFrame.data[5] = highByte(temp);    // 0x01
-    canFrame.data[6] = 0x00;              // Fixe
-    canFrame.data[7] = 0x00;              // Fixe
+static void dispatchCanFrame(const CanFrame &frame)
+{
+    traceRecord(TRACE_CAN_RX, 0, 0, frame.identifier, frame.data, frame.data_length_code, TRACE_OK);
+    recordRx(frame.identifier, millis());
+    windowBits += frameBits(frame);
 
-    ESP32Can.writeFrame(canFrame);
-    Serial.printf("CAN 0x356: V=%.2fV, I=%.1fA, T=%.1f°C\n",
-                  voltage / 100.0, current / 100.0, temp / 10.0);
+    // Routage par identifiant : la trame de présence vient de la table du protocole
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    if (table.keepaliveId != CAN_NO_KEEPALIVE && frame.identifier == table.keepaliveId)
+    {
+        onInverterKeepalive(frame);
+        return;
+    }
+    rxUnhandled++;
 }
 
-void sendAlarms()
+static void checkInverterWatchdog(unsigned long now)
 {
-    // Données Brutes : 00 00 04 00 01 00 00 00
+    if (!isInverterWatchdogActive())
+        return;
+    if (inverterPresent && now - inverterLastSeen > CAN_INVERTER_TIMEOUT_MS)
+    {
+        inverterPresent = false;
+        markCanInputsChanged(CAN_INPUT_LIMITS);
+        Serial.printf("Onduleur muet depuis %lums: courants plafonnés à %dA\n",
+                      now - inverterLastSeen, CAN_SAFE_CURRENT_A);
+    }
+}
 
-    canFrame = {0};
-    canFrame.identifier = CAN_ID_ALARMS;
-    canFrame.extd = 0;
-    canFrame.data_length_code = 8;
+void receiveCanData()
+{
+    drainCanRx();
 
-    canFrame.data[0] = 0x00; // Protections: aucune active
-    canFrame.data[1] = 0x00; // Réservé
-    canFrame.data[2] = 0x04; // Alarmes: bit 2 actif
-    canFrame.data[3] = 0x00; // Réservé
-    canFrame.data[4] = 0x01; // Nombre de modules: 1
-    canFrame.data[5] = 0x00; // Signature
-    canFrame.data[6] = 0x00; // Signature
-    canFrame.data[7] = 0x00; // Réservé
+    CanFrame frame;
+    while (popCanRx(frame))
+    {
+        dispatchCanFrame(frame);
+    }
+    checkInverterWatchdog(millis());
+}
 
-    ESP32Can.writeFrame(canFrame);
-    Serial.println("CAN 0x359: Alarmes envoyées");
+bool isInverterWatchdogActive()
+{
+    return CAN_PROTOCOLS[activeProtocol].keepaliveId != CAN_NO_KEEPALIVE;
 }
 
-void sendRequests()
+bool isInverterPresent()
 {
-    // FORMAT EXACT SELON CONSIGNE
-    // Données Brutes : C0 00 00 00 00 00 00 00
+    return inverterPresent;
+}
 
-    canFrame = {0};
-    canFrame.identifier = CAN_ID_REQUESTS;
-    canFrame.extd = 0;
-    canFrame.data_length_code = 8;
+const CanRxStats *getCanRxStats(uint8_t &count)
+{
+    count = rxStatsCount;
+    return rxStats;
+}
 
-    canFrame.data[0] = 0xC0; // Bits 7+6: Charge+Discharge enable
-    canFrame.data[1] = 0x00; // Réservé
-    canFrame.data[2] = 0x00; // Réservé
-    canFrame.data[3] = 0x00; // Réservé
-    canFrame.data[4] = 0x00; // Réservé
-    canFrame.data[5] = 0x00; // Réservé
-    canFrame.data[6] = 0x00; // Réservé
-    canFrame.data[7] = 0x00; // Réservé
+void printCanRxStats()
+{
+    unsigned long now = millis();
+    Serial.println("\n=== RÉCEPTION CAN ===");
+    for (uint8_t i = 0; i < rxStatsCount; i++)
+    {
+        const CanRxStats &stats = rxStats[i];
+        Serial.printf("%03lX reçues=%lu intervalle=%lums max=%lums dernière il y a %lums\n",
+                      (unsigned long)stats.identifier, (unsigned long)stats.count,
+                      stats.intervalMs, stats.maxIntervalMs, now - stats.lastMs);
+    }
+    Serial.printf("Sans traitement: %lu, non suivies: %lu, ring plein: %lu\n",
+                  (unsigned long)rxUnhandled, (unsigned long)rxUntracked,
+                  (unsigned long)rxRingOverflows);
+    if (!isInverterWatchdogActive())
+        Serial.println("Onduleur: pas de trame de présence dans ce protocole, pas de plafond");
+    else if (inverterPresent)
+        Serial.printf("Onduleur: présent (dernière trame il y a %lums)\n", now - inverterLastSeen);
+    else
+        Serial.printf("Onduleur: absent, courants plafonnés à %dA\n", CAN_SAFE_CURRENT_A);
+    Serial.println("=====================");
+}
 
-    ESP32Can.writeFrame(canFrame);
-    Serial.println("CAN 0x35C: Requêtes envoyées");
+// ——————— SANTÉ DU CONTRÔLEUR ———————
+
+static const char *canStateName(twai_state_t state)
+{
+    switch (state)
+    {
+    case TWAI_STATE_STOPPED:
+        return "ARRETE";
+    case TWAI_STATE_RUNNING:
+        return "EN MARCHE";
+    case TWAI_STATE_BUS_OFF:
+        return "BUS-OFF";
+    case TWAI_STATE_RECOVERING:
+        return "REPRISE";
+    }
+    return "?";
 }
 
-// ——————— FONCTIONS D'AFFICHAGE DES TRAMES ———————
+static uint8_t errorLevelOf(const twai_status_info_t &info)
+{
+    if (info.state == TWAI_STATE_BUS_OFF)
+        return CAN_ERROR_BUS_OFF;
+    uint32_t worst = max(info.tx_error_counter, info.rx_error_counter);
+    if (worst >= CAN_ERROR_PASSIVE_LIMIT)
+        return CAN_ERROR_PASSIVE;
+    if (worst >= CAN_ERROR_WARNING_LIMIT)
+        return CAN_ERROR_WARNING;
+    return CAN_ERROR_ACTIVE;
+}
 
-void updateCanFrameDisplay()
+static void handleBusOff(unsigned long now)
 {
-    // Mettre à jour les textes des trames avec les valeurs actuelles
-    uint16_t ichg = (uint16_t)(chargeCurrentSetpoint * 10);
-    uint16_t idis = (uint16_t)(dischargeCurrentSetpoint * 10);
+    // Reprise espacée : un câblage en défaut ne doit pas faire osciller le bus
+    static unsigned long nextRecoveryMs = 0;
+    static bool recovering = false;
 
-    sprintf(lastCanFrames[0], "351: 04 02 %02X %02X %02X %02X C9 01",
-            lowByte(ichg), highByte(ichg), lowByte(idis), highByte(idis));
+    if (health.state == TWAI_STATE_BUS_OFF)
+    {
+        if (!recovering)
+        {
+            recovering = true;
+            health.busOffCount++;
+            health.lastBusOffMs = now;
+            nextRecoveryMs = now + health.recoveryIntervalMs;
+            Serial.printf("CAN: bus-off (TEC=%lu), reprise dans %lums\n",
+                          (unsigned long)health.txErrorCounter, health.recoveryIntervalMs);
+        }
+        else if ((long)(now - nextRecoveryMs) >= 0)
+        {
+            health.recoveryAttempts++;
+            canDriver->recover();
+            // Délai doublé avant la tentative suivante, et pour le prochain bus-off
+            health.recoveryIntervalMs = min(health.recoveryIntervalMs * 2, (unsigned long)CAN_RECOVERY_MAX_INTERVAL_MS);
+            nextRecoveryMs = now + health.recoveryIntervalMs;
+        }
+    }
+    else if (health.state == TWAI_STATE_STOPPED && recovering)
+    {
+        // Reprise terminée : le contrôleur attend d'être relancé
+        if (canDriver->restart())
+        {
+            recovering = false;
+            health.recoveries++;
+            Serial.printf("CAN: contrôleur relancé après %lums de bus-off\n", now - health.lastBusOffMs);
+        }
+    }
+    else if (health.state == TWAI_STATE_RUNNING && health.busOffCount &&
+             now - health.lastBusOffMs > CAN_RECOVERY_MAX_INTERVAL_MS)
+    {
+        // Bus stable depuis longtemps : la prochaine reprise repart du délai minimal
+        health.recoveryIntervalMs = CAN_RECOVERY_MIN_INTERVAL_MS;
+    }
+}
+
+void updateCanHealth()
+{
+    static unsigned long lastSample = 0;
+    unsigned long now = millis();
+    unsigned long elapsed = now - lastSample;
+    if (elapsed < CAN_HEALTH_PERIOD_MS)
+        return;
+    lastSample = now;
+
+    if (!health.recoveryIntervalMs)
+        health.recoveryIntervalMs = CAN_RECOVERY_MIN_INTERVAL_MS;
+
+    // Charge : bits émis et reçus sur la période écoulée
+    health.busLoadPercent = windowBits * 100.0f / ((float)CAN_SPEED_KBPS * elapsed);
+    windowBits = 0;
+
+    twai_status_info_t info;
+    health.valid = canDriver->status(info);
+    if (!health.valid)
+        return;
 
-    strcpy(lastCanFrames[1], "355: 14 00 64 00 D0 07 00 00");
-    strcpy(lastCanFrames[2], "356: 68 10 00 00 0E 01 00 00");
-    strcpy(lastCanFrames[3], "359: 00 00 04 00 01 00 00 00");
-    strcpy(lastCanFrames[4], "35C: C0 00 00 00 00 00 00 00");
+    health.state = info.state;
+    health.errorLevel = errorLevelOf(info);
+    health.txErrorCounter = info.tx_error_counter;
+    health.rxErrorCounter = info.rx_error_counter;
+    health.txFailed = info.tx_failed_count;
+    health.rxMissed = info.rx_missed_count;
+    health.rxOverrun = info.rx_overrun_count;
+    health.arbLost = info.arb_lost_count;
+    health.busErrors = info.bus_error_count;
+
+    handleBusOff(now);
 }
 
+const CanHealth &getCanHealth()
+{
+    return health;
+}
+
+bool isCanBusHealthy()
+{
+    return health.valid && health.state == TWAI_STATE_RUNNING && health.errorLevel < CAN_ERROR_PASSIVE;
+}
+
+void printCanHealth()
+{
+    static const char *levelNames[] = {"active", "alerte", "passive", "bus-off"};
+    Serial.println("\n=== SANTÉ CAN ===");
+    if (!health.valid)
+    {
+        Serial.println("Statut du contrôleur indisponible (pilote non installé ?)");
+        Serial.println("=================");
+        return;
+    }
+    Serial.printf("État: %s, erreur %s (TEC=%lu REC=%lu)\n", canStateName(health.state),
+                  levelNames[health.errorLevel], (unsigned long)health.txErrorCounter,
+                  (unsigned long)health.rxErrorCounter);
+    Serial.printf("Charge bus: %.1f%% (%d kbps)\n", health.busLoadPercent, CAN_SPEED_KBPS);
+    Serial.printf("Émission: échecs=%lu arbitrages perdus=%lu refus writeFrame=%lu\n",
+                  (unsigned long)health.txFailed, (unsigned long)health.arbLost,
+                  (unsigned long)health.writeFailures);
+    Serial.printf("Réception: perdues=%lu débordements=%lu, erreurs bus=%lu\n",
+                  (unsigned long)health.rxMissed, (unsigned long)health.rxOverrun,
+                  (unsigned long)health.busErrors);
+    Serial.printf("Bus-off: %lu, tentatives=%lu, relances=%lu, prochain délai=%lums\n",
+                  (unsigned long)health.busOffCount, (unsigned long)health.recoveryAttempts,
+                  (unsigned long)health.recoveries, health.recoveryIntervalMs);
+    Serial.println("=================");
+}
+
+// ——————— FONCTIONS D'AFFICHAGE DES TRAMES ———————
+
 void showCanFrames()
 {
     extern void clearDisplay();
@@ -266,10 +920,16 @@ void showCanFrames()
     clearDisplay();
     drawTitle("TRAMES CAN");
 
-    // Afficher les 4 trames sur 4 lignes
-    for (int i = 0; i < 4; i++)
+    // Octets en cache des 4 premières trames (ceux réellement émis)
+    const CanProtocolTable &table = CAN_PROTOCOLS[activeProtocol];
+    for (uint8_t i = 0; i < 4 && i < table.frameCount; i++)
     {
-        drawText(2, 25 + i * 10, lastCanFrames[i], false, false);
+        const CanFrame &frame = frameCache[i];
+        char line[24]; // "351 0402640064...": 20 colonnes sur 21
+        snprintf(line, sizeof(line), "%03X %02X%02X%02X%02X%02X%02X%02X%02X",
+                 (unsigned)(frame.identifier & 0x7FF), frame.data[0], frame.data[1], frame.data[2],
+                 frame.data[3], frame.data[4], frame.data[5], frame.data[6], frame.data[7]);
+        drawText(2, 25 + i * 10, line, false, false);
     }
 
     // Instructions
@@ -281,8 +941,42 @@ void showCanFrames()
 void setCanDisplayActive(bool active)
 {
     canDisplayActive = active;
-    if (active)
+}
+
+void showCanHealthScreen()
+{
+    extern void clearDisplay();
+    extern void showDisplay();
+    extern void drawText(int x, int y, const char *text, bool large, bool inverted);
+    extern void drawTitle(const char *title);
+
+    clearDisplay();
+    drawTitle("DIAG CAN");
+
+    // 21 colonnes en police 6x10 : libellés courts ; tampon au pire cas des
+    // compteurs, l'écran coupe ce qui dépasse
+    char line[48];
+    if (!health.valid)
     {
-        updateCanFrameDisplay(); // Initialiser l'affichage
+        drawText(2, 25, "Statut indisponible", false, false);
+        showDisplay();
+        return;
     }
-}
\ No newline at end of file
+    snprintf(line, sizeof(line), "%s T%lu R%lu", canStateName(health.state),
+             (unsigned long)health.txErrorCounter, (unsigned long)health.rxErrorCounter);
+    drawText(2, 25, line, false, false);
+    snprintf(line, sizeof(line), "Bus %u%% Ond %s", (unsigned)min(health.busLoadPercent, 100.0f),
+             !isInverterWatchdogActive() ? "-" : isInverterPresent() ? "OK" : "absent");
+    drawText(2, 35, line, false, false);
+    snprintf(line, sizeof(line), "Ech %lu Arb %lu Ref %lu", (unsigned long)health.txFailed,
+             (unsigned long)health.arbLost, (unsigned long)health.writeFailures);
+    drawText(2, 45, line, false, false);
+    snprintf(line, sizeof(line), "RxPerd %lu Err %lu", (unsigned long)(health.rxMissed + health.rxOverrun),
+             (unsigned long)health.busErrors);
+    drawText(2, 55, line, false, false);
+    snprintf(line, sizeof(line), "BusOff %lu Repris %lu", (unsigned long)health.busOffCount,
+             (unsigned long)health.recoveries);
+    drawText(2, 64, line, false, false);
+
+    showDisplay();
+}
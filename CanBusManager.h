@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include <ESP32-TWAI-CAN.hpp>
 #include "Config.h"
+#include "TraceManager.h"
 
 // ——————— CONFIGURATION CAN (a ajouter dans Config.h si valide) ———————
 #ifndef CAN_TX_PIN
@@ -18,49 +19,196 @@
 #define CAN_SPEED_KBPS 500
 #endif
 
+#ifndef CAN_TX_QUEUE_SIZE
+#define CAN_TX_QUEUE_SIZE 5 // File d'émission TWAI (trames)
+#endif
+
+#ifndef CAN_RX_QUEUE_SIZE
+#define CAN_RX_QUEUE_SIZE 5 // File de réception TWAI (trames)
+#endif
+
+#ifndef CAN_INVERTER_TIMEOUT_MS
+#define CAN_INVERTER_TIMEOUT_MS 10000 // Onduleur muet au-delà : limites de sécurité
+#endif
+
+#ifndef CAN_SAFE_CURRENT_A
+#define CAN_SAFE_CURRENT_A 10 // Courants de charge/décharge plafonnés sans onduleur
+#endif
+
+#ifndef CAN_MANUFACTURER_NAME
+#define CAN_MANUFACTURER_NAME "PYLON   " // 0x35E, 8 caractères ASCII
+#endif
+
+#ifndef CAN_DEFAULT_PROTOCOL
+#define CAN_DEFAULT_PROTOCOL PROTOCOL_PYLONTECH // Sans protocole enregistré en NVS
+#endif
+
 // ——————— PROTOCOLES SUPPORTÉS ———————
 enum CanProtocol
 {
     PROTOCOL_PYLONTECH = 0,
-    PROTOCOL_SOLIS = 1
+    PROTOCOL_COUNT = 1
 };
 
 // IDs des trames CAN selon protocole
 // Pylontech/BYD
-#define PYLON_ID_LIMITS 0x351
-#define PYLON_ID_SOC_SOH 0x355
-#define PYLON_ID_VOLTAGE_CURRENT 0x356
-
-// Solis
-#define SOLIS_ID_LIMITS 0x320
-#define SOLIS_ID_SOC_SOH 0x323
-#define SOLIS_ID_VOLTAGE_CURRENT 0x325
-
-// IDs des trames CAN selon protocole Pylontech/BYD
-#define CAN_ID_LIMITS 0x351          // Limites Charge/Décharge
-#define CAN_ID_SOC_SOH 0x355         // SOC/SOH
-#define CAN_ID_VOLTAGE_CURRENT 0x356 // Tensions/Courants
-#define CAN_ID_ALARMS 0x359          // Status Protections/Alarmes
-#define CAN_ID_REQUESTS 0x35C        // Indicateurs de Requête
-#define CAN_ID_MANUFACTURER 0x35E    // Nom du Fabricant
-
-// Timing d'envoi
+#define PYLON_ID_LIMITS 0x351          // Limites Charge/Décharge
+#define PYLON_ID_SOC_SOH 0x355         // SOC/SOH
+#define PYLON_ID_VOLTAGE_CURRENT 0x356 // Tensions/Courants
+#define PYLON_ID_ALARMS 0x359          // Status Protections/Alarmes
+#define PYLON_ID_REQUESTS 0x35C        // Indicateurs de Requête
+#define PYLON_ID_MANUFACTURER 0x35E    // Nom du Fabricant
+#define PYLON_ID_INVERTER_KEEPALIVE 0x305 // Reçue : présence de l'onduleur
+
+// Timing d'envoi (période par défaut des trames)
 #define CAN_SEND_INTERVAL_MS 1000
+#define CAN_MAX_PROTOCOL_FRAMES 8
 
-// Limites pour consignes variables
-#define MAX_CHARGE_CURRENT_A 600 // 0 à 600A pour 4 batteries
+// Ordonnanceur d'émission : chaque trame part à sa phase dans sa période,
+// au plus CAN_TX_FRAMES_PER_CALL par appel, pour ne jamais remplir la file
+// d'un coup. Les dernières places de la file sont gardées aux trames critiques.
+#define CAN_TX_FRAMES_PER_CALL 1
+#define CAN_TX_RESERVED_SLOTS 2
+
+// Réception : la file TWAI est vidée à chaque boucle dans un ring (un
+// producteur, un consommateur, sans verrou), puis chaque trame est routée
+// vers son traitement par la table des identifiants reçus.
+#define CAN_RX_RING_SIZE 32   // Trames (puissance de 2)
+#define CAN_RX_TRACKED_IDS 16 // Identifiants suivis dans les statistiques
+
+// Santé du contrôleur : compteurs TWAI relus à chaque période, reprise
+// automatique après bus-off espacée (doublée à chaque nouvel échec)
+#define CAN_HEALTH_PERIOD_MS 1000
+#define CAN_RECOVERY_MIN_INTERVAL_MS 1000
+#define CAN_RECOVERY_MAX_INTERVAL_MS 60000
+#define CAN_ERROR_WARNING_LIMIT 96  // TEC/REC : seuil d'alerte du contrôleur
+#define CAN_ERROR_PASSIVE_LIMIT 128 // TEC/REC : erreur passive
+#define CAN_FRAME_OVERHEAD_BITS 47  // Trame standard hors données, sans bits de bourrage
+
+
+// ——————— TABLES DE PROTOCOLE ———————
+// Un protocole = une table de trames (ID, période, encodeur). Les encodeurs
+// sont générés à la compilation à partir de champs (voir CanBusManager.cpp) ;
+// changer de protocole ne change que la table parcourue.
+
+typedef void (*CanFrameEncoder)(uint8_t *data);
+
+// Comportement d'une trame quand la file d'émission est pleine
+enum CanTxPriority
+{
+    CAN_PRIORITY_CRITICAL = 0, // Réessayée aux appels suivants jusqu'à émission
+    CAN_PRIORITY_NORMAL = 1    // Abandonnée pour cette période
+};
+
+// Données dont dépend l'encodage d'une trame (masque) : une trame n'est
+// ré-encodée que si l'une d'elles a changé, sinon ses octets en cache repartent
+enum CanInput
+{
+    CAN_INPUT_NONE = 0x00,      // Contenu fixe
+    CAN_INPUT_LIMITS = 0x01,    // Limites (LimitManager), plafond de sécurité
+    CAN_INPUT_PACK = 0x02,      // Valeurs agrégées du pack
+    CAN_INPUT_ALL = 0xFF
+};
+
+struct CanFrameSpec
+{
+    uint32_t identifier;
+    uint16_t periodMs;
+    uint16_t phaseMs; // Décalage dans la période (étale les émissions)
+    uint8_t priority; // CanTxPriority
+    uint8_t inputs;   // CanInput
+    uint8_t length;
+    CanFrameEncoder encode;
+};
+
+#define CAN_NO_KEEPALIVE 0xFFFFFFFF // Protocole sans trame de présence de l'onduleur
+
+struct CanProtocolTable
+{
+    const char *name;
+    const CanFrameSpec *frames;
+    uint8_t frameCount;
+    uint32_t keepaliveId; // Trame reçue de l'onduleur (chien de garde), ou CAN_NO_KEEPALIVE
+};
+
+// Statistiques d'émission d'une trame du protocole actif
+struct CanTxStats
+{
+    uint32_t identifier;
+    uint32_t sent;
+    uint32_t encodes; // Ré-encodages (données changées) ; sent - encodes = octets en cache
+    uint32_t retries; // Critique : file pleine, réessayée
+    uint32_t dropped; // Normale : file pleine, période sautée
+    unsigned long lastSentMs;
+    unsigned long achievedPeriodMs; // Dernier intervalle réel entre deux émissions
+    unsigned long maxJitterMs;      // |intervalle réel - période|
+    uint32_t jitterSumMs;           // Moyenne = somme / (sent - 1)
+};
+
+// Statistiques de réception d'un identifiant
+struct CanRxStats
+{
+    uint32_t identifier;
+    uint32_t count;
+    unsigned long lastMs;
+    unsigned long intervalMs;    // Dernier intervalle entre deux trames
+    unsigned long maxIntervalMs;
+};
+
+// Niveau d'erreur du contrôleur (ISO 11898)
+enum CanErrorLevel
+{
+    CAN_ERROR_ACTIVE = 0,
+    CAN_ERROR_WARNING = 1, // TEC ou REC >= CAN_ERROR_WARNING_LIMIT
+    CAN_ERROR_PASSIVE = 2, // TEC ou REC >= CAN_ERROR_PASSIVE_LIMIT
+    CAN_ERROR_BUS_OFF = 3
+};
+
+// Santé du contrôleur (dernier échantillon)
+struct CanHealth
+{
+    bool valid; // Statut lu auprès du pilote
+    twai_state_t state;
+    uint8_t errorLevel; // CanErrorLevel
+    uint32_t txErrorCounter;
+    uint32_t rxErrorCounter;
+    uint32_t txFailed;  // Cumuls du pilote depuis le démarrage
+    uint32_t rxMissed;  // File de réception pleine
+    uint32_t rxOverrun; // FIFO matérielle débordée
+    uint32_t arbLost;
+    uint32_t busErrors;
+    uint32_t writeFailures; // writeFrame() refusé
+    uint32_t busOffCount;
+    uint32_t recoveryAttempts;
+    uint32_t recoveries; // Contrôleur relancé après bus-off
+    unsigned long lastBusOffMs;
+    unsigned long recoveryIntervalMs; // Délai avant la prochaine tentative
+    float busLoadPercent;             // Trames émises + reçues, dernière période
+};
+
+// Pilote CAN (TWAI par défaut ; remplaçable pour un essai sur l'hôte)
+struct CanDriver
+{
+    bool (*write)(const CanFrame &frame);
+    uint32_t (*txPending)();      // Trames en attente dans la file d'émission
+    bool (*read)(CanFrame &frame); // Sans attente : false si la file est vide
+    bool (*status)(twai_status_info_t &info);
+    bool (*recover)(); // Lance la reprise après bus-off
+    bool (*restart)(); // Relance le contrôleur une fois la reprise terminée
+};
+
+// Plafonds des consignes opérateur (le moteur de limites déclasse en dessous)
+#define MAX_CHARGE_CURRENT_A 600 // Banc complet ; nominal par batterie : LIMIT_BATTERY_*
 #define MAX_DISCHARGE_CURRENT_A 600
 
 // ——————— VARIABLES GLOBALES ———————
-extern CanFrame canFrame;
 extern unsigned long lastCanSend;
 
-// Variables pour consignes dynamiques
+// Consignes opérateur : courants maximaux avant déclassement (LimitManager)
 extern float chargeCurrentSetpoint;    // 0 à 600A
 extern float dischargeCurrentSetpoint; // 0 à 600A
 
 // Variables pour affichage des trames
-extern char lastCanFrames[5][50]; // Stockage des 5 dernières trames
 extern bool canDisplayActive;
 
 // ——————— FONCTIONS PUBLIQUES ———————
@@ -74,20 +222,43 @@ void setDischargeCurrentSetpoint(float currentA); // 0-600A
 float getChargeCurrentSetpoint();
 float getDischargeCurrentSetpoint();
 
-// Envoi des données
+// Protocole onduleur (persisté)
+bool setCanProtocol(CanProtocol protocol, bool persist);
+CanProtocol getCanProtocol();
+const CanProtocolTable &getCanProtocolTable();
+bool setCanProtocolByName(const char *name); // "pylontech"
+
+// Envoi des données (trames dues du protocole actif)
 void sendCanData();
 bool shouldSendCan();
 
-// Envoi de trames spécifiques
-void sendChargeLimits();
-void sendSocSoh();
-void sendVoltageCurrentTemp();
-void sendAlarms();
-void sendRequests();
+// Cache des trames encodées
+void markCanInputsChanged(uint8_t inputs); // Masque CanInput
+const CanFrame &getCachedCanFrame(uint8_t frame); // Index dans la table active
+void printCanFrameCache();
+
+// Ordonnanceur d'émission
+void setCanDriver(const CanDriver *driver); // nullptr = TWAI
+const CanTxStats &getCanTxStats(uint8_t frame); // Index dans la table active
+void resetCanTxStats();
+void printCanTxStats();
+
+// Réception et présence de l'onduleur (à appeler à chaque boucle)
+void receiveCanData();
+bool isInverterWatchdogActive(); // Le protocole actif a une trame de présence
+bool isInverterPresent();         // false (chien de garde actif) : courants plafonnés à CAN_SAFE_CURRENT_A
+const CanRxStats *getCanRxStats(uint8_t &count);
+void printCanRxStats();
+
+// Santé du contrôleur (à appeler à chaque boucle, échantillonne à sa période)
+void updateCanHealth();
+const CanHealth &getCanHealth();
+bool isCanBusHealthy(); // En marche, sous le seuil d'erreur passive
+void printCanHealth();
 
-// Fonctions d'affichage des trames
-void updateCanFrameDisplay();
+// Fonctions d'affichage des trames (octets du cache)
 void showCanFrames();
+void showCanHealthScreen();
 void setCanDisplayActive(bool active);
 
 #endif
\ No newline at end of file
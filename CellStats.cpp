@@ -0,0 +1,201 @@
+#include "CellStats.h"
+#include <math.h>
+#include <string.h>
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+// ——————— ACCUMULATEURS ———————
+
+void resetCellStats(CellStatsAccumulator &acc)
+{
+    acc.count = 0;
+    acc.minMv = 0xFFFF;
+    acc.maxMv = 0;
+    acc.sumMv = 0;
+    acc.sumSquares = 0;
+}
+
+void mergeCellStats(CellStatsAccumulator &acc, const CellStatsAccumulator &other)
+{
+    acc.count += other.count;
+    if (other.minMv < acc.minMv)
+        acc.minMv = other.minMv;
+    if (other.maxMv > acc.maxMv)
+        acc.maxMv = other.maxMv;
+    acc.sumMv += other.sumMv;
+    acc.sumSquares += other.sumSquares;
+}
+
+CellStats finishCellStats(const CellStatsAccumulator &acc)
+{
+    CellStats stats = {};
+    stats.count = acc.count;
+    if (!acc.count)
+        return stats;
+
+    stats.minMv = acc.minMv;
+    stats.maxMv = acc.maxMv;
+    stats.imbalanceMv = acc.maxMv - acc.minMv;
+    stats.meanMv = (float)acc.sumMv / acc.count;
+
+    // Variance exacte en entiers : (n·Σv² - (Σv)²) / n²
+    uint64_t sum = acc.sumMv;
+    uint64_t spread = (uint64_t)acc.count * acc.sumSquares - sum * sum;
+    stats.stddevMv = sqrtf((float)spread) / acc.count;
+    return stats;
+}
+
+bool sameCellStats(const CellStatsAccumulator &a, const CellStatsAccumulator &b)
+{
+    return a.count == b.count && a.minMv == b.minMv && a.maxMv == b.maxMv &&
+           a.sumMv == b.sumMv && a.sumSquares == b.sumSquares;
+}
+
+// ——————— VARIANTES ———————
+
+void accumulateCellStatsScalar(CellStatsAccumulator &acc, const uint16_t *cells, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t v = cells[i];
+        if (v == 0)
+            continue; // Cellule absente
+        acc.count++;
+        if (v < acc.minMv)
+            acc.minMv = v;
+        if (v > acc.maxMv)
+            acc.maxMv = v;
+        acc.sumMv += v;
+        acc.sumSquares += (uint32_t)v * v;
+    }
+}
+
+void accumulateCellStatsVector(CellStatsAccumulator &acc, const uint16_t *__restrict cells, size_t count)
+{
+    // Sans branche : une cellule absente (0) ajoute 0 aux sommes et au max ;
+    // pour le min, v - 1 l'envoie à 0xFFFF (les présentes gardent leur ordre).
+    // Réductions indépendantes que le compilateur vectorise (-O3).
+    uint32_t present = 0;
+    uint16_t minBiased = 0xFFFF;
+    uint16_t maxMv = 0;
+    uint32_t sum = 0;
+    uint64_t squares = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint16_t v = cells[i];
+        present += v != 0;
+        uint16_t biased = (uint16_t)(v - 1);
+        minBiased = biased < minBiased ? biased : minBiased;
+        maxMv = v > maxMv ? v : maxMv;
+        sum += v;
+        squares += (uint32_t)v * v;
+    }
+
+    acc.count += present;
+    if (present && (uint16_t)(minBiased + 1) < acc.minMv)
+        acc.minMv = minBiased + 1;
+    if (maxMv > acc.maxMv)
+        acc.maxMv = maxMv;
+    acc.sumMv += sum;
+    acc.sumSquares += squares;
+}
+
+void accumulateCellStatsWords(CellStatsAccumulator &acc, const uint16_t *cells, size_t count)
+{
+    // Xtensa (LX6/LX7) : pas de SIMD 16 bits exploitable par le compilateur,
+    // mais MINU/MAXU et MUL16U en un cycle. Un chargement 32 bits pour deux
+    // cellules, deux chaînes de min/max indépendantes, mêmes règles que la
+    // variante sans branche.
+    uint32_t present = 0;
+    uint32_t minA = 0xFFFF, minB = 0xFFFF;
+    uint32_t maxA = 0, maxB = 0;
+    uint32_t sum = 0;
+    uint64_t squares = 0;
+
+    size_t i = 0;
+    if (((uintptr_t)cells & 2) && count)
+    {
+        // Tête non alignée sur 32 bits
+        accumulateCellStatsVector(acc, cells, 1);
+        i = 1;
+    }
+
+    const uint16_t *aligned = (const uint16_t *)__builtin_assume_aligned(cells + i, 4);
+    size_t pairs = (count - i) / 2;
+    for (size_t p = 0; p < pairs; p++)
+    {
+        uint32_t w;
+        memcpy(&w, aligned + 2 * p, sizeof(w)); // Un seul l32i (little-endian)
+        uint32_t a = w & 0xFFFF;
+        uint32_t b = w >> 16;
+        present += (a != 0) + (b != 0);
+        uint32_t biasedA = (a - 1) & 0xFFFF;
+        uint32_t biasedB = (b - 1) & 0xFFFF;
+        minA = biasedA < minA ? biasedA : minA;
+        minB = biasedB < minB ? biasedB : minB;
+        maxA = a > maxA ? a : maxA;
+        maxB = b > maxB ? b : maxB;
+        sum += a + b;
+        squares += a * a; // Chaque carré tient sur 32 bits, pas leur somme
+        squares += b * b;
+    }
+
+    CellStatsAccumulator part;
+    part.count = present;
+    part.minMv = present ? (uint16_t)((minA < minB ? minA : minB) + 1) : 0xFFFF;
+    part.maxMv = maxA > maxB ? maxA : maxB;
+    part.sumMv = sum;
+    part.sumSquares = squares;
+    mergeCellStats(acc, part);
+
+    if ((count - i) & 1)
+        accumulateCellStatsVector(acc, cells + count - 1, 1);
+}
+
+// ——————— BENCHMARK ———————
+#ifdef ARDUINO
+void benchmarkCellStats()
+{
+    // Cycles par cellule : 9 et 32 batteries x 48 cellules, 16 présentes par batterie
+    static uint16_t cells[32 * 48];
+    for (int i = 0; i < 32 * 48; i++)
+        cells[i] = (i % 48) < 16 ? (uint16_t)(3200 + (i * 37) % 250) : 0;
+
+    const uint16_t batteries[] = {9, 32};
+    const char *names[] = {"scalaire", "sans branche", "mots 32 bits"};
+    void (*variants[])(CellStatsAccumulator &, const uint16_t *, size_t) = {
+        accumulateCellStatsScalar, accumulateCellStatsVector, accumulateCellStatsWords};
+    const int iterations = 100;
+
+    Serial.println("\n=== BENCHMARK STATISTIQUES CELLULES ===");
+    for (int s = 0; s < 2; s++)
+    {
+        size_t count = batteries[s] * 48;
+        CellStatsAccumulator reference;
+        resetCellStats(reference);
+        accumulateCellStatsScalar(reference, cells, count);
+
+        for (int v = 0; v < 3; v++)
+        {
+            CellStatsAccumulator acc;
+            uint32_t start = ESP.getCycleCount();
+            for (int n = 0; n < iterations; n++)
+            {
+                resetCellStats(acc);
+                variants[v](acc, cells, count);
+            }
+            uint32_t cycles = ESP.getCycleCount() - start;
+
+            Serial.printf("%2d x 48 %-13s : %5.2f cycles/cellule %s\n", batteries[s], names[v],
+                          (float)cycles / ((float)iterations * count),
+                          sameCellStats(acc, reference) ? "OK" : "ERREUR");
+        }
+    }
+    CellStats stats = finishCellStats(reference);
+    Serial.printf("min=%u max=%u moyenne=%.1f écart-type=%.2f mV\n", stats.minMv, stats.maxMv,
+                  stats.meanMv, stats.stddevMv);
+    Serial.println("=======================================\n");
+}
+#endif
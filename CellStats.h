@@ -0,0 +1,59 @@
+#ifndef CELL_STATS_H
+#define CELL_STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ——————— STATISTIQUES CELLULES ———————
+// Noyau sur tableaux packés de tensions cellules (uint16 mV, 0 = cellule
+// absente, comme BatteryData). Sans dépendance Arduino : compilé aussi par
+// tools/cell_stats_bench.cpp sur l'hôte.
+//
+// Les accumulateurs sont entiers : toutes les variantes donnent exactement
+// le même résultat, et les accumulateurs de plusieurs batteries se cumulent
+// (mergeCellStats). Moyenne et écart-type en dérivent (finishCellStats).
+
+struct CellStatsAccumulator
+{
+    uint32_t count;      // Cellules présentes
+    uint16_t minMv;      // 0xFFFF tant qu'aucune cellule
+    uint16_t maxMv;
+    uint32_t sumMv;
+    uint64_t sumSquares; // mV²
+};
+
+struct CellStats
+{
+    uint32_t count;
+    uint16_t minMv;
+    uint16_t maxMv;
+    uint16_t imbalanceMv; // max - min
+    float meanMv;
+    float stddevMv; // Écart-type de population
+};
+
+void resetCellStats(CellStatsAccumulator &acc);
+void mergeCellStats(CellStatsAccumulator &acc, const CellStatsAccumulator &other);
+CellStats finishCellStats(const CellStatsAccumulator &acc);
+bool sameCellStats(const CellStatsAccumulator &a, const CellStatsAccumulator &b);
+
+// Variantes (résultats identiques)
+void accumulateCellStatsScalar(CellStatsAccumulator &acc, const uint16_t *cells, size_t count); // Référence
+void accumulateCellStatsVector(CellStatsAccumulator &acc, const uint16_t *cells, size_t count); // Sans branche, auto-vectorisable
+void accumulateCellStatsWords(CellStatsAccumulator &acc, const uint16_t *cells, size_t count);  // Xtensa : 2 cellules par mot 32 bits
+
+// Variante retenue pour la cible
+inline void accumulateCellStats(CellStatsAccumulator &acc, const uint16_t *cells, size_t count)
+{
+#if defined(ARDUINO_ARCH_ESP32)
+    accumulateCellStatsWords(acc, cells, count);
+#else
+    accumulateCellStatsVector(acc, cells, count);
+#endif
+}
+
+#ifdef ARDUINO
+void benchmarkCellStats(); // Cycles par cellule de chaque variante (port série)
+#endif
+
+#endif
@@ -1,4 +1,8 @@
 #include "DisplayManager.h"
+#include "ModbusManager.h"
+#include "PackManager.h"
+#include "CanBusManager.h"
+#include "LimitManager.h"
 
 // ——————— VARIABLE GLOBALE ———————
 U8G2 *display_u8g2 = nullptr;
@@ -90,13 +94,14 @@ void showMainData()
 {
     clearDisplay();
 
-    // Données fictives pour test
-    float soc = 75.5;              // %
-    float voltage = 51.2;          // V
-    float current = -12.3;         // A (négatif = charge)
-    float chargeSetpoint = 450;    // A
-    float dischargeSetpoint = 600; // A
-    float avgTemp = 23.4;          // °C
+    // Instantané du pack (PackManager) et limites envoyées à l'onduleur
+    const PackSnapshot &pack = getPackSnapshot();
+    float soc = getPackSocPercent();                         // %
+    float voltage = getPackVoltage();                        // V
+    float current = getPackCurrent();                        // A (négatif = charge)
+    float chargeLimit = getChargeCurrentLimitA();       // A, CCL envoyée
+    float dischargeLimit = getDischargeCurrentLimitA(); // A, DCL envoyée
+    float maxTemp = pack.extremum[PACK_TEMP_MAX] * 0.1f;     // °C, capteur le plus chaud
 
     // Ligne 1 : SOC et Tension
     char line[32];
@@ -110,19 +115,24 @@ void showMainData()
     sprintf(line, "I:%.1fA", current);
     drawText(5, 22, line);
 
-    sprintf(line, "Temp:%.1fC", avgTemp);
+    sprintf(line, "Tmax:%.1fC", maxTemp);
     drawText(70, 22, line);
 
-    // Ligne 3 : Consignes
-    sprintf(line, "Ch:%dA", (int)chargeSetpoint);
+    // Ligne 3 : Limites envoyées à l'onduleur
+    sprintf(line, "Ch:%dA", (int)chargeLimit);
     drawText(5, 32, line);
 
-    sprintf(line, "Dch:%dA", (int)dischargeSetpoint);
+    sprintf(line, "Dch:%dA", (int)dischargeLimit);
     drawText(70, 32, line);
 
-    // Ligne 5 : Boutons
-    drawText(5, 55, "R:N/A");
-    drawText(80, 55, "OK:menu");
+    // Ligne 4 : Cellules extrêmes
+    sprintf(line, "Cell:%ld-%ldmV", (long)pack.extremum[PACK_CELL_MIN], (long)pack.extremum[PACK_CELL_MAX]);
+    drawText(5, 42, line);
+
+    // Ligne 5 : Batteries comptées et boutons
+    sprintf(line, "Bat:%d/%d", pack.onlineCount, batteryCount);
+    drawText(5, 55, line);
+    drawText(80, 55, isCanBusHealthy() ? "OK:menu" : "CAN HS!");
 
     showDisplay();
 }
\ No newline at end of file
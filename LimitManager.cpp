@@ -0,0 +1,372 @@
+#include "LimitManager.h"
+#include "PackManager.h"
+#include "ModbusManager.h"
+#include "CanBusManager.h"
+
+// ——————— COURBES DE DÉCLASSEMENT ———————
+// Points (x, facteur Q8) à x strictement croissant : interpolation linéaire
+// entre deux points, valeur du bord au-delà. Tout est constexpr : les
+// courbes sont vérifiées et échantillonnées à la compilation (static_assert).
+
+struct DeratePoint
+{
+    int16_t x;
+    uint16_t factor;
+};
+
+constexpr uint16_t interpolate(const DeratePoint *curve, size_t n, int32_t x)
+{
+    return (n == 1 || x <= curve[0].x) ? curve[0].factor
+           : x < curve[1].x
+               ? (uint16_t)(curve[0].factor + ((int32_t)curve[1].factor - curve[0].factor) *
+                                                  (x - curve[0].x) / (curve[1].x - curve[0].x))
+               : interpolate(curve + 1, n - 1, x);
+}
+
+constexpr bool ascending(const DeratePoint *curve, size_t n)
+{
+    return n < 2 || (curve[0].x < curve[1].x && ascending(curve + 1, n - 1));
+}
+
+template <size_t N>
+constexpr uint16_t derate(const DeratePoint (&curve)[N], int32_t x)
+{
+    return interpolate(curve, N, x);
+}
+
+template <size_t N>
+constexpr bool isAscending(const DeratePoint (&curve)[N])
+{
+    return ascending(curve, N);
+}
+
+// Charge : cellule la plus haute (mV), températures (0.1 °C), SOC (brut, 1000 = 100 %)
+static constexpr DeratePoint CHARGE_BY_CELL_MAX[] = {{3400, 256}, {3450, 128}, {3500, 38}, {3550, 0}};
+static constexpr DeratePoint CHARGE_BY_TEMP[] = {{0, 0}, {50, 51}, {100, 128}, {150, 256},
+                                                 {450, 256}, {500, 128}, {550, 0}};
+static constexpr DeratePoint CHARGE_BY_SOC[] = {{900, 256}, {950, 128}, {1000, 26}};
+
+// Décharge : cellule la plus basse, températures, SOC
+static constexpr DeratePoint DISCHARGE_BY_CELL_MIN[] = {{2800, 0}, {2900, 38}, {3000, 128}, {3100, 256}};
+static constexpr DeratePoint DISCHARGE_BY_TEMP[] = {{-200, 0}, {-100, 128}, {0, 256},
+                                                    {500, 256}, {550, 128}, {600, 0}};
+static constexpr DeratePoint DISCHARGE_BY_SOC[] = {{50, 0}, {100, 64}, {200, 256}};
+
+static_assert(isAscending(CHARGE_BY_CELL_MAX) && isAscending(CHARGE_BY_TEMP) && isAscending(CHARGE_BY_SOC) &&
+                  isAscending(DISCHARGE_BY_CELL_MIN) && isAscending(DISCHARGE_BY_TEMP) &&
+                  isAscending(DISCHARGE_BY_SOC),
+              "Courbe de déclassement : x doit être strictement croissant");
+static_assert(derate(CHARGE_BY_CELL_MAX, 3300) == LIMIT_FACTOR_ONE && derate(CHARGE_BY_CELL_MAX, 3425) == 192 &&
+                  derate(CHARGE_BY_CELL_MAX, 3600) == 0,
+              "Interpolation de CHARGE_BY_CELL_MAX");
+static_assert(derate(CHARGE_BY_TEMP, -50) == 0 && derate(CHARGE_BY_TEMP, 250) == LIMIT_FACTOR_ONE &&
+                  derate(DISCHARGE_BY_TEMP, -150) == 64,
+              "Interpolation des courbes de température");
+
+// ——————— VARIABLES ———————
+
+static PackLimits limits = {0, 0, LIMIT_CHARGE_VOLTAGE_DV, LIMIT_DISCHARGE_VOLTAGE_DV,
+                            0, 0, 0, 0, 0, 0, LIMIT_FACTOR_ONE, LIMIT_FACTOR_ONE,
+                            LIMIT_NO_DATA, LIMIT_NO_DATA, 0, 0, 0, 0};
+static uint32_t lastPackSeq = 0;
+static float lastChargeSetpoint = -1;
+static float lastDischargeSetpoint = -1;
+static unsigned long lastSlewMs = 0;
+
+// Facteurs de partage lissés (Q8 << 8) : charge, décharge
+static int32_t chargeSharingState = LIMIT_FACTOR_ONE << 8;
+static int32_t dischargeSharingState = LIMIT_FACTOR_ONE << 8;
+
+// ——————— DÉCLASSEMENT PAR BATTERIE ———————
+
+struct Derating
+{
+    uint16_t factor; // Q8
+    uint8_t reason;  // LimitReason
+};
+
+static void applyCurve(Derating &derating, uint16_t factor, uint8_t reason)
+{
+    if (factor < derating.factor)
+    {
+        derating.factor = factor;
+        derating.reason = reason;
+    }
+}
+
+static Derating chargeDerating(const int32_t *extremum, uint8_t mask)
+{
+    // Courbes de température en cloche : le pire est à l'un des deux extrêmes
+    Derating derating = {LIMIT_FACTOR_ONE, LIMIT_NONE};
+    if (mask & (1 << PACK_CELL_MAX))
+        applyCurve(derating, derate(CHARGE_BY_CELL_MAX, extremum[PACK_CELL_MAX]), LIMIT_CELL_VOLTAGE);
+    if (mask & (1 << PACK_TEMP_MIN))
+    {
+        applyCurve(derating, derate(CHARGE_BY_TEMP, extremum[PACK_TEMP_MIN]), LIMIT_TEMPERATURE);
+        applyCurve(derating, derate(CHARGE_BY_TEMP, extremum[PACK_TEMP_MAX]), LIMIT_TEMPERATURE);
+    }
+    applyCurve(derating, derate(CHARGE_BY_SOC, extremum[PACK_SOC_MIN]), LIMIT_SOC);
+    return derating;
+}
+
+static Derating dischargeDerating(const int32_t *extremum, uint8_t mask)
+{
+    Derating derating = {LIMIT_FACTOR_ONE, LIMIT_NONE};
+    if (mask & (1 << PACK_CELL_MIN))
+        applyCurve(derating, derate(DISCHARGE_BY_CELL_MIN, extremum[PACK_CELL_MIN]), LIMIT_CELL_VOLTAGE);
+    if (mask & (1 << PACK_TEMP_MIN))
+    {
+        applyCurve(derating, derate(DISCHARGE_BY_TEMP, extremum[PACK_TEMP_MIN]), LIMIT_TEMPERATURE);
+        applyCurve(derating, derate(DISCHARGE_BY_TEMP, extremum[PACK_TEMP_MAX]), LIMIT_TEMPERATURE);
+    }
+    applyCurve(derating, derate(DISCHARGE_BY_SOC, extremum[PACK_SOC_MIN]), LIMIT_SOC);
+    return derating;
+}
+
+// ——————— COURANT NOMINAL ET PARTAGE ———————
+
+// Batteries comptées dans un sens de courant (MOSFET fermé)
+struct BankShare
+{
+    uint32_t ratedDa; // Somme des nominaux
+    uint32_t loadDa;  // Courant total dans ce sens
+    uint16_t slotRatedDa[MAX_BATTERIES];
+    uint16_t slotLoadDa[MAX_BATTERIES]; // 0 = non chargée (ou pas comptée)
+};
+
+static uint16_t ratedCurrentDa(uint8_t slot, uint16_t reg, uint16_t fallbackA, uint16_t ceilingA, bool &fromSettings)
+{
+    // Réglage retenu s'il est plausible (non nul, sous le plafond du banc)
+    uint16_t value;
+    if (getBatterySettingRegister(batterySlotIds[slot], reg, &value) && value && value <= ceilingA * 10)
+    {
+        fromSettings = true;
+        return value;
+    }
+    return fallbackA * 10;
+}
+
+static void addToBank(BankShare &bank, uint8_t slot, uint16_t ratedDa, int32_t loadDa)
+{
+    bank.ratedDa += ratedDa;
+    bank.slotRatedDa[slot] = ratedDa;
+    bank.slotLoadDa[slot] = loadDa > 0 ? (uint16_t)loadDa : 0;
+    bank.loadDa += bank.slotLoadDa[slot];
+}
+
+static int32_t measureSharing(const BankShare &bank)
+{
+    // Nominal × courant total / courant de la batterie : courant de banc qui
+    // mettrait cette batterie à son nominal. La plus chargée relativement fixe
+    // le banc. -1 : courant trop faible pour juger du partage.
+    if (bank.loadDa < LIMIT_SHARING_MIN_DA || !bank.ratedDa)
+        return -1;
+    uint32_t bankDa = bank.ratedDa;
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (bank.slotLoadDa[slot])
+            bankDa = min(bankDa, (uint32_t)((uint64_t)bank.slotRatedDa[slot] * bank.loadDa / bank.slotLoadDa[slot]));
+    }
+    return (int32_t)((uint64_t)bankDa * LIMIT_FACTOR_ONE / bank.ratedDa);
+}
+
+static uint16_t filterSharing(int32_t &state, int32_t measured)
+{
+    // Lecture des batteries à des instants différents : lissage. Sans mesure,
+    // le dernier facteur est conservé.
+    if (measured >= 0)
+        state += ((measured << 8) - state) >> LIMIT_SHARING_FILTER_SHIFT;
+    return (uint16_t)((state + 128) >> 8);
+}
+
+// ——————— CIBLES ———————
+
+static uint16_t bankTarget(float setpointA, uint32_t ratedDa, uint16_t sharing, Derating &derating)
+{
+    // Nominal du banc réduit par le partage, plafonné par la consigne, × facteur Q8
+    uint32_t setpointDa = (uint32_t)(setpointA * 10);
+    uint32_t usableDa = ratedDa * sharing / LIMIT_FACTOR_ONE;
+    if (usableDa < setpointDa && derating.reason == LIMIT_NONE)
+        derating.reason = sharing < LIMIT_FACTOR_ONE ? LIMIT_SHARING : LIMIT_RATED;
+    return (uint16_t)(min(setpointDa, usableDa) * derating.factor / LIMIT_FACTOR_ONE);
+}
+
+static void computeTargets()
+{
+    Derating charge = {LIMIT_FACTOR_ONE, LIMIT_NONE};
+    Derating discharge = {LIMIT_FACTOR_ONE, LIMIT_NONE};
+    uint8_t chargeLimiter = 0, dischargeLimiter = 0;
+    uint8_t online = 0, chargeEnabled = 0, dischargeEnabled = 0, fromSettings = 0;
+    int32_t cellMaxMv = 0;
+    BankShare chargeBank, dischargeBank;
+    memset(&chargeBank, 0, sizeof(chargeBank));
+    memset(&dischargeBank, 0, sizeof(dischargeBank));
+
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        int32_t extremum[PACK_EXTREMA];
+        uint8_t mask;
+        if (!getPackBatteryExtrema(slot, extremum, mask))
+            continue;
+        online++;
+        if (mask & (1 << PACK_CELL_MAX))
+            cellMaxMv = max(cellMaxMv, extremum[PACK_CELL_MAX]);
+
+        // MOSFET ouvert : la batterie ne prend pas part à ce sens de courant
+        const BatteryData &battery = batteries[slot];
+        bool rated = false;
+        if (getBatteryFlag(battery, BATTERY_FLAG_CHARGE_MOSFET))
+        {
+            chargeEnabled++;
+            addToBank(chargeBank, slot,
+                      ratedCurrentDa(slot, LIMIT_RATED_CHARGE_REG, LIMIT_BATTERY_CHARGE_CURRENT_A,
+                                     MAX_CHARGE_CURRENT_A, rated),
+                      -battery.currentDa);
+            Derating d = chargeDerating(extremum, mask);
+            if (d.factor < charge.factor)
+            {
+                charge = d;
+                chargeLimiter = batterySlotIds[slot];
+            }
+        }
+        if (getBatteryFlag(battery, BATTERY_FLAG_DISCHARGE_MOSFET))
+        {
+            dischargeEnabled++;
+            addToBank(dischargeBank, slot,
+                      ratedCurrentDa(slot, LIMIT_RATED_DISCHARGE_REG, LIMIT_BATTERY_DISCHARGE_CURRENT_A,
+                                     MAX_DISCHARGE_CURRENT_A, rated),
+                      battery.currentDa);
+            Derating d = dischargeDerating(extremum, mask);
+            if (d.factor < discharge.factor)
+            {
+                discharge = d;
+                dischargeLimiter = batterySlotIds[slot];
+            }
+        }
+        if (rated)
+            fromSettings++;
+    }
+
+    if (!online)
+    {
+        charge.reason = discharge.reason = LIMIT_NO_DATA;
+    }
+    else
+    {
+        if (!chargeEnabled)
+            charge.reason = LIMIT_MOSFET;
+        if (!dischargeEnabled)
+            discharge.reason = LIMIT_MOSFET;
+    }
+
+    limits.chargeSharing = filterSharing(chargeSharingState, measureSharing(chargeBank));
+    limits.dischargeSharing = filterSharing(dischargeSharingState, measureSharing(dischargeBank));
+    limits.chargeRatedDa = (uint16_t)min(chargeBank.ratedDa, (uint32_t)UINT16_MAX);
+    limits.dischargeRatedDa = (uint16_t)min(dischargeBank.ratedDa, (uint32_t)UINT16_MAX);
+    limits.ratedFromSettings = fromSettings;
+    limits.chargeTargetDa = bankTarget(getChargeCurrentSetpoint(), chargeBank.ratedDa, limits.chargeSharing, charge);
+    limits.dischargeTargetDa =
+        bankTarget(getDischargeCurrentSetpoint(), dischargeBank.ratedDa, limits.dischargeSharing, discharge);
+    limits.chargeFactor = charge.factor;
+    limits.dischargeFactor = discharge.factor;
+    limits.chargeReason = charge.reason;
+    limits.dischargeReason = discharge.reason;
+    limits.chargeLimiterId = chargeLimiter;
+    limits.dischargeLimiterId = dischargeLimiter;
+
+    // Cellule pleine : CVL ramenée à la tension actuelle pour stopper la charge sans à-coup
+    uint16_t packVoltageDv = getPackSnapshot().voltageDv;
+    limits.chargeVoltageDv = cellMaxMv >= LIMIT_CELL_FULL_MV && packVoltageDv
+                                 ? min(packVoltageDv, (uint16_t)LIMIT_CHARGE_VOLTAGE_DV)
+                                 : LIMIT_CHARGE_VOLTAGE_DV;
+    limits.dischargeVoltageDv = LIMIT_DISCHARGE_VOLTAGE_DV;
+    limits.updates++;
+}
+
+// ——————— PENTE ———————
+
+static uint16_t slew(uint16_t output, uint16_t target, uint16_t step)
+{
+    // Baisse immédiate (protection), hausse d'au plus step
+    if (target <= output)
+        return target;
+    return target - output > step ? output + step : target;
+}
+
+// ——————— FONCTIONS PUBLIQUES ———————
+
+bool updateLimits()
+{
+    unsigned long now = millis();
+    const PackSnapshot &pack = getPackSnapshot();
+    float chargeSetpoint = getChargeCurrentSetpoint();
+    float dischargeSetpoint = getDischargeCurrentSetpoint();
+
+    if (pack.seq != lastPackSeq || chargeSetpoint != lastChargeSetpoint ||
+        dischargeSetpoint != lastDischargeSetpoint)
+    {
+        lastPackSeq = pack.seq;
+        lastChargeSetpoint = chargeSetpoint;
+        lastDischargeSetpoint = dischargeSetpoint;
+        computeTargets();
+    }
+
+    // Pas de pente accumulé depuis la dernière hausse (reste conservé)
+    uint32_t step = (uint32_t)(now - lastSlewMs) * LIMIT_SLEW_UP_DA_PER_S / 1000;
+    bool rising = limits.chargeTargetDa > limits.chargeCurrentDa ||
+                  limits.dischargeTargetDa > limits.dischargeCurrentDa;
+    if (!rising)
+        lastSlewMs = now;
+    else if (step)
+        lastSlewMs += step * 1000 / LIMIT_SLEW_UP_DA_PER_S;
+
+    uint16_t charge = slew(limits.chargeCurrentDa, limits.chargeTargetDa, min(step, (uint32_t)UINT16_MAX));
+    uint16_t discharge = slew(limits.dischargeCurrentDa, limits.dischargeTargetDa, min(step, (uint32_t)UINT16_MAX));
+    static uint16_t sentVoltageDv = 0;
+    bool changed = charge != limits.chargeCurrentDa || discharge != limits.dischargeCurrentDa ||
+                   limits.chargeVoltageDv != sentVoltageDv;
+    limits.chargeCurrentDa = charge;
+    limits.dischargeCurrentDa = discharge;
+    sentVoltageDv = limits.chargeVoltageDv;
+    return changed;
+}
+
+const PackLimits &getPackLimits()
+{
+    return limits;
+}
+
+float getChargeCurrentLimitA()
+{
+    return limits.chargeCurrentDa * 0.1f;
+}
+
+float getDischargeCurrentLimitA()
+{
+    return limits.dischargeCurrentDa * 0.1f;
+}
+
+void printPackLimits()
+{
+    static const char *reasonNames[] = {"aucun", "tension cellule", "température", "SOC",
+                                        "MOSFET", "pas de données", "nominal", "partage"};
+    Serial.println("\n=== LIMITES ===");
+    Serial.printf("CCL: %.1fA (cible %.1fA, consigne %.0fA), facteur %d%%, cause: %s (ID=%d)\n",
+                  getChargeCurrentLimitA(), limits.chargeTargetDa * 0.1f, getChargeCurrentSetpoint(),
+                  limits.chargeFactor * 100 / LIMIT_FACTOR_ONE, reasonNames[limits.chargeReason],
+                  limits.chargeLimiterId);
+    Serial.printf("DCL: %.1fA (cible %.1fA, consigne %.0fA), facteur %d%%, cause: %s (ID=%d)\n",
+                  getDischargeCurrentLimitA(), limits.dischargeTargetDa * 0.1f, getDischargeCurrentSetpoint(),
+                  limits.dischargeFactor * 100 / LIMIT_FACTOR_ONE, reasonNames[limits.dischargeReason],
+                  limits.dischargeLimiterId);
+    Serial.printf("Nominal du banc: charge %.1fA, décharge %.1fA (%d/%d batteries par réglages)\n",
+                  limits.chargeRatedDa * 0.1f, limits.dischargeRatedDa * 0.1f, limits.ratedFromSettings,
+                  getPackSnapshot().onlineCount);
+    Serial.printf("Partage utilisable: charge %d%%, décharge %d%%\n",
+                  limits.chargeSharing * 100 / LIMIT_FACTOR_ONE, limits.dischargeSharing * 100 / LIMIT_FACTOR_ONE);
+    Serial.printf("CVL: %.1fV, tension de décharge: %.1fV\n", limits.chargeVoltageDv * 0.1f,
+                  limits.dischargeVoltageDv * 0.1f);
+    Serial.printf("Recalculs: %lu, pente: %d.%dA/s\n", (unsigned long)limits.updates,
+                  LIMIT_SLEW_UP_DA_PER_S / 10, LIMIT_SLEW_UP_DA_PER_S % 10);
+    Serial.println("===============");
+}
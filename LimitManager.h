@@ -0,0 +1,112 @@
+#ifndef LIMIT_MANAGER_H
+#define LIMIT_MANAGER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// ——————— MOTEUR DE LIMITES ———————
+// CCL/DCL (courants max de charge/décharge) et CVL (tension de fin de charge)
+// envoyés à l'onduleur, recalculés à chaque publication du pack (donc aussi
+// quand une batterie passe hors ligne ou revient) : somme des courants
+// nominaux des batteries comptées au MOSFET fermé, réduite par le déséquilibre
+// de partage observé et plafonnée par la consigne opérateur, × facteur de
+// déclassement de la batterie la plus contrainte (tension cellule,
+// température, SOC). Les baisses s'appliquent aussitôt, les hausses sont
+// limitées en pente.
+
+#ifndef LIMIT_CHARGE_VOLTAGE_DV
+#define LIMIT_CHARGE_VOLTAGE_DV 516 // CVL nominale, 51.6 V
+#endif
+
+#ifndef LIMIT_DISCHARGE_VOLTAGE_DV
+#define LIMIT_DISCHARGE_VOLTAGE_DV 457 // 45.7 V
+#endif
+
+#ifndef LIMIT_CELL_FULL_MV
+#define LIMIT_CELL_FULL_MV 3550 // Cellule pleine : CVL ramenée à la tension du pack
+#endif
+
+#ifndef LIMIT_SLEW_UP_DA_PER_S
+#define LIMIT_SLEW_UP_DA_PER_S 50 // Hausse max des courants : 5 A/s
+#endif
+
+// Courant nominal d'une batterie. La carte des réglages BMS connue ne le
+// porte pas (LIMIT_RATED_*_REG = REG_NO_FIELD) : par défaut, seules ces
+// valeurs de config sont utilisées, pour toutes les batteries.
+#ifndef LIMIT_BATTERY_CHARGE_CURRENT_A
+#define LIMIT_BATTERY_CHARGE_CURRENT_A 150
+#endif
+
+#ifndef LIMIT_BATTERY_DISCHARGE_CURRENT_A
+#define LIMIT_BATTERY_DISCHARGE_CURRENT_A 150
+#endif
+
+// Registre de réglage portant le courant nominal (0.1 A), à définir pour un
+// firmware BMS qui l'expose ; valeur lue retenue si non nulle et sous
+// MAX_*_CURRENT_A, sinon valeur de config
+#ifndef LIMIT_RATED_CHARGE_REG
+#define LIMIT_RATED_CHARGE_REG REG_NO_FIELD
+#endif
+
+#ifndef LIMIT_RATED_DISCHARGE_REG
+#define LIMIT_RATED_DISCHARGE_REG REG_NO_FIELD
+#endif
+
+#ifndef LIMIT_SHARING_MIN_DA
+#define LIMIT_SHARING_MIN_DA 100 // Partage mesuré au-delà de 10 A de courant total
+#endif
+
+#define LIMIT_SHARING_FILTER_SHIFT 3 // Lissage 1/8 du facteur de partage
+
+#define LIMIT_FACTOR_ONE 256 // Facteurs de déclassement en Q8 (256 = 100 %)
+
+// Cause du déclassement le plus fort
+enum LimitReason
+{
+    LIMIT_NONE = 0,
+    LIMIT_CELL_VOLTAGE = 1,
+    LIMIT_TEMPERATURE = 2,
+    LIMIT_SOC = 3,
+    LIMIT_MOSFET = 4, // Aucune batterie au MOSFET fermé
+    LIMIT_NO_DATA = 5, // Aucune batterie comptée
+    LIMIT_RATED = 6,   // Somme des courants nominaux sous la consigne
+    LIMIT_SHARING = 7  // Partage de courant déséquilibré entre batteries
+};
+
+struct PackLimits
+{
+    uint16_t chargeCurrentDa; // CCL envoyée (après pente), 0.1 A
+    uint16_t dischargeCurrentDa;
+    uint16_t chargeVoltageDv; // CVL, 0.1 V
+    uint16_t dischargeVoltageDv;
+
+    // Cibles avant pente, et ce qui les fixe
+    uint16_t chargeTargetDa;
+    uint16_t dischargeTargetDa;
+    uint16_t chargeFactor; // Q8, batterie la plus contrainte
+    uint16_t dischargeFactor;
+    uint16_t chargeRatedDa; // Somme des nominaux des batteries au MOSFET fermé
+    uint16_t dischargeRatedDa;
+    uint16_t chargeSharing; // Q8, part du nominal utilisable vu le partage observé
+    uint16_t dischargeSharing;
+    uint8_t chargeReason; // LimitReason
+    uint8_t dischargeReason;
+    uint8_t chargeLimiterId; // ID de la batterie la plus contrainte (0 = aucune)
+    uint8_t dischargeLimiterId;
+    uint8_t ratedFromSettings; // Batteries dont le nominal vient des réglages
+
+    uint32_t updates; // Recalculs des cibles
+};
+
+// ——————— FONCTIONS PUBLIQUES ———————
+
+// Recalcul sur nouvelle publication du pack ou consigne, puis pente.
+// Renvoie true si les valeurs envoyées ont changé.
+bool updateLimits();
+
+const PackLimits &getPackLimits();
+float getChargeCurrentLimitA();
+float getDischargeCurrentLimitA();
+void printPackLimits();
+
+#endif
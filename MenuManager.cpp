@@ -14,6 +14,8 @@ unsigned long resultTimer = 0;
 bool codeSuccess = false;
 // Menu items
 MenuItem menuItems[MAX_MENU_ITEMS];
+// Diagnostic Modbus : page affichée (bus puis batteries)
+int modbusStatsPage = 0;
 
 // ——————— FONCTIONS D'INITIALISATION ———————
 void initMenu()
@@ -33,6 +35,8 @@ void buildMenu()
     menuItems[totalMenuItems++] = {"Affichage erreurs", ACTION_ERRORS, false};
     menuItems[totalMenuItems++] = {"Batteries individuelles", ACTION_INDIVIDUAL, false};
     menuItems[totalMenuItems++] = {"Afficher trames CAN", ACTION_CAN_FRAMES, false};
+    menuItems[totalMenuItems++] = {"Diagnostic Modbus", ACTION_MODBUS_STATS, false};
+    menuItems[totalMenuItems++] = {"Diagnostic CAN", ACTION_CAN_HEALTH, false};
     menuItems[totalMenuItems++] = {"Mode admin", ACTION_ADMIN_CODE, false};
 
     // Items admin uniquement
@@ -40,6 +44,7 @@ void buildMenu()
     {
         menuItems[totalMenuItems++] = {"Effectuer appairage", ACTION_PAIRING, true};
         menuItems[totalMenuItems++] = {"Parametres systeme", ACTION_SYSTEM_SETTINGS, true};
+        menuItems[totalMenuItems++] = {"Vitesse Modbus auto", ACTION_MODBUS_BAUD, true};
     }
 
     // Garde-fou
@@ -70,6 +75,10 @@ void navigateMenuUp()
     {
         codeDigits[currentDigit] = (codeDigits[currentDigit] + 1) % 10;
     }
+    else if (currentScreen == SCREEN_MODBUS_STATS)
+    {
+        modbusStatsPage = (modbusStatsPage - 1 + MODBUS_STATS_PAGES) % MODBUS_STATS_PAGES;
+    }
     // MAIN_DATA : pas de navigation up/down
 }
 
@@ -85,6 +94,10 @@ void navigateMenuDown()
     {
         codeDigits[currentDigit] = (codeDigits[currentDigit] + 9) % 10; // -1 mod 10
     }
+    else if (currentScreen == SCREEN_MODBUS_STATS)
+    {
+        modbusStatsPage = (modbusStatsPage + 1) % MODBUS_STATS_PAGES;
+    }
     // MAIN_DATA : pas de navigation up/down
 }
 
@@ -148,6 +161,10 @@ void goBackMenu()
         currentScreen = SCREEN_MENU;
         Serial.println("Retour du menu CAN vers menu principal");
         break;
+    case SCREEN_MODBUS_STATS:
+    case SCREEN_CAN_HEALTH:
+        currentScreen = SCREEN_MENU;
+        break;
     }
 }
 
@@ -171,6 +188,12 @@ void updateMenuDisplay()
     case SCREEN_CAN_FRAMES: // ⭐ MANQUE ICI !
         showCanFramesScreen();
         break;
+    case SCREEN_MODBUS_STATS:
+        showModbusStatsScreen();
+        break;
+    case SCREEN_CAN_HEALTH:
+        showCanHealthScreen();
+        break;
     }
 }
 
@@ -266,6 +289,53 @@ void showCanFramesScreen()
     extern void showCanFrames();
     showCanFrames();
 }
+
+void showModbusStatsScreen()
+{
+    // Pages : un bus par page, puis une batterie par page (UP/DOWN)
+    const ModbusStats *stats;
+    char title[24];
+    if (modbusStatsPage >= MODBUS_STATS_PAGES)
+        modbusStatsPage = 0; // Registre effacé depuis le dernier affichage
+    if (modbusStatsPage < MODBUS_BUS_COUNT)
+    {
+        stats = getBusStats(modbusStatsPage);
+        snprintf(title, sizeof(title), "DIAG BUS %d %lubd", modbusStatsPage, getModbusBaud(modbusStatsPage));
+    }
+    else
+    {
+        uint8_t batteryId = batterySlotIds[modbusStatsPage - MODBUS_BUS_COUNT];
+        stats = getBatteryStats(batteryId);
+        snprintf(title, sizeof(title), "DIAG BATTERIE %d", batteryId);
+    }
+
+    clearDisplay();
+    drawTitle(title);
+
+    // 21 colonnes en police 6x10 ; tampon au pire cas des compteurs, l'écran
+    // coupe ce qui dépasse
+    char line[64];
+    snprintf(line, sizeof(line), "Req %lu  OK %lu", (unsigned long)stats->requests,
+             (unsigned long)stats->responses);
+    drawText(2, 25, line);
+    snprintf(line, sizeof(line), "TO %lu CRC %lu Adr %lu", (unsigned long)stats->timeouts,
+             (unsigned long)stats->crcErrors, (unsigned long)stats->addressErrors);
+    drawText(2, 35, line);
+    snprintf(line, sizeof(line), "Fn %lu Exc %lu Tr %lu Lg %lu", (unsigned long)stats->functionErrors,
+             (unsigned long)stats->exceptions, (unsigned long)stats->truncated,
+             (unsigned long)stats->lengthErrors);
+    drawText(2, 45, line);
+    snprintf(line, sizeof(line), "p95<%ums max %lums", getLatencyPercentileMs(*stats, 95),
+             (unsigned long)(stats->latencyMaxUs / 1000));
+    drawText(2, 55, line);
+    if (stats->lastRefresh)
+    {
+        snprintf(line, sizeof(line), "Rafraich. %lums", stats->refreshIntervalMs);
+        drawText(2, 64, line);
+    }
+
+    showDisplay();
+}
 // ——————— FONCTIONS UTILITAIRES ———————
 
 void adjustMenuView()
@@ -317,6 +387,16 @@ void executeMenuAction(int idx)
     case ACTION_CAN_FRAMES:
         actionShowCanFrames();
         break;
+    case ACTION_MODBUS_BAUD:
+        actionNegotiateBaud();
+        break;
+    case ACTION_MODBUS_STATS:
+        modbusStatsPage = 0;
+        currentScreen = SCREEN_MODBUS_STATS;
+        break;
+    case ACTION_CAN_HEALTH:
+        currentScreen = SCREEN_CAN_HEALTH;
+        break;
     }
 }
 
@@ -412,6 +492,22 @@ void actionSystemSettings()
     Serial.println("Action: Parametres systeme (ADMIN)");
 }
 
+void actionNegotiateBaud()
+{
+    Serial.println("=== NÉGOCIATION VITESSE MODBUS ===");
+    showMessage("MODBUS", "Negociation vitesse...");
+
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        if (modbusBuses[i].serial)
+            negotiateModbusBaud(i);
+    }
+
+    char msg[32];
+    snprintf(msg, sizeof(msg), "Bus 0: %lu bauds", getModbusBaud(0));
+    showMessage("MODBUS", msg);
+}
+
 void actionShowCanFrames()
 {
     Serial.println("Action: Affichage trames CAN");
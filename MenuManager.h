@@ -11,6 +11,9 @@ extern int selectedMenuItem;
 extern int totalMenuItems;
 extern int menuViewTop;
 extern bool adminMode;
+extern int modbusStatsPage;
+
+#define MODBUS_STATS_PAGES (MODBUS_BUS_COUNT + batteryCount) // Batteries découvertes
 
 // Variables pour le code admin
 extern int codeDigits[3];
@@ -42,6 +45,7 @@ void showMenuScreen();
 void showCodeInputScreen();
 void showCodeResultScreen();
 void showCanFramesScreen();
+void showModbusStatsScreen();
 
 // Gestion du mode admin
 void activateAdminMode();
@@ -59,6 +63,7 @@ void actionIndividualBatteries();
 void actionPairing();
 void actionSystemSettings();
 void actionShowCanFrames();
+void actionNegotiateBaud();
 
 // Utilitaires internes
 void adjustMenuView();
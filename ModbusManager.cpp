@@ -1,60 +1,1883 @@
 #include "ModbusManager.h"
+#include "PackManager.h"
+#include <Preferences.h>
 
 // ——————— VARIABLES GLOBALES ———————
-HardwareSerial *modbusSerial = nullptr;
-uint8_t sendBuffer[256];
-uint8_t receiveBuffer[256];
+ModbusBus modbusBuses[MODBUS_BUS_COUNT];
+uint8_t batteryCount;
+uint8_t batterySlotIds[MAX_BATTERIES];
+uint8_t batteryBusMap[MAX_BATTERIES];
 BatteryData batteries[MAX_BATTERIES];
+#if BATTERY_CELLS_SOA
+uint16_t batteryCellVoltagesMv[MAX_BATTERIES][BATTERY_MAX_CELLS];
+#endif
+BatteryLink batteryLinks[MAX_BATTERIES];
+BatterySettings batterySettings[MAX_BATTERIES];
+ModbusStats batteryStats[MAX_BATTERIES];
+
+// ——————— TABLE DES REGISTRES TEMPS RÉEL ———————
+// Source unique des adresses, échelles et champs cibles : décodage,
+// lectures ciblées et planificateur de polling en dérivent. Triée par adresse.
+
+#define PARAM_BIT(p) (1u << (p))
+#define BATTERY_FIELD(f) ((uint16_t)offsetof(BatteryData, f))
+
+#if BATTERY_CELLS_SOA
+#define BATTERY_CELLS_FIELD REG_CELL_STORE
+#else
+#define BATTERY_CELLS_FIELD BATTERY_FIELD(cellVoltagesMv)
+#endif
+
+static constexpr RegisterDescriptor REALTIME_REGISTERS[] = {
+    // Tensions cellules (0x00~0x2F) en mV
+    {REG_CELL_VOLTAGES_START, BATTERY_MAX_CELLS, FIELD_U16, REG_FLAG_ZERO_INVALID, 1, 0,
+     BATTERY_CELLS_FIELD, BATTERY_FIELD(cellValidMask), BATTERY_FIELD(validCells),
+     PARAM_BIT(PARAM_CELL_VOLTAGES), 0},
+    // Températures capteurs (0x30~0x37), offset -40, rangées en 0.1 °C
+    {REG_TEMPERATURES_START, BATTERY_MAX_TEMPS, FIELD_I16, REG_FLAG_ZERO_INVALID, 10, -40,
+     BATTERY_FIELD(temperaturesDc), BATTERY_FIELD(tempValidMask), BATTERY_FIELD(validTemps),
+     PARAM_BIT(PARAM_TEMPERATURES), 0},
+    // Tension totale (0x38) : 0.1 V
+    {REG_TOTAL_VOLTAGE, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(voltageDv), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_VOLTAGE) | PARAM_BIT(PARAM_MAIN_VALUES), 0},
+    // Courant (0x39) : 0.1A, offset 30000, charge=négatif, décharge=positif
+    {REG_CURRENT, 1, FIELD_I16, 0, 1, -30000,
+     BATTERY_FIELD(currentDa), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_CURRENT) | PARAM_BIT(PARAM_MAIN_VALUES), 0},
+    // SOC (0x3A) : selon doc 0.001, 800/1000=80%
+    {REG_SOC, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(socRaw), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_SOC) | PARAM_BIT(PARAM_MAIN_VALUES), 0},
+    // Compteur de vie (0x3B) : relu aussi avec l'identité (niveau CELLULES),
+    // un recul signale un BMS redémarré (réglages à relire)
+    {REG_HEARTBEAT, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(heartbeat), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_HEARTBEAT) | PARAM_BIT(PARAM_CELL_COUNT), 0},
+    // Nombre de cellules (0x3C) et de capteurs (0x3D) : octet bas
+    {REG_CELL_COUNT, 1, FIELD_U8, 0, 1, 0,
+     BATTERY_FIELD(cellCount), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_CELL_COUNT), 0},
+    {REG_TEMP_SENSOR_COUNT, 1, FIELD_U8, 0, 1, 0,
+     BATTERY_FIELD(tempSensorCount), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_CELL_COUNT), 0},
+    // MOSFET charge (0x52) et décharge (0x53) : bit 0
+    {REG_CHARGE_MOSFET, 1, FIELD_FLAG, 0, 1, 0,
+     BATTERY_FIELD(flags), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_CHARGE_MOSFET) | PARAM_BIT(PARAM_MOSFET_STATES), BATTERY_FLAG_CHARGE_MOSFET},
+    {REG_DISCHARGE_MOSFET, 1, FIELD_FLAG, 0, 1, 0,
+     BATTERY_FIELD(flags), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_DISCHARGE_MOSFET) | PARAM_BIT(PARAM_MOSFET_STATES), BATTERY_FLAG_DISCHARGE_MOSFET},
+    // Température MOS (0x5A), offset -40, rangée en 0.1 °C
+    {REG_MOS_TEMP, 1, FIELD_I16, 0, 10, -40,
+     BATTERY_FIELD(mosTempDc), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_TEMP_MOS), 0},
+    // États de défaut (0x66, 0x67, 0x68)
+    {REG_FAULT_STATUS1, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(faultStatus1), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_FAULT_STATUS), 0},
+    {REG_FAULT_STATUS2, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(faultStatus2), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_FAULT_STATUS), 0},
+    {REG_FAULT_STATUS3, 1, FIELD_U16, 0, 1, 0,
+     BATTERY_FIELD(faultStatus3), REG_NO_FIELD, REG_NO_FIELD,
+     PARAM_BIT(PARAM_FAULT_STATUS), 0},
+};
+
+static constexpr size_t REGISTER_MAP_SIZE = sizeof(REALTIME_REGISTERS) / sizeof(REALTIME_REGISTERS[0]);
+
+// Table triée, sans chevauchement, contenue dans le bloc temps réel
+static constexpr bool registerMapValid(size_t i)
+{
+    return i >= REGISTER_MAP_SIZE ||
+           ((REALTIME_REGISTERS[i].address + REALTIME_REGISTERS[i].count <= ADDR_REALTIME_END + 1) &&
+            (i == 0 || REALTIME_REGISTERS[i - 1].address + REALTIME_REGISTERS[i - 1].count <=
+                           REALTIME_REGISTERS[i].address) &&
+            registerMapValid(i + 1));
+}
+static_assert(registerMapValid(0), "Table des registres temps réel incohérente");
+
+// ——————— REGISTRE DES BATTERIES ———————
+// Les tableaux par batterie sont indexés par emplacement, attribué quand une
+// batterie est découverte : seules les batteries présentes occupent un
+// emplacement et du temps de polling. Les ID sont uniques sur l'ensemble des
+// bus. Le registre est gardé en NVS pour reprendre le polling dès le démarrage.
+
+static const BmsAddressScheme BMS_ADDRESS_SCHEMES[BMS_FAMILY_COUNT] = {
+    // Requête 0x80 + ID, réponse 0x50 + ID
+    {"0x80+ID / 0x50+ID", 0x80, 0x50, 32},
+    // Modbus RTU standard : l'esclave répond avec sa propre adresse
+    {"Modbus RTU", 0x00, 0x00, BATTERY_ID_MAX},
+};
+
+static const char *REGISTRY_PREFS_NAMESPACE = "bmsreg";
+static uint8_t batterySlotById[BATTERY_ID_MAX + 1]; // Emplacement + 1 (0 = ID inconnu)
+
+static void restoreSlotSettings(uint8_t slot);
+static void cancelBankCommand();
+
+static const BmsAddressScheme &busScheme(const ModbusBus &bus)
+{
+    return BMS_ADDRESS_SCHEMES[bus.family]; // Validée par initModbusBus / setBusBmsFamily
+}
+
+static uint8_t requestAddress(const ModbusBus &bus, uint8_t batteryId)
+{
+    return busScheme(bus).requestBase + batteryId;
+}
+
+static uint8_t responseAddress(const ModbusBus &bus, uint8_t batteryId)
+{
+    return busScheme(bus).responseBase + batteryId;
+}
+
+int8_t getBatterySlot(uint8_t batteryId)
+{
+    if (batteryId > BATTERY_ID_MAX)
+        return -1;
+    return (int8_t)batterySlotById[batteryId] - 1;
+}
+
+static uint8_t allocateBatterySlot(uint8_t batteryId, uint8_t busIndex)
+{
+    uint8_t slot = batteryCount++;
+    batterySlotIds[slot] = batteryId;
+    batterySlotById[batteryId] = slot + 1;
+    batteryBusMap[slot] = busIndex;
+
+    memset(&batteries[slot], 0, sizeof(batteries[slot]));
+#if BATTERY_CELLS_SOA
+    memset(batteryCellVoltagesMv[slot], 0, sizeof(batteryCellVoltagesMv[slot]));
+#endif
+    batteries[slot].batteryId = batteryId;
+    memset(&batteryStats[slot], 0, sizeof(batteryStats[slot]));
+    memset(&batterySettings[slot], 0, sizeof(batterySettings[slot]));
+    batterySettings[slot].refreshNeeded = true;
+
+    // Hors ligne jusqu'à la première sonde (immédiate)
+    memset(&batteryLinks[slot], 0, sizeof(batteryLinks[slot]));
+    batteryLinks[slot].state = LINK_OFFLINE;
+    batteryLinks[slot].backoffMs = MODBUS_BACKOFF_MIN_MS;
+    return slot;
+}
+
+static void saveBatteryRegistry()
+{
+    Preferences prefs;
+    prefs.begin(REGISTRY_PREFS_NAMESPACE, false);
+    prefs.putBytes("ids", batterySlotIds, batteryCount);
+    prefs.putBytes("bus", batteryBusMap, batteryCount);
+    prefs.end();
+}
+
+static void loadBatteryRegistry()
+{
+    batteryCount = 0;
+    memset(batterySlotById, 0, sizeof(batterySlotById));
+    resetPack();
+
+    uint8_t ids[MAX_BATTERIES], buses[MAX_BATTERIES];
+    Preferences prefs;
+    prefs.begin(REGISTRY_PREFS_NAMESPACE, true);
+    size_t count = prefs.getBytesLength("ids");
+    if (count > MAX_BATTERIES || prefs.getBytesLength("bus") != count)
+        count = 0;
+    if (count)
+    {
+        prefs.getBytes("ids", ids, count);
+        prefs.getBytes("bus", buses, count);
+    }
+    prefs.end();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ids[i] >= 1 && ids[i] <= BATTERY_ID_MAX && buses[i] < MODBUS_BUS_COUNT &&
+            getBatterySlot(ids[i]) < 0)
+            allocateBatterySlot(ids[i], buses[i]);
+    }
+    Serial.printf("Registre: %d batteries connues (%d emplacements)\n", batteryCount, MAX_BATTERIES);
+
+    // Réglages connus avant la première lecture Modbus
+    restoreBatterySettings();
+}
+
+int8_t registerBattery(uint8_t batteryId, uint8_t busIndex)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot >= 0)
+        return slot;
+    if (batteryId == 0 || batteryId > BATTERY_ID_MAX || busIndex >= MODBUS_BUS_COUNT)
+        return -1;
+    if (batteryCount >= MAX_BATTERIES)
+    {
+        Serial.printf("Batterie ID=%d ignorée: %d emplacements occupés\n", batteryId, MAX_BATTERIES);
+        return -1;
+    }
+
+    slot = allocateBatterySlot(batteryId, busIndex);
+    restoreSlotSettings(slot);
+    saveBatteryRegistry();
+    Serial.printf("Batterie ID=%d découverte sur le bus %d (emplacement %d/%d)\n",
+                  batteryId, busIndex, slot + 1, MAX_BATTERIES);
+    return slot;
+}
+
+void resetBatteryRegistry()
+{
+    // Oublie toutes les batteries : la découverte repart de zéro sur chaque bus
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        ModbusBus &bus = modbusBuses[i];
+        if (bus.serial)
+            waitModbusIdle(bus);
+        bus.retryCount = 0;
+        bus.scanNextId = 1;
+        bus.nextScanPass = millis();
+        for (int t = 0; t < TIER_COUNT; t++)
+        {
+            bus.tiers[t].sweeping = false;
+        }
+    }
+    cancelBankCommand();
+
+    batteryCount = 0;
+    memset(batterySlotById, 0, sizeof(batterySlotById));
+    resetPack();
+
+    Preferences prefs;
+    prefs.begin(REGISTRY_PREFS_NAMESPACE, false);
+    prefs.remove("ids");
+    prefs.remove("bus");
+    prefs.end();
+    Serial.println("Registre des batteries effacé, découverte relancée");
+}
+
+void setBusBmsFamily(uint8_t busIndex, BmsFamily family)
+{
+    if (busIndex >= MODBUS_BUS_COUNT || family >= BMS_FAMILY_COUNT)
+        return;
+
+    ModbusBus &bus = modbusBuses[busIndex];
+    if (bus.serial)
+        waitModbusIdle(bus);
+    bus.family = family;
+    bus.scanNextId = 1; // Nouvelle plage d'ID à balayer
+    bus.nextScanPass = millis();
+}
+
+uint8_t getBatteryRequestAddress(uint8_t batteryId)
+{
+    return requestAddress(*getBatteryBus(batteryId), batteryId);
+}
+
+uint8_t getBatteryResponseAddress(uint8_t batteryId)
+{
+    return responseAddress(*getBatteryBus(batteryId), batteryId);
+}
 
 // ——————— FONCTIONS D'INITIALISATION ———————
 
+// Niveau au repos : balayage en cours et mesures à zéro
+#define POLL_TIER_IDLE false, 0, 0, 0, false, 0, 0, 0, 0
+
+static const PollTierState DEFAULT_POLL_TIERS[TIER_COUNT] = {
+    {"RAPIDE", {PARAM_MAIN_VALUES, PARAM_MOSFET_STATES}, 2, MODBUS_TIER_FAST_MS, POLL_TIER_IDLE},
+    {"CELLULES", {PARAM_CELL_VOLTAGES, PARAM_CELL_COUNT}, 2, MODBUS_TIER_CELLS_MS, POLL_TIER_IDLE},
+    {"TEMPERATURES", {PARAM_TEMPERATURES, PARAM_TEMP_MOS}, 2, MODBUS_TIER_TEMPS_MS, POLL_TIER_IDLE},
+    {"DEFAUTS", {PARAM_FAULT_STATUS}, 1, MODBUS_TIER_FAULTS_MS, POLL_TIER_IDLE},
+};
+
+static unsigned long loadBusBaud(uint8_t busIndex);
+
 void initModbus(HardwareSerial *serial)
 {
+    // Batteries connues (emplacements et réglages) avant la première lecture Modbus
+    loadBatteryRegistry();
+
+    initModbusBus(0, serial, MODBUS_RX_PIN, MODBUS_TX_PIN, MODBUS_DE_RE_PIN);
+}
+
+void initModbusBus(uint8_t busIndex, HardwareSerial *serial, int8_t rxPin, int8_t txPin, int8_t deRePin)
+{
+    if (busIndex >= MODBUS_BUS_COUNT)
+        return;
+
+    ModbusBus &bus = modbusBuses[busIndex];
+    memset(&bus, 0, sizeof(bus));
+    bus.index = busIndex;
+    bus.deRePin = deRePin;
+    bus.transaction.state = MODBUS_STATE_IDLE;
+    bus.receiveBuffer = bus.rxBuffers[0];
+    memcpy(bus.tiers, DEFAULT_POLL_TIERS, sizeof(bus.tiers));
+    bus.family = busIndex == 0 ? MODBUS_BMS_FAMILY : MODBUS2_BMS_FAMILY;
+    bus.scanNextId = 1;
+
     // Configuration du pin DE/RE pour RS485
-    pinMode(MODBUS_DE_RE_PIN, OUTPUT);
-    enableRS485Receive(); // Mode réception par défaut
+    pinMode(deRePin, OUTPUT);
+    enableRS485Receive(bus); // Mode réception par défaut
+
+    unsigned long storedBaud = loadBusBaud(busIndex);
+    bus.baud = storedBaud ? storedBaud : MODBUS_BAUD;
+    bus.baudStored = storedBaud != 0;
 
-    modbusSerial = serial;
+    bus.serial = serial;
     //  Attention : Utiliser SERIAL_8E1
-    modbusSerial->begin(BAUD_RATE, SERIAL_8E1, MODBUS_RX_PIN, MODBUS_TX_PIN);
+    bus.serial->begin(bus.baud, MODBUS_CONFIG, rxPin, txPin);
+
+    Serial.printf("Modbus bus %d initialisé - Baud: %lu 8E1\n", busIndex, bus.baud);
+    Serial.printf("Pins: RX=%d, TX=%d, DE/RE=%d\n", rxPin, txPin, deRePin);
+    Serial.printf("Adressage: %s (ID 1 à %d)\n", BMS_ADDRESS_SCHEMES[bus.family].name,
+                  BMS_ADDRESS_SCHEMES[bus.family].maxId);
+}
+
+void enableRS485Transmit(ModbusBus &bus)
+{
+    digitalWrite(bus.deRePin, HIGH); // Mode émission
+}
+
+void enableRS485Receive(ModbusBus &bus)
+{
+    digitalWrite(bus.deRePin, LOW); // Mode réception
+}
+
+ModbusBus *getBatteryBus(uint8_t batteryId)
+{
+    // Bus de la batterie (bus 0 si le bus configuré n'est pas initialisé)
+    uint8_t busIndex = 0;
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot >= 0)
+        busIndex = batteryBusMap[slot];
+    if (busIndex >= MODBUS_BUS_COUNT || !modbusBuses[busIndex].serial)
+        busIndex = 0;
+    return &modbusBuses[busIndex];
+}
+
+void setBatteryBus(uint8_t batteryId, uint8_t busIndex)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0 || busIndex >= MODBUS_BUS_COUNT)
+        return;
+
+    waitModbusIdle(*getBatteryBus(batteryId));
+    batteryBusMap[slot] = busIndex;
+    saveBatteryRegistry();
+}
+
+// ——————— MOTEUR DE TRANSACTIONS ———————
+// Une transaction avance par états (IDLE → TRANSMITTING → AWAITING_RESPONSE →
+// COMPLETE / TIMED_OUT) à chaque appel de pollModbus(), sans jamais attendre.
+// Chaque bus a sa propre transaction : les bus travaillent en parallèle.
+
+bool startModbusTransaction(ModbusBus &bus, uint8_t batteryId, int frameLength,
+                            uint16_t responseTimeoutMs, uint16_t interByteTimeoutMs,
+                            int maxResponseLength)
+{
+    ModbusTransaction &tx = bus.transaction;
+    if (!bus.serial || tx.state != MODBUS_STATE_IDLE || frameLength <= 0)
+        return false;
+
+    // Vider le buffer de réception (octets parasites d'une trame précédente)
+    while (bus.serial->available())
+        bus.serial->read();
+
+    tx.batteryId = batteryId;
+    tx.background = false;
+    tx.probe = false;
+    tx.command = false;
+    tx.requestLength = frameLength;
+    tx.responseLength = 0;
+    tx.maxResponseLength = min(maxResponseLength, MODBUS_RX_BUFFER_SIZE);
+    tx.responseTimeoutMs = responseTimeoutMs;
+    tx.interByteTimeoutMs = interByteTimeoutMs;
+    tx.startAddr = 0;
+    tx.regCount = 0;
+    tx.expectedLength = 0;
+    tx.rxCrc = 0xFFFF;
+    tx.t35Us = modbusT35Us(bus.baud);
+    tx.attempt = 0;
+    tx.blockRegs = 0;
+    tx.scan = false;
+    tx.responseAddr = batteryId ? responseAddress(bus, batteryId) : 0;
+
+    // La trame tient dans la FIFO TX de l'UART : write() rend la main immédiatement
+    enableRS485Transmit(bus);
+    bus.serial->write(bus.sendBuffer, frameLength);
+    tx.txStartUs = micros();
+    tx.txDurationUs = (unsigned long)frameLength * MODBUS_BITS_PER_CHAR * 1000000UL / bus.baud;
+    tx.state = MODBUS_STATE_TRANSMITTING;
+    traceRecord(TRACE_MODBUS_TX, bus.index, batteryId, 0, bus.sendBuffer, frameLength, TRACE_OK);
+    bus.stats.requests++;
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot >= 0)
+        batteryStats[slot].requests++;
+
+    return true;
+}
+
+static TraceResult classifyResponse(const ModbusTransaction &tx, const uint8_t *frame,
+                                    uint8_t requestFunction)
+{
+    if (tx.state == MODBUS_STATE_TIMED_OUT)
+        return TRACE_TIMEOUT;
+    if (tx.expectedLength == 0)
+    {
+        // Longueur inconnue (fin sur T3.5) : seule une trame trop courte ou à CRC
+        // faux est tronquée, une trame intègre est jugée sur sa fonction
+        if (tx.responseLength < 4 || tx.rxCrc != 0)
+            return TRACE_TRUNCATED;
+    }
+    else if (tx.responseLength < tx.expectedLength)
+    {
+        // Au-delà de 127 registres la longueur attendue vient de la requête :
+        // une réponse plus courte mais intègre n'est pas une troncature
+        bool shortFrame = tx.responseLength >= 5 && tx.rxCrc == 0 &&
+                          tx.responseLength == frame[2] + 5;
+        if (!shortFrame)
+            return TRACE_TRUNCATED;
+    }
+    if (tx.rxCrc != 0)
+        return TRACE_BAD_CRC;
+    if (tx.batteryId != 0 && frame[0] != tx.responseAddr)
+        return TRACE_BAD_ADDRESS;
+    if (frame[1] & 0x80)
+        return TRACE_EXCEPTION;
+    if (frame[1] != requestFunction)
+        return TRACE_BAD_FUNCTION;
+    // Champ nb octets sur 8 bits : 128 registres = 256 octets = 0x00
+    if (requestFunction == CMD_READ_HOLDING && frame[2] != ((tx.regCount * 2) & 0xFF))
+        return TRACE_BAD_LENGTH;
+    return TRACE_OK;
+}
+
+static bool writeEchoMatches(const uint8_t *request, const uint8_t *frame)
+{
+    // Écho 0x06/0x10 : adresse de registre, puis valeur (0x06) ou quantité (0x10)
+    if (request[1] != CMD_WRITE_SINGLE && request[1] != CMD_WRITE_MULTIPLE)
+        return true;
+    return memcmp(&request[2], &frame[2], 4) == 0;
+}
+
+static void recordResponseStats(ModbusStats &stats, TraceResult result, unsigned long latencyUs)
+{
+    switch (result)
+    {
+    case TRACE_OK:
+        stats.responses++;
+        break;
+    case TRACE_TIMEOUT:
+        stats.timeouts++;
+        return; // Pas de latence mesurable
+    case TRACE_TRUNCATED:
+        stats.truncated++;
+        break;
+    case TRACE_BAD_CRC:
+        stats.crcErrors++;
+        break;
+    case TRACE_BAD_ADDRESS:
+        stats.addressErrors++;
+        break;
+    case TRACE_BAD_FUNCTION:
+        stats.functionErrors++;
+        break;
+    case TRACE_BAD_LENGTH:
+        stats.lengthErrors++;
+        break;
+    default:
+        stats.exceptions++;
+        break;
+    }
+
+    uint8_t bucket = 0;
+    while (bucket < MODBUS_LATENCY_BUCKETS - 1 && latencyUs >= getLatencyBucketLimitMs(bucket) * 1000UL)
+        bucket++;
+    stats.latencyHist[bucket]++;
+    stats.latencyTotalMs += latencyUs / 1000;
+    if (latencyUs > stats.latencyMaxUs)
+        stats.latencyMaxUs = latencyUs;
+}
+
+void pollModbusBus(ModbusBus &bus)
+{
+    ModbusTransaction &tx = bus.transaction;
+
+    if (tx.state == MODBUS_STATE_TRANSMITTING)
+    {
+        // Attendre la fin théorique d'émission avant de relâcher DE/RE
+        if (micros() - tx.txStartUs < tx.txDurationUs)
+            return;
+
+        bus.serial->flush(); // Dernier caractère dans le registre à décalage
+        enableRS485Receive(bus);
+        tx.awaitStart = millis();
+        tx.state = MODBUS_STATE_AWAITING_RESPONSE;
+    }
+
+    if (tx.state != MODBUS_STATE_AWAITING_RESPONSE)
+        return;
+
+    while (bus.serial->available() && tx.responseLength < tx.maxResponseLength)
+    {
+        uint8_t b = bus.serial->read();
+        bus.receiveBuffer[tx.responseLength++] = b;
+        tx.rxCrc = crc16Update(tx.rxCrc, b); // CRC prêt dès le dernier octet
+        tx.lastByteUs = micros();
+    }
+
+    if (tx.responseLength > 0)
+    {
+        // Longueur attendue dès que l'en-tête (adresse, fonction, nb octets) est là
+        if (tx.expectedLength == 0)
+        {
+            tx.expectedLength = expectedFrameLength(bus.receiveBuffer, tx.responseLength, tx.regCount);
+            if (tx.expectedLength > tx.maxResponseLength)
+                tx.expectedLength = tx.maxResponseLength;
+        }
+
+        unsigned long silenceUs = micros() - tx.lastByteUs;
+        if (tx.expectedLength > 0)
+        {
+            // Trame complète dès le dernier octet de CRC, sinon abandon si elle s'interrompt
+            if (tx.responseLength >= tx.expectedLength ||
+                silenceUs >= tx.interByteTimeoutMs * 1000UL)
+                tx.state = MODBUS_STATE_COMPLETE;
+        }
+        else if (tx.responseLength >= tx.maxResponseLength || silenceUs >= tx.t35Us)
+        {
+            // Longueur inconnue : fin de trame sur silence T3.5
+            tx.state = MODBUS_STATE_COMPLETE;
+        }
+    }
+    else if (millis() - tx.awaitStart >= tx.responseTimeoutMs)
+    {
+        tx.state = MODBUS_STATE_TIMED_OUT;
+    }
+
+    // Fin de transaction (ce passage n'a lieu qu'une fois) : tracer et compter
+    if (tx.state == MODBUS_STATE_AWAITING_RESPONSE || tx.batteryId == 0)
+        return; // Broadcast : pas de réponse attendue
+
+    TraceResult result = classifyResponse(tx, bus.receiveBuffer, bus.sendBuffer[1]);
+    traceRecord(TRACE_MODBUS_RX, bus.index, tx.batteryId, tx.startAddr, bus.receiveBuffer,
+                tx.responseLength, result);
+
+    unsigned long latencyUs = tx.lastByteUs - tx.txStartUs;
+    recordResponseStats(bus.stats, result, latencyUs);
+    int8_t slot = getBatterySlot(tx.batteryId);
+    if (slot >= 0) // Pas une sonde de découverte
+        recordResponseStats(batteryStats[slot], result, latencyUs);
+}
+
+void pollModbus()
+{
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        if (modbusBuses[i].serial)
+            pollModbusBus(modbusBuses[i]);
+    }
+}
+
+int expectedFrameLength(const uint8_t *frame, int length, uint16_t requestedRegs)
+{
+    // Longueur totale (CRC compris) d'une réponse d'après son en-tête, 0 si inconnue
+    if (length < 2)
+        return 0;
+
+    uint8_t function = frame[1];
+    if (function & 0x80)
+        return 5; // Exception : adresse, fonction, code, CRC
+
+    switch (function)
+    {
+    case CMD_READ_HOLDING:
+        if (length < 3)
+            return 0;
+        // Le champ nb octets ne tient que sur 8 bits : au-delà de 127 registres
+        // (bloc temps réel complet = 256 octets) on se fie à la requête
+        if (requestedRegs * 2 > 0xFF)
+            return 3 + requestedRegs * 2 + 2;
+        return 3 + frame[2] + 2;
+    case CMD_WRITE_SINGLE:
+    case CMD_WRITE_MULTIPLE:
+        return 8; // Écho adresse registre + valeur/quantité
+    default:
+        return 0;
+    }
+}
+
+unsigned long modbusT35Us(unsigned long baud)
+{
+    // 3,5 temps caractère, plancher fixe au-delà de 19200 bauds
+    if (baud > 19200)
+        return MODBUS_T35_MIN_US;
+    return 35UL * MODBUS_BITS_PER_CHAR * 1000000UL / (10UL * baud);
+}
+
+static bool startBusReadTransaction(ModbusBus &bus, uint8_t batteryId, uint16_t startAddr,
+                                    uint16_t regCount, uint16_t responseTimeoutMs)
+{
+    // Le bus est explicite : une sonde de découverte vise un ID sans emplacement
+    if (!isModbusIdle(bus))
+        return false;
+
+    int frameLength = buildReadCommand(bus.sendBuffer, requestAddress(bus, batteryId), startAddr, regCount);
+    if (!startModbusTransaction(bus, batteryId, frameLength, responseTimeoutMs,
+                                MODBUS_INTERBYTE_TIMEOUT_MS, MODBUS_RX_BUFFER_SIZE))
+        return false;
+
+    bus.transaction.startAddr = startAddr;
+    bus.transaction.regCount = regCount;
+    return true;
+}
+
+bool startReadTransaction(uint8_t batteryId, uint16_t startAddr, uint16_t regCount,
+                          uint16_t responseTimeoutMs)
+{
+    return startBusReadTransaction(*getBatteryBus(batteryId), batteryId, startAddr, regCount,
+                                   responseTimeoutMs);
+}
+
+ModbusTransactionState runModbusTransaction(ModbusBus &bus)
+{
+    // Version bloquante pour les appels ponctuels (menu, appairage...).
+    // Les autres bus continuent de recevoir pendant l'attente.
+    while (bus.transaction.state == MODBUS_STATE_TRANSMITTING ||
+           bus.transaction.state == MODBUS_STATE_AWAITING_RESPONSE)
+    {
+        pollModbus();
+        yield();
+    }
+    return bus.transaction.state;
+}
+
+void releaseModbusTransaction(ModbusBus &bus)
+{
+    bus.transaction.state = MODBUS_STATE_IDLE;
+}
+
+ModbusTransactionState getModbusState(const ModbusBus &bus)
+{
+    return bus.transaction.state;
+}
+
+bool isModbusIdle(const ModbusBus &bus)
+{
+    return bus.transaction.state == MODBUS_STATE_IDLE;
+}
+
+// ——————— POLLING NON BLOQUANT ———————
+// Planificateur à niveaux : les valeurs utiles à l'onduleur (SOC/V/I, MOSFET)
+// sont relues à chaque cycle, les cellules, températures et défauts plus
+// rarement. Les niveaux sont servis par ordre de priorité, une transaction
+// à la fois par bus ; chaque bus balaie ses propres batteries.
+
+static bool pollingEnabled = true;
+
+static void recordBusResult(ModbusBus &bus, bool success);
+static void applyBaudFallback(ModbusBus &bus);
+static bool startSettingsRefresh(ModbusBus &bus);
+static bool startBankCommandTransaction(ModbusBus &bus);
+static void finishBankCommandTransaction(ModbusBus &bus);
+static void queueRegisterRetry(const ModbusTransaction &tx, uint16_t startAddr, uint16_t regCount, bool split);
+static bool startRegisterRetry(ModbusBus &bus, bool blocking);
+static bool startDiscoveryProbe(ModbusBus &bus, unsigned long now);
+static void finishDiscoveryProbe(ModbusBus &bus, const ModbusTransaction &tx, const uint8_t *frame);
+
+static ModbusDataType dataTypeForAddress(uint16_t startAddr)
+{
+    if (startAddr >= ADDR_SETTING3_START)
+        return DATA_SETTING3;
+    if (startAddr >= ADDR_SETTING2_START)
+        return DATA_SETTING2;
+    if (startAddr >= ADDR_SETTING1_START)
+        return DATA_SETTING1;
+    return DATA_REALTIME;
+}
+
+static void decodeCompletedFrame(ModbusBus &bus)
+{
+    // Décode la trame mise de côté par finishBackgroundTransaction()
+    if (!bus.completedBuffer)
+        return;
+
+    const ModbusTransaction &tx = bus.completed;
+    const uint8_t *frame = bus.completedBuffer;
+    bus.completedBuffer = nullptr;
+
+    if (tx.scan)
+    {
+        finishDiscoveryProbe(bus, tx, frame);
+        return;
+    }
+
+    bool success = false;
+    if (tx.state == MODBUS_STATE_COMPLETE)
+    {
+        success = parseFrame(tx.batteryId, dataTypeForAddress(tx.startAddr), tx.startAddr, frame, tx);
+    }
+    else
+    {
+        if (MODBUS_VERBOSE && !tx.probe)
+            Serial.printf("TIMEOUT: Pas de réponse de la batterie ID=%d\n", tx.batteryId);
+        if (tx.attempt)
+            queueRegisterRetry(tx, tx.startAddr, tx.regCount, false); // Toujours manquante
+    }
+
+    recordBatteryResult(tx.batteryId, success);
+    if (!tx.probe) // Une sonde vers une batterie absente ne dit rien de la vitesse
+        recordBusResult(bus, success);
+}
+
+static bool finishBackgroundTransaction(ModbusBus &bus)
+{
+    // Traite la fin d'une transaction lancée par le polling
+    ModbusTransaction &tx = bus.transaction;
+    if (!tx.background ||
+        (tx.state != MODBUS_STATE_COMPLETE && tx.state != MODBUS_STATE_TIMED_OUT))
+        return false;
+
+    if (tx.command)
+    {
+        finishBankCommandTransaction(bus);
+        releaseModbusTransaction(bus);
+        bus.lastTransactionEnd = millis();
+        return true;
+    }
+
+    // La trame passe en attente de décodage et la transaction suivante
+    // reçoit dans le buffer suivant : le bus n'attend pas le décodage
+    decodeCompletedFrame(bus);
+    bus.completed = tx;
+    bus.completedBuffer = bus.receiveBuffer;
+    bus.rxIndex = (bus.rxIndex + 1) % MODBUS_RX_BUFFERS;
+    bus.receiveBuffer = bus.rxBuffers[bus.rxIndex];
+
+    releaseModbusTransaction(bus);
+    bus.lastTransactionEnd = millis();
+
+    // Un bloc de réglages décide du bloc suivant : décodé tout de suite
+    if (dataTypeForAddress(bus.completed.startAddr) != DATA_REALTIME)
+        decodeCompletedFrame(bus);
+    return true;
+}
+
+void waitModbusIdle(ModbusBus &bus)
+{
+    // Laisse se terminer une transaction de fond avant un accès bloquant
+    while (!isModbusIdle(bus))
+    {
+        pollModbus();
+        if (!finishBackgroundTransaction(bus) &&
+            (bus.transaction.state == MODBUS_STATE_COMPLETE ||
+             bus.transaction.state == MODBUS_STATE_TIMED_OUT))
+        {
+            releaseModbusTransaction(bus); // Résultat non réclamé
+        }
+        yield();
+    }
+    decodeCompletedFrame(bus);
+}
+
+void setModbusPollingEnabled(bool enabled)
+{
+    pollingEnabled = enabled;
+}
+
+void setPollTierPeriod(PollTier tier, unsigned long periodMs)
+{
+    if (tier >= TIER_COUNT)
+        return;
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        modbusBuses[i].tiers[tier].periodMs = periodMs;
+    }
+}
+
+const PollTierState *getPollTierState(uint8_t busIndex, PollTier tier)
+{
+    if (busIndex >= MODBUS_BUS_COUNT || tier >= TIER_COUNT)
+        return nullptr;
+    return &modbusBuses[busIndex].tiers[tier];
+}
+
+static uint8_t nextPolledBattery(ModbusBus &bus, PollTierState &tier, uint8_t fromSlot)
+{
+    // ID de la prochaine batterie du bus joignable à partir de fromSlot (0 = fin
+    // du balayage). Seules les batteries découvertes sont parcourues et les hors
+    // ligne sont sautées : le cycle suit l'ensemble en ligne.
+    for (uint8_t slot = fromSlot; slot < batteryCount; slot++)
+    {
+        if (batteryBusMap[slot] != bus.index)
+            continue;
+        if (batteryLinks[slot].state != LINK_OFFLINE)
+            return batterySlotIds[slot];
+        batteryLinks[slot].skippedTransactions += tier.paramCount;
+    }
+    return 0;
+}
 
-    // Initialiser les buffers
-    memset(sendBuffer, 0, sizeof(sendBuffer));
-    memset(receiveBuffer, 0, sizeof(receiveBuffer));
+static void endTierSweep(PollTierState &tier, unsigned long now)
+{
+    tier.sweeping = false;
+    tier.yieldTurn = true;
+    tier.sweepCount++;
+    tier.lastSweepDurationMs = now - tier.sweepStart;
+}
+
+static PollTierState *beginTierSweep(ModbusBus &bus, PollTierState &tier, unsigned long now)
+{
+    tier.achievedIntervalMs = tier.sweepCount ? now - tier.lastSweepStart : 0;
+    tier.lastSweepStart = now;
+    tier.sweepStart = now;
+    tier.sweeping = true;
+    tier.nextBattery = nextPolledBattery(bus, tier, 0);
+    tier.nextParam = 0;
+    return &tier;
+}
+
+static PollTierState *selectPollTier(ModbusBus &bus, unsigned long now)
+{
+    // Le premier niveau (par priorité) en cours de balayage ou arrivé à échéance.
+    // Un niveau qui vient de finir cède une transaction aux niveaux inférieurs,
+    // sinon un niveau rapide en dépassement les affamerait.
+    PollTierState *deferred = nullptr;
+    for (int i = 0; i < TIER_COUNT; i++)
+    {
+        PollTierState &tier = bus.tiers[i];
+        if (tier.sweeping)
+            return &tier;
 
-    // Initialiser les données des batteries
-    for (int i = 0; i < MAX_BATTERIES; i++)
+        if (tier.sweepCount == 0 || now - tier.lastSweepStart >= tier.periodMs)
+        {
+            if (tier.yieldTurn)
+            {
+                tier.yieldTurn = false;
+                if (!deferred)
+                    deferred = &tier;
+                continue;
+            }
+            return beginTierSweep(bus, tier, now);
+        }
+    }
+    return deferred ? beginTierSweep(bus, *deferred, now) : nullptr;
+}
+
+static bool startDueProbe(ModbusBus &bus, unsigned long now)
+{
+    // Re-sonde d'une batterie hors ligne : lecture courte de REG_HEARTBEAT
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        BatteryLink &link = batteryLinks[slot];
+        if (batteryBusMap[slot] != bus.index || link.state != LINK_OFFLINE ||
+            (long)(now - link.nextProbe) < 0)
+            continue;
+
+        uint16_t startAddr, regCount;
+        getBatteryParamRange(PARAM_HEARTBEAT, &startAddr, &regCount);
+        if (!startReadTransaction(batterySlotIds[slot], startAddr, regCount, MODBUS_PROBE_TIMEOUT_MS))
+            return false;
+
+        bus.transaction.background = true;
+        bus.transaction.probe = true;
+        link.probesSent++;
+        link.nextProbe = now + link.backoffMs; // Résultat décodé plus tard
+        return true;
+    }
+    return false;
+}
+
+static void updateBusPolling(ModbusBus &bus, unsigned long now)
+{
+    if (!isModbusIdle(bus) || now - bus.lastTransactionEnd < MODBUS_INTER_REQUEST_GAP_MS)
+        return;
+
+    if (bus.baudFallbackPending)
+        applyBaudFallback(bus);
+
+    // La commande MOSFET groupée passe avant tout le reste
+    if (startBankCommandTransaction(bus))
+        return;
+
+    // Puis les registres manquants d'une lecture précédente
+    if (startRegisterRetry(bus, false))
+    {
+        bus.transaction.background = true;
+        return;
+    }
+
+    // Les sondes passent entre deux balayages rapides
+    if (!bus.tiers[TIER_FAST].sweeping && startDueProbe(bus, now))
+        return;
+
+    // Relecture des réglages, puis découverte, quand aucun niveau n'a besoin du bus
+    PollTierState *tier = selectPollTier(bus, now);
+    if (!tier)
+    {
+        if (!startSettingsRefresh(bus))
+            startDiscoveryProbe(bus, now);
+        return;
+    }
+
+    if (tier->nextBattery != 0 && getBatteryLinkState(tier->nextBattery) == LINK_OFFLINE)
+    {
+        // Passée hors ligne en cours de balayage : sautée, sinon la lecture
+        // perdue compterait comme une sonde et doublerait déjà le backoff
+        tier->nextParam = 0;
+        tier->nextBattery = nextPolledBattery(bus, *tier, getBatterySlot(tier->nextBattery));
+    }
+
+    if (tier->nextBattery == 0)
+    {
+        endTierSweep(*tier, now); // Aucune batterie en ligne sur ce bus
+        return;
+    }
+
+    uint16_t startAddr, regCount;
+    if (getBatteryParamRange(tier->params[tier->nextParam], &startAddr, &regCount) &&
+        startReadTransaction(tier->nextBattery, startAddr, regCount, MODBUS_PARAM_TIMEOUT_MS))
+    {
+        bus.transaction.background = true;
+    }
+
+    // Avancer : paramètre suivant, puis batterie suivante
+    if (++tier->nextParam >= tier->paramCount)
+    {
+        tier->nextParam = 0;
+        tier->nextBattery = nextPolledBattery(bus, *tier, getBatterySlot(tier->nextBattery) + 1);
+        if (tier->nextBattery == 0)
+            endTierSweep(*tier, now);
+    }
+}
+
+void updateModbusPolling()
+{
+    pollModbus();
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        if (modbusBuses[i].serial)
+            finishBackgroundTransaction(modbusBuses[i]);
+    }
+    expireStaleBatteryData();
+
+    if (!pollingEnabled)
+    {
+        for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+        {
+            decodeCompletedFrame(modbusBuses[i]);
+        }
+        return;
+    }
+
+    unsigned long now = millis();
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        if (modbusBuses[i].serial)
+            updateBusPolling(modbusBuses[i], now);
+    }
+
+    // Requêtes suivantes parties : décoder pendant leur réception
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        decodeCompletedFrame(modbusBuses[i]);
+    }
+}
+
+unsigned long getPollTierWireTimeUs(uint8_t busIndex, PollTier tier)
+{
+    // Temps de ligne d'un balayage complet du niveau sur un bus (requêtes + réponses)
+    if (busIndex >= MODBUS_BUS_COUNT || tier >= TIER_COUNT)
+        return 0;
+
+    const ModbusBus &bus = modbusBuses[busIndex];
+    unsigned long bytes = 0;
+    for (int p = 0; p < bus.tiers[tier].paramCount; p++)
+    {
+        uint16_t startAddr, regCount;
+        if (getBatteryParamRange(bus.tiers[tier].params[p], &startAddr, &regCount))
+            bytes += 8 + 5 + regCount * 2; // Requête + (en-tête, données, CRC)
+    }
+
+    unsigned long busBatteries = 0;
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (batteryBusMap[slot] == busIndex)
+            busBatteries++;
+    }
+
+    return bytes * busBatteries * MODBUS_BITS_PER_CHAR * 1000000UL / bus.baud;
+}
+
+void printPollingStats()
+{
+    Serial.println("\n=== POLLING MODBUS ===");
+    for (int b = 0; b < MODBUS_BUS_COUNT; b++)
+    {
+        const ModbusBus &bus = modbusBuses[b];
+        if (!bus.serial)
+            continue;
+
+        Serial.printf("--- Bus %d (%lu bauds) ---\n", b, bus.baud);
+        float busLoad = 0;
+        for (int i = 0; i < TIER_COUNT; i++)
+        {
+            const PollTierState &tier = bus.tiers[i];
+            unsigned long wireUs = getPollTierWireTimeUs(b, (PollTier)i);
+            float refreshHz = tier.achievedIntervalMs ? 1000.0f / tier.achievedIntervalMs : 0.0f;
+            busLoad += (float)wireUs / (tier.periodMs * 1000.0f);
+
+            Serial.printf("%-12s période=%lums réel=%lums (%.2f Hz) balayage=%lums ligne=%lums\n",
+                          tier.name, tier.periodMs, tier.achievedIntervalMs, refreshHz,
+                          tier.lastSweepDurationMs, wireUs / 1000);
+        }
+        Serial.printf("Charge bus estimée: %.0f%%\n", busLoad * 100);
+    }
+
+    static const char *linkNames[] = {"EN LIGNE", "SUSPECTE", "HORS LIGNE"};
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        const BatteryLink &link = batteryLinks[slot];
+        Serial.printf("Batterie %d (bus %d): %-10s échecs=%d backoff=%lums sondes=%lu évitées=%lu\n",
+                      batterySlotIds[slot], batteryBusMap[slot], linkNames[link.state],
+                      link.consecutiveFailures, link.backoffMs,
+                      (unsigned long)link.probesSent, (unsigned long)link.skippedTransactions);
+    }
+    Serial.printf("En ligne: %d/%d (emplacements: %d), temps de bus rendu: %lums\n",
+                  getOnlineBatteryCount(), batteryCount, MAX_BATTERIES, getLinkTimeSavedMs());
+    for (int b = 0; b < MODBUS_BUS_COUNT; b++)
+    {
+        if (modbusBuses[b].serial)
+            Serial.printf("Découverte bus %d: ID suivant %d, %lu sondes, %lu passes\n", b,
+                          modbusBuses[b].scanNextId, (unsigned long)modbusBuses[b].scanProbes,
+                          (unsigned long)modbusBuses[b].scanPasses);
+    }
+    const BankMosfetCommand *cmd = getBankMosfetCommand();
+    Serial.printf("Commandes MOSFET: %lu, dernière=%luus, pire cas=%luus\n",
+                  (unsigned long)cmd->commandCount, cmd->lastDurationUs, cmd->worstDurationUs);
+    Serial.println("======================\n");
+}
+
+// ——————— RELECTURE PARTIELLE ———————
+// Après une réponse temps réel tronquée, corrompue ou incomplète, seuls les
+// registres manquants sont redemandés. Une trame corrompue ne dit pas où
+// est l'erreur : sa plage est relue par morceaux de MODBUS_RETRY_CHUNK_REGS,
+// et un morceau qui passe n'est plus relu.
+
+static uint32_t readTransactionBytes(uint16_t regCount)
+{
+    // Requête (8) + réponse (adresse, fonction, nb octets, données, CRC)
+    return 8 + 5 + regCount * 2UL;
+}
+
+static bool pushRegisterRetry(ModbusBus &bus, const ModbusRetry &retry)
+{
+    if (bus.retryCount >= MODBUS_RETRY_SLOTS)
+        return false;
+    bus.retries[bus.retryCount++] = retry;
+    return true;
+}
+
+static void queueRegisterRetry(const ModbusTransaction &tx, uint16_t startAddr, uint16_t regCount, bool split)
+{
+    if (tx.probe || tx.command || regCount == 0 || dataTypeForAddress(startAddr) != DATA_REALTIME)
+        return;
+
+    ModbusBus &bus = *getBatteryBus(tx.batteryId);
+    uint16_t chunk = split ? MODBUS_RETRY_CHUNK_REGS : regCount;
+    uint8_t parts = (regCount + chunk - 1) / chunk;
+    if (tx.attempt >= MODBUS_RETRY_MAX_ATTEMPTS || bus.retryCount + parts > MODBUS_RETRY_SLOTS)
+    {
+        bus.stats.retryAbandoned++; // Le prochain balayage du niveau relira la plage
+        return;
+    }
+
+    ModbusRetry retry;
+    retry.batteryId = tx.batteryId;
+    retry.attempt = tx.attempt + 1;
+    retry.blockRegs = tx.attempt ? tx.blockRegs : tx.regCount;
+    for (uint16_t offset = 0; offset < regCount; offset += chunk)
+    {
+        retry.startAddr = startAddr + offset;
+        retry.regCount = min((uint16_t)(regCount - offset), chunk);
+        pushRegisterRetry(bus, retry);
+    }
+
+    // Sans relecture partielle, tout le bloc d'origine serait relu
+    bus.stats.wholeBlockBytes += readTransactionBytes(retry.blockRegs);
+}
+
+static bool startRegisterRetry(ModbusBus &bus, bool blocking)
+{
+    // Plus ancienne plage en attente ; abandonnée si la batterie a quitté le bus,
+    // ou la ligne pour le polling (un appel bloquant insiste)
+    while (bus.retryCount > 0)
+    {
+        const ModbusRetry &retry = bus.retries[0];
+        int8_t slot = getBatterySlot(retry.batteryId);
+        bool stale = slot < 0 || batteryBusMap[slot] != bus.index ||
+                     (!blocking && batteryLinks[slot].state == LINK_OFFLINE);
+        if (!stale)
+        {
+            if (!startReadTransaction(retry.batteryId, retry.startAddr, retry.regCount,
+                                      MODBUS_PARAM_TIMEOUT_MS))
+                return false;
+            bus.transaction.attempt = retry.attempt;
+            bus.transaction.blockRegs = retry.blockRegs;
+            bus.stats.retries++;
+            bus.stats.retryBytes += readTransactionBytes(retry.regCount);
+        }
+
+        bus.retryCount--;
+        memmove(&bus.retries[0], &bus.retries[1], bus.retryCount * sizeof(ModbusRetry));
+        if (!stale)
+            return true;
+        bus.stats.retryAbandoned++;
+    }
+    return false;
+}
+
+static bool runRegisterRetries(ModbusBus &bus)
+{
+    // Accès bloquant : relit tout de suite les plages en attente du bus.
+    // Faux si une plage a dû être abandonnée.
+    uint32_t abandoned = bus.stats.retryAbandoned;
+    while (startRegisterRetry(bus, true))
+    {
+        const ModbusTransaction &tx = bus.transaction;
+        bool result = false;
+        if (runModbusTransaction(bus) == MODBUS_STATE_COMPLETE)
+            result = parseResponse(tx.batteryId, DATA_REALTIME, tx.startAddr);
+        else
+            queueRegisterRetry(tx, tx.startAddr, tx.regCount, false);
+        recordBatteryResult(tx.batteryId, result);
+        releaseModbusTransaction(bus);
+    }
+    return bus.stats.retryAbandoned == abandoned;
+}
+
+// ——————— DÉCOUVERTE ———————
+// Quand ni les niveaux de polling ni les réglages n'ont besoin du bus, un ID
+// sans emplacement de la plage de la famille BMS est sondé (REG_HEARTBEAT).
+// Une passe complète au plus toutes les MODBUS_SCAN_PERIOD_MS : une batterie
+// ajoutée à chaud est trouvée sans coûter de temps de bus en régime établi.
+
+static bool busHasBatteries(uint8_t busIndex)
+{
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (batteryBusMap[slot] == busIndex)
+            return true;
+    }
+    return false;
+}
+
+static bool startDiscoveryProbe(ModbusBus &bus, unsigned long now)
+{
+    if (batteryCount >= MAX_BATTERIES || (long)(now - bus.nextScanPass) < 0)
+        return false;
+
+    uint8_t maxId = busScheme(bus).maxId;
+    while (bus.scanNextId <= maxId && getBatterySlot(bus.scanNextId) >= 0)
+        bus.scanNextId++;
+    if (bus.scanNextId > maxId)
+    {
+        bus.scanNextId = 1;
+        bus.scanPasses++;
+        bus.nextScanPass = now + MODBUS_SCAN_PERIOD_MS;
+#if MODBUS_AUTO_BAUD
+        // Première installation : au démarrage aucune batterie n'était connue,
+        // la vitesse est négociée à la fin de la première passe qui en trouve
+        if (!bus.baudStored && busHasBatteries(bus.index))
+            negotiateModbusBaud(bus.index);
+#endif
+        return false;
+    }
+
+    uint16_t startAddr, regCount;
+    getBatteryParamRange(PARAM_HEARTBEAT, &startAddr, &regCount);
+    if (!startBusReadTransaction(bus, bus.scanNextId, startAddr, regCount, MODBUS_PROBE_TIMEOUT_MS))
+        return false;
+
+    bus.transaction.background = true;
+    bus.transaction.scan = true;
+    bus.scanNextId++;
+    bus.scanProbes++;
+    return true;
+}
+
+static void finishDiscoveryProbe(ModbusBus &bus, const ModbusTransaction &tx, const uint8_t *frame)
+{
+    // Réponse intègre : la batterie reçoit un emplacement et entre dans le polling
+    if (tx.state != MODBUS_STATE_COMPLETE || classifyResponse(tx, frame, CMD_READ_HOLDING) != TRACE_OK)
+        return;
+
+    int8_t slot = getBatterySlot(tx.batteryId);
+    if (slot >= 0 && batteryBusMap[slot] != bus.index)
+    {
+        Serial.printf("ID=%d déjà présent sur le bus %d : doublon du bus %d ignoré\n",
+                      tx.batteryId, batteryBusMap[slot], bus.index);
+        return;
+    }
+    if (registerBattery(tx.batteryId, bus.index) < 0)
+        return;
+
+    recordBatteryResult(tx.batteryId, parseFrame(tx.batteryId, DATA_REALTIME, tx.startAddr, frame, tx));
+}
+
+// ——————— VITESSE DE LIAISON ———————
+// Vitesse par bus : négociée par sondes REG_HEARTBEAT (la plus rapide à
+// laquelle toutes les batteries présentes répondent), enregistrée en NVS,
+// repli sur MODBUS_BAUD après MODBUS_BAUD_FALLBACK_ERRORS erreurs d'affilée.
+
+static const unsigned long BAUD_CANDIDATES[] = {115200, 38400, 19200, MODBUS_BAUD};
+static const char *BAUD_PREFS_NAMESPACE = "modbus";
+
+static bool isBaudCandidate(unsigned long baud)
+{
+    for (unsigned long candidate : BAUD_CANDIDATES)
+    {
+        if (candidate == baud)
+            return true;
+    }
+    return false;
+}
+
+static unsigned long loadBusBaud(uint8_t busIndex)
+{
+    // Vitesse enregistrée, 0 si aucune (ou invalide)
+    char key[8];
+    snprintf(key, sizeof(key), "baud%d", busIndex);
+
+    Preferences prefs;
+    prefs.begin(BAUD_PREFS_NAMESPACE, true);
+    unsigned long baud = prefs.getUInt(key, 0);
+    prefs.end();
+
+    return isBaudCandidate(baud) ? baud : 0;
+}
+
+static void saveBusBaud(uint8_t busIndex, unsigned long baud)
+{
+    char key[8];
+    snprintf(key, sizeof(key), "baud%d", busIndex);
+
+    Preferences prefs;
+    prefs.begin(BAUD_PREFS_NAMESPACE, false);
+    prefs.putUInt(key, baud);
+    prefs.end();
+
+    modbusBuses[busIndex].baudStored = true;
+}
+
+static void applyBusBaud(ModbusBus &bus, unsigned long baud)
+{
+    bus.serial->updateBaudRate(baud);
+    bus.baud = baud;
+    bus.consecutiveErrors = 0;
+
+    // Octets reçus à l'ancienne vitesse
+    while (bus.serial->available())
+        bus.serial->read();
+}
+
+static void recordBusResult(ModbusBus &bus, bool success)
+{
+    if (success)
+    {
+        bus.consecutiveErrors = 0;
+        return;
+    }
+
+    if (bus.baud == MODBUS_BAUD || bus.baudFallbackPending ||
+        ++bus.consecutiveErrors < MODBUS_BAUD_FALLBACK_ERRORS)
+        return;
+
+    Serial.printf("Bus %d: %d erreurs consécutives à %lu bauds, repli à %d bauds\n",
+                  bus.index, bus.consecutiveErrors, bus.baud, MODBUS_BAUD);
+    bus.baudFallbackPending = true; // Une transaction peut être en cours
+}
+
+static void applyBaudFallback(ModbusBus &bus)
+{
+    bus.baudFallbackPending = false;
+    applyBusBaud(bus, MODBUS_BAUD);
+    saveBusBaud(bus.index, MODBUS_BAUD);
+}
+
+static bool probeHeartbeat(ModbusBus &bus, uint8_t batteryId)
+{
+    // Lecture bloquante de REG_HEARTBEAT (négociation uniquement)
+    uint16_t startAddr, regCount;
+    getBatteryParamRange(PARAM_HEARTBEAT, &startAddr, &regCount);
+    if (!startReadTransaction(batteryId, startAddr, regCount, MODBUS_PROBE_TIMEOUT_MS))
+        return false;
+
+    bool success = runModbusTransaction(bus) == MODBUS_STATE_COMPLETE &&
+                   parseResponse(batteryId, DATA_REALTIME, startAddr);
+    releaseModbusTransaction(bus);
+    delay(MODBUS_INTER_REQUEST_GAP_MS);
+    return success;
+}
+
+unsigned long getModbusBaud(uint8_t busIndex)
+{
+    if (busIndex >= MODBUS_BUS_COUNT)
+        return 0;
+    return modbusBuses[busIndex].baud;
+}
+
+bool setModbusBaud(uint8_t busIndex, unsigned long baud, bool persist)
+{
+    if (busIndex >= MODBUS_BUS_COUNT || !modbusBuses[busIndex].serial || !isBaudCandidate(baud))
+        return false;
+
+    ModbusBus &bus = modbusBuses[busIndex];
+    waitModbusIdle(bus);
+    applyBusBaud(bus, baud);
+    if (persist)
+        saveBusBaud(busIndex, baud);
+    return true;
+}
+
+void negotiateUnsetModbusBauds()
+{
+    // Au démarrage, une fois tous les bus initialisés (affectation définitive)
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        if (modbusBuses[i].serial && !modbusBuses[i].baudStored)
+            negotiateModbusBaud(i);
+    }
+}
+
+unsigned long negotiateModbusBaud(uint8_t busIndex)
+{
+    if (busIndex >= MODBUS_BUS_COUNT || !modbusBuses[busIndex].serial)
+        return 0;
+
+    ModbusBus &bus = modbusBuses[busIndex];
+    waitModbusIdle(bus);
+    Serial.printf("Négociation vitesse bus %d...\n", busIndex);
+
+    // Référence : batteries qui répondent à la vitesse de repli
+    applyBusBaud(bus, MODBUS_BAUD);
+    bool present[MAX_BATTERIES] = {false};
+    uint8_t presentCount = 0;
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (batteryBusMap[slot] == busIndex && probeHeartbeat(bus, batterySlotIds[slot]))
+        {
+            present[slot] = true;
+            presentCount++;
+        }
+    }
+
+    if (presentCount == 0)
+    {
+        // Rien à négocier (aucune batterie découverte) : nouvel essai à la fin
+        // de la première passe de découverte qui en trouve
+        Serial.printf("Bus %d: aucune batterie, %d bauds\n", busIndex, MODBUS_BAUD);
+        return MODBUS_BAUD;
+    }
+
+    // Du plus rapide au plus lent : retenir le premier accepté par toutes
+    unsigned long chosen = MODBUS_BAUD;
+    for (unsigned long candidate : BAUD_CANDIDATES)
+    {
+        if (candidate == MODBUS_BAUD)
+            break;
+
+        applyBusBaud(bus, candidate);
+        bool reliable = true;
+        for (uint8_t slot = 0; slot < batteryCount && reliable; slot++)
+        {
+            if (!present[slot])
+                continue;
+            for (int r = 0; r < MODBUS_BAUD_PROBE_READS && reliable; r++)
+            {
+                reliable = probeHeartbeat(bus, batterySlotIds[slot]);
+            }
+        }
+
+        Serial.printf("Bus %d: %lu bauds %s\n", busIndex, candidate, reliable ? "OK" : "refusé");
+        if (reliable)
+        {
+            chosen = candidate;
+            break;
+        }
+    }
+
+    setModbusBaud(busIndex, chosen, true);
+    Serial.printf("Bus %d: vitesse retenue %lu bauds (%d batteries)\n", busIndex, chosen, presentCount);
+    return chosen;
+}
+
+// ——————— STATISTIQUES D'ÉCHANGES ———————
+// Comptées à la fin de chaque transaction (quelques incréments) : laissées
+// actives en production. Latence = requête émise → dernier octet reçu.
+
+static const uint16_t LATENCY_BUCKET_LIMITS_MS[MODBUS_LATENCY_BUCKETS] = {5, 10, 20, 50, 100, 200, 500, 0xFFFF};
+
+uint16_t getLatencyBucketLimitMs(uint8_t bucket)
+{
+    return bucket < MODBUS_LATENCY_BUCKETS ? LATENCY_BUCKET_LIMITS_MS[bucket] : 0xFFFF;
+}
+
+uint16_t getLatencyPercentileMs(const ModbusStats &stats, uint8_t percent)
+{
+    // Borne haute du seuil contenant le percentile (0 si aucune mesure)
+    uint32_t total = 0;
+    for (int i = 0; i < MODBUS_LATENCY_BUCKETS; i++)
+        total += stats.latencyHist[i];
+    if (total == 0)
+        return 0;
+
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t cumulated = 0;
+    for (int i = 0; i < MODBUS_LATENCY_BUCKETS; i++)
+    {
+        cumulated += stats.latencyHist[i];
+        if (cumulated >= target)
+            return LATENCY_BUCKET_LIMITS_MS[i];
+    }
+    return 0xFFFF;
+}
+
+uint32_t getStatsErrorCount(const ModbusStats &stats)
+{
+    return stats.timeouts + stats.truncated + stats.crcErrors + stats.addressErrors +
+           stats.functionErrors + stats.exceptions + stats.lengthErrors;
+}
+
+const ModbusStats *getBatteryStats(uint8_t batteryId)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return nullptr;
+    return &batteryStats[slot];
+}
+
+const ModbusStats *getBusStats(uint8_t busIndex)
+{
+    if (busIndex >= MODBUS_BUS_COUNT)
+        return nullptr;
+    return &modbusBuses[busIndex].stats;
+}
+
+void resetModbusStats()
+{
+    memset(batteryStats, 0, sizeof(batteryStats));
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        memset(&modbusBuses[i].stats, 0, sizeof(modbusBuses[i].stats));
+    }
+}
+
+static void printStatsLine(const char *label, const ModbusStats &stats)
+{
+    uint32_t measured = 0;
+    for (int i = 0; i < MODBUS_LATENCY_BUCKETS; i++)
+        measured += stats.latencyHist[i];
+    Serial.printf("%-8s req=%lu ok=%lu TO=%lu tronq=%lu CRC=%lu adr=%lu fn=%lu exc=%lu lg=%lu",
+                  label, (unsigned long)stats.requests, (unsigned long)stats.responses,
+                  (unsigned long)stats.timeouts, (unsigned long)stats.truncated,
+                  (unsigned long)stats.crcErrors, (unsigned long)stats.addressErrors,
+                  (unsigned long)stats.functionErrors, (unsigned long)stats.exceptions,
+                  (unsigned long)stats.lengthErrors);
+    Serial.printf(" lat moy=%lums p95<%ums max=%lums",
+                  measured ? (unsigned long)(stats.latencyTotalMs / measured) : 0UL,
+                  getLatencyPercentileMs(stats, 95), (unsigned long)(stats.latencyMaxUs / 1000));
+    if (stats.lastRefresh)
+        Serial.printf(" rafr=%lums (max %lums)", stats.refreshIntervalMs, stats.refreshIntervalMaxMs);
+    Serial.println();
+}
+
+void printModbusStats()
+{
+    Serial.println("\n=== STATISTIQUES MODBUS ===");
+    char label[12];
+    for (int b = 0; b < MODBUS_BUS_COUNT; b++)
+    {
+        if (!modbusBuses[b].serial)
+            continue;
+        snprintf(label, sizeof(label), "Bus %d", b);
+        const ModbusStats &stats = modbusBuses[b].stats;
+        printStatsLine(label, stats);
+        if (stats.retries || stats.retryAbandoned)
+            Serial.printf("         relectures=%lu (%lu octets, %lu en blocs complets, économie %ld) abandons=%lu\n",
+                          (unsigned long)stats.retries, (unsigned long)stats.retryBytes,
+                          (unsigned long)stats.wholeBlockBytes,
+                          (long)stats.wholeBlockBytes - (long)stats.retryBytes,
+                          (unsigned long)stats.retryAbandoned);
+    }
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        snprintf(label, sizeof(label), "Bat %d", batterySlotIds[slot]);
+        printStatsLine(label, batteryStats[slot]);
+    }
+
+    // Histogramme global (tous bus)
+    Serial.print("Latence (ms):");
+    for (int i = 0; i < MODBUS_LATENCY_BUCKETS; i++)
+    {
+        uint32_t count = 0;
+        for (int b = 0; b < MODBUS_BUS_COUNT; b++)
+            count += modbusBuses[b].stats.latencyHist[i];
+        if (i < MODBUS_LATENCY_BUCKETS - 1)
+            Serial.printf(" <%u:%lu", LATENCY_BUCKET_LIMITS_MS[i], (unsigned long)count);
+        else
+            Serial.printf(" >=%u:%lu", LATENCY_BUCKET_LIMITS_MS[i - 1], (unsigned long)count);
+    }
+    Serial.println();
+    Serial.println("===========================\n");
+}
+
+// ——————— CACHE DES RÉGLAGES ———————
+// Les blocs SETTING1/2/3 (~500 octets par batterie) ne changent presque
+// jamais : ils sont gardés en RAM et en NVS, restaurés au démarrage et relus
+// en tâche de fond seulement si l'identité de la batterie change (nombre de
+// cellules/sondes, retour après une absence) ou si son heartbeat recule
+// (redémarrage du BMS).
+
+static const char *SETTINGS_PREFS_NAMESPACE = "bmsset";
+
+// Enregistrement NVS d'une batterie
+struct SettingsRecord
+{
+    uint16_t regs[SETTINGS_REG_COUNT];
+    uint8_t cellCount;
+    uint8_t tempSensorCount;
+    uint32_t hash;
+};
+
+uint32_t hashBatterySettings(const uint16_t *regs, uint16_t count)
+{
+    // FNV-1a 32 bits
+    uint32_t hash = 2166136261UL;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        hash = (hash ^ (regs[i] & 0xFF)) * 16777619UL;
+        hash = (hash ^ (regs[i] >> 8)) * 16777619UL;
+    }
+    return hash;
+}
+
+static void settingsKey(char *key, size_t size, uint8_t batteryId)
+{
+    snprintf(key, size, "set%d", batteryId);
+}
+
+static bool loadBatterySettings(Preferences &prefs, uint8_t slot)
+{
+    uint8_t id = batterySlotIds[slot];
+    BatterySettings &settings = batterySettings[slot];
+    memset(&settings, 0, sizeof(settings));
+    settings.refreshNeeded = true;
+
+    char key[8];
+    settingsKey(key, sizeof(key), id);
+    if (prefs.getBytesLength(key) != sizeof(SettingsRecord))
+        return false;
+
+    static SettingsRecord record;
+    prefs.getBytes(key, &record, sizeof(record));
+    if (hashBatterySettings(record.regs, SETTINGS_REG_COUNT) != record.hash)
+    {
+        Serial.printf("Réglages batterie ID=%d corrompus en flash\n", id);
+        return false;
+    }
+
+    memcpy(settings.regs, record.regs, sizeof(settings.regs));
+    settings.cellCount = record.cellCount;
+    settings.tempSensorCount = record.tempSensorCount;
+    settings.hash = record.hash;
+    settings.valid = true;
+    settings.restored = true;
+    settings.refreshNeeded = false;
+    return true;
+}
+
+void restoreBatterySettings()
+{
+    Preferences prefs;
+    prefs.begin(SETTINGS_PREFS_NAMESPACE, true);
+
+    uint8_t restoredCount = 0;
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (loadBatterySettings(prefs, slot))
+            restoredCount++;
+    }
+
+    prefs.end();
+    Serial.printf("Réglages restaurés depuis la flash: %d/%d batteries\n", restoredCount, batteryCount);
+}
+
+static void restoreSlotSettings(uint8_t slot)
+{
+    // Batterie découverte en cours de fonctionnement : réglages connus d'un passage précédent
+    Preferences prefs;
+    prefs.begin(SETTINGS_PREFS_NAMESPACE, true);
+    loadBatterySettings(prefs, slot);
+    prefs.end();
+}
+
+static void saveBatterySettings(uint8_t batteryId)
+{
+    const BatterySettings &settings = batterySettings[getBatterySlot(batteryId)];
+
+    static SettingsRecord record;
+    memcpy(record.regs, settings.regs, sizeof(record.regs));
+    record.cellCount = settings.cellCount;
+    record.tempSensorCount = settings.tempSensorCount;
+    record.hash = settings.hash;
+
+    char key[8];
+    settingsKey(key, sizeof(key), batteryId);
+
+    Preferences prefs;
+    prefs.begin(SETTINGS_PREFS_NAMESPACE, false);
+    prefs.putBytes(key, &record, sizeof(record));
+    prefs.end();
+}
+
+void requestSettingsRefresh(uint8_t batteryId)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return;
+
+    BatterySettings &settings = batterySettings[slot];
+    if (!settings.refreshNeeded)
+        Serial.printf("Réglages batterie ID=%d à relire\n", batteryId);
+    settings.refreshNeeded = true;
+    settings.blockMask = 0;
+}
+
+const BatterySettings *getBatterySettings(uint8_t batteryId)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0 || !batterySettings[slot].valid)
+        return nullptr;
+    return &batterySettings[slot];
+}
+
+bool getBatterySettingRegister(uint8_t batteryId, uint16_t regAddr, uint16_t *value)
+{
+    const BatterySettings *settings = getBatterySettings(batteryId);
+    if (!settings || regAddr < ADDR_SETTING1_START || regAddr > ADDR_SETTING3_END)
+        return false;
+
+    *value = settings->regs[regAddr - ADDR_SETTING1_START];
+    return true;
+}
+
+void parseSettingsData(uint8_t batteryId, ModbusDataType dataType, const uint8_t *data, uint16_t length)
+{
+    static const uint16_t blockStart[] = {0, ADDR_SETTING1_START, ADDR_SETTING2_START, ADDR_SETTING3_START};
+    static const uint16_t blockEnd[] = {0, ADDR_SETTING1_END, ADDR_SETTING2_END, ADDR_SETTING3_END};
+
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return;
+
+    BatterySettings &settings = batterySettings[slot];
+    uint16_t regCount = blockEnd[dataType] - blockStart[dataType] + 1;
+    if (length < regCount * 2)
+        return; // Bloc incomplet : on garde l'ancien
+
+    uint16_t *regs = &settings.regs[blockStart[dataType] - ADDR_SETTING1_START];
+    for (uint16_t i = 0; i < regCount; i++)
+    {
+        regs[i] = (data[i * 2] << 8) | data[i * 2 + 1];
+    }
+    settings.blockMask |= 1 << (dataType - 1);
+
+    if (settings.blockMask != SETTINGS_BLOCKS_ALL)
+        return;
+
+    // Jeu complet : identité de référence, écriture flash seulement si le contenu a changé
+    const BatteryData &battery = batteries[slot];
+    uint32_t hash = hashBatterySettings(settings.regs, SETTINGS_REG_COUNT);
+    bool changed = !settings.valid || hash != settings.hash ||
+                   settings.cellCount != battery.cellCount ||
+                   settings.tempSensorCount != battery.tempSensorCount;
+
+    settings.hash = hash;
+    settings.cellCount = battery.cellCount;
+    settings.tempSensorCount = battery.tempSensorCount;
+    settings.valid = true;
+    settings.restored = false;
+    settings.refreshNeeded = false;
+
+    if (changed)
+        saveBatterySettings(batteryId);
+    Serial.printf("Réglages batterie ID=%d lus (hash %08lX%s)\n", batteryId,
+                  (unsigned long)hash, changed ? ", enregistrés" : ", inchangés");
+}
+
+static void checkSettingsIdentity(uint8_t batteryId, uint16_t previousHeartbeat,
+                                  uint16_t startAddr, uint16_t regCount)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    BatterySettings &settings = batterySettings[slot];
+    const BatteryData &battery = batteries[slot];
+    if (!settings.valid || settings.refreshNeeded)
+        return;
+
+    // Identité : configuration cellules/sondes différente de celle des réglages
+    if ((battery.cellCount && battery.cellCount != settings.cellCount) ||
+        (battery.tempSensorCount && battery.tempSensorCount != settings.tempSensorCount))
+    {
+        requestSettingsRefresh(batteryId);
+        return;
+    }
+
+    // Heartbeat qui recule (hors rebouclage 16 bits) : le BMS a redémarré
+    bool heartbeatRead = startAddr <= REG_HEARTBEAT && startAddr + regCount > REG_HEARTBEAT;
+    if (heartbeatRead && battery.heartbeat < previousHeartbeat &&
+        previousHeartbeat - battery.heartbeat < 0x8000)
+    {
+        requestSettingsRefresh(batteryId);
+    }
+}
+
+static bool startSettingsRefresh(ModbusBus &bus)
+{
+    // Un bloc manquant d'une batterie en ligne de ce bus
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        BatterySettings &settings = batterySettings[slot];
+        // Identité lue d'abord (niveau CELLULES) : enregistrés sans elle, les
+        // réglages seraient relus dès la lecture suivante du nombre de cellules
+        if (!settings.refreshNeeded || batteryBusMap[slot] != bus.index ||
+            batteryLinks[slot].state != LINK_ONLINE || batteries[slot].cellCount == 0)
+            continue;
+
+        uint16_t startAddr, regCount;
+        if (!(settings.blockMask & 0x01))
+        {
+            startAddr = ADDR_SETTING1_START;
+            regCount = ADDR_SETTING1_END - ADDR_SETTING1_START + 1;
+        }
+        else if (!(settings.blockMask & 0x02))
+        {
+            startAddr = ADDR_SETTING2_START;
+            regCount = ADDR_SETTING2_END - ADDR_SETTING2_START + 1;
+        }
+        else
+        {
+            startAddr = ADDR_SETTING3_START;
+            regCount = ADDR_SETTING3_END - ADDR_SETTING3_START + 1;
+        }
+
+        if (!startReadTransaction(batterySlotIds[slot], startAddr, regCount, MODBUS_RESPONSE_TIMEOUT_MS))
+            return false;
+        bus.transaction.background = true;
+        return true;
+    }
+    return false;
+}
+
+// ——————— SUIVI DE LIAISON ———————
+
+void recordBatteryResult(uint8_t batteryId, bool success)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return;
+
+    BatteryLink &link = batteryLinks[slot];
+    unsigned long now = millis();
+
+    if (success)
+    {
+        if (link.state != LINK_ONLINE)
+            Serial.printf("Batterie ID=%d en ligne\n", batteryId);
+        if (link.state == LINK_OFFLINE && link.lastSeen != 0)
+            requestSettingsRefresh(batteryId); // De retour : peut-être remplacée
+        link.state = LINK_ONLINE;
+        link.consecutiveFailures = 0;
+        link.backoffMs = MODBUS_BACKOFF_MIN_MS;
+        link.lastSeen = now;
+        return;
+    }
+
+    if (link.consecutiveFailures < 0xFF)
+        link.consecutiveFailures++;
+
+    if (link.state == LINK_OFFLINE)
+    {
+        // Sonde sans réponse : doubler l'intervalle
+        link.backoffMs = min(link.backoffMs * 2, (unsigned long)MODBUS_BACKOFF_MAX_MS);
+    }
+    else if (link.consecutiveFailures >= MODBUS_OFFLINE_AFTER_FAILURES)
+    {
+        Serial.printf("Batterie ID=%d hors ligne\n", batteryId);
+        link.state = LINK_OFFLINE;
+        link.backoffMs = MODBUS_BACKOFF_MIN_MS;
+        setBatteryFlag(batteries[slot], BATTERY_FLAG_DATA_VALID, false);
+        updatePackBattery(slot, false, false);
+    }
+    else
+    {
+        link.state = LINK_SUSPECT;
+    }
+
+    link.nextProbe = now + link.backoffMs;
+}
+
+void expireStaleBatteryData()
+{
+    // Une donnée qui n'a pas été rafraîchie depuis longtemps n'est plus fiable
+    unsigned long now = millis();
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
     {
-        batteries[i].batteryId = i + 1;
-        batteries[i].dataValid = false;
-        batteries[i].lastUpdate = 0;
-        batteries[i].validCells = 0;
-        batteries[i].validTemps = 0;
+        if (isBatteryDataValid(batteries[slot]) && now - batteries[slot].lastUpdate > MODBUS_DATA_STALE_MS)
+        {
+            setBatteryFlag(batteries[slot], BATTERY_FLAG_DATA_VALID, false);
+            updatePackBattery(slot, false, false);
+            Serial.printf("Batterie ID=%d: données périmées\n", batterySlotIds[slot]);
+        }
     }
+}
 
-    Serial.println("Modbus initialisé - Baud: 9600 8E1");
-    Serial.printf("Pins: RX=%d, TX=%d, DE/RE=%d\n", MODBUS_RX_PIN, MODBUS_TX_PIN, MODBUS_DE_RE_PIN);
-    Serial.printf("Adresse maître: 0x%02X\n", MASTER_ADDR);
-    Serial.printf("Adresse réponse base: 0x%02X\n", RESPONSE_ADDR_BASE);
+BatteryLinkState getBatteryLinkState(uint8_t batteryId)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return LINK_OFFLINE;
+    return batteryLinks[slot].state;
 }
 
-void enableRS485Transmit()
+uint8_t getOnlineBatteryCount()
 {
-    digitalWrite(MODBUS_DE_RE_PIN, HIGH); // Mode émission
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < batteryCount; i++)
+    {
+        if (batteryLinks[i].state != LINK_OFFLINE)
+            count++;
+    }
+    return count;
 }
 
-void enableRS485Receive()
+unsigned long getLinkTimeSavedMs()
 {
-    digitalWrite(MODBUS_DE_RE_PIN, LOW); // Mode réception
+    // Temps de bus rendu : timeouts évités moins le coût des sondes courtes
+    unsigned long saved = 0, spent = 0;
+    for (uint8_t i = 0; i < batteryCount; i++)
+    {
+        saved += batteryLinks[i].skippedTransactions * (unsigned long)MODBUS_PARAM_TIMEOUT_MS;
+        spent += batteryLinks[i].probesSent * (unsigned long)MODBUS_PROBE_TIMEOUT_MS;
+    }
+    return saved > spent ? saved - spent : 0;
 }
 
 // ——————— FONCTIONS DE LECTURE MODULAIRES ———————
 
 bool readBatteryData(uint8_t batteryId, ModbusDataType dataType)
 {
-    if (batteryId < 1 || batteryId > MAX_BATTERIES)
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    if (getBatterySlot(batteryId) < 0)
     {
-        Serial.printf("ERREUR: ID batterie invalide: %d\n", batteryId);
+        Serial.printf("ERREUR: Batterie ID=%d inconnue (non découverte)\n", batteryId);
         return false;
     }
 
@@ -92,135 +1915,89 @@ bool readBatteryData(uint8_t batteryId, ModbusDataType dataType)
     Serial.printf("Lecture %s batterie ID=%d (0x%04X à 0x%04X)\n",
                   typeName, batteryId, startAddr, startAddr + regCount - 1);
 
+    waitModbusIdle(bus);
+
     // Construire et envoyer la commande
-    int frameLength = buildReadCommand(batteryId, startAddr, regCount);
-    if (frameLength <= 0)
+    if (!startReadTransaction(batteryId, startAddr, regCount, MODBUS_RESPONSE_TIMEOUT_MS))
     {
-        Serial.println("ERREUR: Construction commande échouée");
+        Serial.println("ERREUR: Envoi commande échoué");
         return false;
     }
 
-    // Debug
-    printModbusBuffer("ENVOI", sendBuffer, frameLength);
-
-    // Vider le buffer de réception
-    while (modbusSerial->available())
+    bool result = false;
+    uint8_t queuedRetries = bus.retryCount;
+    if (runModbusTransaction(bus) == MODBUS_STATE_COMPLETE)
+    {
+        result = parseResponse(batteryId, dataType, startAddr);
+    }
+    else
     {
-        modbusSerial->read();
+        Serial.printf("TIMEOUT: Pas de réponse de la batterie ID=%d\n", batteryId);
     }
+    recordBatteryResult(batteryId, result);
 
-    // Passer en mode émission et envoyer
-    enableRS485Transmit();
-    modbusSerial->write(sendBuffer, frameLength);
-    modbusSerial->flush();
-    enableRS485Receive(); // Repasser en mode réception
+    releaseModbusTransaction(bus);
 
-    // Attendre la réponse (timeout 500ms)
-    unsigned long timeout = millis() + 500;
-    int responseLength = 0;
+    // Registres manquants : relus tout de suite, par sous-plages
+    if (bus.retryCount > queuedRetries)
+        result = runRegisterRetries(bus);
+    return result;
+}
 
-    while (millis() < timeout && responseLength < sizeof(receiveBuffer))
+bool getBatteryParamRange(BatteryParam param, uint16_t *startAddr, uint16_t *regCount)
+{
+    // Plage de registres temps réel couverte par un paramètre (d'après la table)
+    uint16_t first = 0xFFFF, end = 0;
+    for (size_t i = 0; i < REGISTER_MAP_SIZE; i++)
     {
-        if (modbusSerial->available())
-        {
-            receiveBuffer[responseLength++] = modbusSerial->read();
-            timeout = millis() + 50; // Prolonger si on reçoit des données
-        }
+        const RegisterDescriptor &desc = REALTIME_REGISTERS[i];
+        if (!(desc.params & PARAM_BIT(param)))
+            continue;
+        if (desc.address < first)
+            first = desc.address;
+        if (desc.address + desc.count > end)
+            end = desc.address + desc.count;
     }
 
-    if (responseLength > 0)
-    {
-        printModbusBuffer("RECU", receiveBuffer, responseLength);
-        return parseResponse(batteryId, dataType);
-    }
-    else
-    {
-        Serial.printf("TIMEOUT: Pas de réponse de la batterie ID=%d\n", batteryId);
+    if (end == 0)
         return false;
-    }
+
+    *startAddr = first;
+    *regCount = end - first;
+    return true;
 }
 
 bool readBatteryParam(uint8_t batteryId, BatteryParam param)
 {
+    ModbusBus &bus = *getBatteryBus(batteryId);
     // Lecture ciblée d'un paramètre spécifique
     uint16_t startAddr, regCount;
-
-    switch (param)
+    if (!getBatteryParamRange(param, &startAddr, &regCount))
     {
-    case PARAM_SOC:
-        startAddr = REG_SOC;
-        regCount = 1;
-        break;
-    case PARAM_VOLTAGE:
-        startAddr = REG_TOTAL_VOLTAGE;
-        regCount = 1;
-        break;
-    case PARAM_CURRENT:
-        startAddr = REG_CURRENT;
-        regCount = 1;
-        break;
-    case PARAM_TEMP_MOS:
-        startAddr = REG_MOS_TEMP;
-        regCount = 1;
-        break;
-    case PARAM_CHARGE_MOSFET:
-        startAddr = REG_CHARGE_MOSFET;
-        regCount = 1;
-        break;
-    case PARAM_DISCHARGE_MOSFET:
-        startAddr = REG_DISCHARGE_MOSFET;
-        regCount = 1;
-        break;
-    case PARAM_CELL_VOLTAGES:
-        startAddr = REG_CELL_VOLTAGES_START;
-        regCount = 48; // 0x00 à 0x2F
-        break;
-    case PARAM_TEMPERATURES:
-        startAddr = REG_TEMPERATURES_START;
-        regCount = 8; // 0x30 à 0x37
-        break;
-    case PARAM_FAULT_STATUS:
-        startAddr = REG_FAULT_STATUS1;
-        regCount = 3; // Status 1, 2 et 3
-        break;
-    default:
         Serial.println("ERREUR: Paramètre invalide");
         return false;
     }
 
     Serial.printf("Lecture paramètre %d batterie ID=%d\n", param, batteryId);
 
-    int frameLength = buildReadCommand(batteryId, startAddr, regCount);
-    if (frameLength <= 0)
-        return false;
-
-    // Vider buffer et envoyer
-    while (modbusSerial->available())
-        modbusSerial->read();
-    enableRS485Transmit();
-    modbusSerial->write(sendBuffer, frameLength);
-    modbusSerial->flush();
-    enableRS485Receive();
+    waitModbusIdle(bus);
 
-    // Attendre réponse
-    unsigned long timeout = millis() + 300;
-    int responseLength = 0;
+    if (!startReadTransaction(batteryId, startAddr, regCount, MODBUS_PARAM_TIMEOUT_MS))
+        return false;
 
-    while (millis() < timeout && responseLength < sizeof(receiveBuffer))
+    bool result = false;
+    uint8_t queuedRetries = bus.retryCount;
+    if (runModbusTransaction(bus) == MODBUS_STATE_COMPLETE)
     {
-        if (modbusSerial->available())
-        {
-            receiveBuffer[responseLength++] = modbusSerial->read();
-            timeout = millis() + 50;
-        }
+        result = parseResponse(batteryId, DATA_REALTIME, startAddr);
     }
+    recordBatteryResult(batteryId, result);
 
-    if (responseLength > 0)
-    {
-        return parseResponse(batteryId, DATA_REALTIME);
-    }
+    releaseModbusTransaction(bus);
 
-    return false;
+    if (bus.retryCount > queuedRetries)
+        result = runRegisterRetries(bus);
+    return result;
 }
 
 bool readAllBatteriesData(ModbusDataType dataType)
@@ -228,15 +2005,15 @@ bool readAllBatteriesData(ModbusDataType dataType)
     Serial.printf("=== LECTURE TOUTES BATTERIES (Type %d) ===\n", dataType);
 
     bool success = true;
-    for (uint8_t id = 1; id <= MAX_BATTERIES; id++)
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
     {
+        uint8_t id = batterySlotIds[slot];
         bool result = readBatteryData(id, dataType);
         if (!result)
         {
             Serial.printf("Échec lecture batterie ID=%d\n", id);
             success = false;
         }
-        delay(100); // Délai entre batteries
     }
 
     return success;
@@ -245,23 +2022,21 @@ bool readAllBatteriesData(ModbusDataType dataType)
 // ——————— FONCTIONS D'ÉCRITURE ———————
 bool writeBatteryParam(uint8_t batteryId, uint16_t regAddr, uint16_t value)
 {
-    if (batteryId < 1 || batteryId > MAX_BATTERIES)
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    if (getBatterySlot(batteryId) < 0)
         return false;
 
     Serial.printf("Écriture batterie ID=%d, reg=0x%04X, val=%d\n", batteryId, regAddr, value);
 
-    int frameLength = buildWriteCommand(batteryId, regAddr, value);
+    waitModbusIdle(bus);
+
+    int frameLength = buildWriteCommand(bus.sendBuffer, requestAddress(bus, batteryId), regAddr, value);
     if (frameLength <= 0)
         return false;
 
-    printModbusBuffer("WRITE", sendBuffer, frameLength);
-
-    while (modbusSerial->available())
-        modbusSerial->read();
-    enableRS485Transmit();
-    modbusSerial->write(sendBuffer, frameLength);
-    modbusSerial->flush();
-    enableRS485Receive();
+    if (!startModbusTransaction(bus, batteryId, frameLength, MODBUS_ACK_TIMEOUT_MS,
+                                MODBUS_ACK_INTERBYTE_TIMEOUT_MS, 16))
+        return false;
 
     // Attendre l'ACK
     if (!waitForAck(batteryId, "WRITE"))
@@ -284,226 +2059,518 @@ bool setDischargeMosfet(uint8_t batteryId, bool enable)
     return writeBatteryParam(batteryId, REG_DISCHARGE_CONTROL, enable ? 1 : 0);
 }
 
+bool setBatteryMosfets(uint8_t batteryId, bool charge, bool discharge)
+{
+    // Charge et décharge en une seule écriture 0x10 (0x0121~0x0122)
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    if (getBatterySlot(batteryId) < 0)
+        return false;
+
+    waitModbusIdle(bus);
+
+    int frameLength = buildMosfetCommand(bus.sendBuffer, requestAddress(bus, batteryId), charge, discharge);
+    if (!startModbusTransaction(bus, batteryId, frameLength, MODBUS_ACK_TIMEOUT_MS,
+                                MODBUS_ACK_INTERBYTE_TIMEOUT_MS, 16))
+        return false;
+
+    return waitForAck(batteryId, "MOSFET");
+}
+
+// ——————— COMMANDE MOSFET GROUPÉE ———————
+// Une commande vise toutes les batteries joignables. En mode pipeline, chaque
+// bus enchaîne les écritures 0x10 de ses batteries (les bus en parallèle) ; en
+// mode broadcast, une seule trame par bus puis relecture de PARAM_MOSFET_STATES.
+// Le broadcast n'est utilisé que si MODBUS_MOSFET_BROADCAST l'autorise.
+// Les réponses sont traitées par updateModbusPolling(), sans bloquer loop().
+
+static_assert(MAX_BATTERIES <= 32, "Masques d'emplacements sur 32 bits");
+
+static BankMosfetCommand bankCommand;
+
+static void cancelBankCommand()
+{
+    // Emplacements réattribués : les masques de la commande en cours n'ont plus de sens
+    bankCommand.active = false;
+}
+
+static void endBankCommand()
+{
+    bankCommand.active = false;
+    bankCommand.lastDurationUs = micros() - bankCommand.startUs;
+    if (bankCommand.lastDurationUs > bankCommand.worstDurationUs)
+        bankCommand.worstDurationUs = bankCommand.lastDurationUs;
+
+    Serial.printf("Commande MOSFET C=%d D=%d: %d/%d confirmées en %luus (pire cas %luus)\n",
+                  bankCommand.charge, bankCommand.discharge,
+                  __builtin_popcount(bankCommand.confirmedMask),
+                  __builtin_popcount(bankCommand.targetMask),
+                  bankCommand.lastDurationUs, bankCommand.worstDurationUs);
+}
+
+static void settleBankBattery(uint8_t batteryId, bool confirmed)
+{
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
+        return;
+    uint32_t bit = 1UL << slot;
+    if (!(bankCommand.pendingMask & bit))
+        return;
+
+    if (confirmed)
+    {
+        bankCommand.pendingMask &= ~bit;
+        bankCommand.confirmedMask |= bit;
+    }
+    else if (++bankCommand.attempts[slot] >= MODBUS_MOSFET_RETRIES)
+    {
+        bankCommand.pendingMask &= ~bit;
+        bankCommand.failedMask |= bit;
+    }
+
+    if (!bankCommand.pendingMask)
+        endBankCommand();
+}
+
+bool setBankMosfets(bool charge, bool discharge, MosfetDispatchMode mode)
+{
+#if !MODBUS_MOSFET_BROADCAST
+    // Adresse 0x00 non validée sur ces BMS : écritures individuelles acquittées
+    if (mode == MOSFET_DISPATCH_BROADCAST)
+    {
+        Serial.println("Commande MOSFET: broadcast désactivé (MODBUS_MOSFET_BROADCAST), envoi par adresse");
+        mode = MOSFET_DISPATCH_PIPELINED;
+    }
+#endif
+
+    // Une nouvelle commande remplace celle en cours (ouverture d'urgence)
+    unsigned long worst = bankCommand.worstDurationUs;
+    uint32_t count = bankCommand.commandCount;
+    uint8_t seq = bankCommand.seq;
+    memset(&bankCommand, 0, sizeof(bankCommand));
+
+    bankCommand.charge = charge;
+    bankCommand.discharge = discharge;
+    bankCommand.mode = mode;
+    bankCommand.seq = seq + 1;
+    bankCommand.worstDurationUs = worst;
+    bankCommand.commandCount = count + 1;
+    bankCommand.startUs = micros();
+
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        if (batteryLinks[slot].state != LINK_OFFLINE)
+            bankCommand.targetMask |= 1UL << slot;
+    }
+    bankCommand.pendingMask = bankCommand.targetMask;
+
+    if (!bankCommand.targetMask)
+    {
+        Serial.println("Commande MOSFET: aucune batterie joignable");
+        return false;
+    }
+
+    for (int i = 0; i < MODBUS_BUS_COUNT; i++)
+    {
+        bankCommand.broadcastPending[i] = mode == MOSFET_DISPATCH_BROADCAST && modbusBuses[i].serial;
+    }
+    bankCommand.active = true;
+    return true;
+}
+
+bool isBankMosfetCommandPending()
+{
+    return bankCommand.active;
+}
+
+const BankMosfetCommand *getBankMosfetCommand()
+{
+    return &bankCommand;
+}
+
+static bool startBankCommandTransaction(ModbusBus &bus)
+{
+    if (!bankCommand.active)
+        return false;
+
+    ModbusTransaction &tx = bus.transaction;
+    if (bankCommand.broadcastPending[bus.index])
+    {
+        // Pas de réponse : le timeout sert de délai de traitement
+        int frameLength = buildMosfetCommand(bus.sendBuffer, MODBUS_BROADCAST_ADDR,
+                                             bankCommand.charge, bankCommand.discharge);
+        if (!startModbusTransaction(bus, 0, frameLength, MODBUS_BROADCAST_TURNAROUND_MS,
+                                    MODBUS_ACK_INTERBYTE_TIMEOUT_MS, 16))
+            return false;
+        bankCommand.broadcastPending[bus.index] = false;
+    }
+    else
+    {
+        uint8_t batteryId = 0;
+        for (uint8_t slot = 0; slot < batteryCount && !batteryId; slot++)
+        {
+            if ((bankCommand.pendingMask & (1UL << slot)) && batteryBusMap[slot] == bus.index)
+                batteryId = batterySlotIds[slot];
+        }
+        if (!batteryId)
+            return false;
+
+        if (bankCommand.mode == MOSFET_DISPATCH_BROADCAST)
+        {
+            // Confirmation par relecture de l'état des MOSFET
+            uint16_t startAddr, regCount;
+            getBatteryParamRange(PARAM_MOSFET_STATES, &startAddr, &regCount);
+            if (!startReadTransaction(batteryId, startAddr, regCount, MODBUS_PARAM_TIMEOUT_MS))
+                return false;
+        }
+        else
+        {
+            int frameLength = buildMosfetCommand(bus.sendBuffer, requestAddress(bus, batteryId),
+                                                 bankCommand.charge, bankCommand.discharge);
+            if (!startModbusTransaction(bus, batteryId, frameLength, MODBUS_ACK_TIMEOUT_MS,
+                                        MODBUS_ACK_INTERBYTE_TIMEOUT_MS, 16))
+                return false;
+        }
+    }
+
+    tx.background = true;
+    tx.command = true;
+    tx.commandSeq = bankCommand.seq;
+    return true;
+}
+
+static void finishBankCommandTransaction(ModbusBus &bus)
+{
+    ModbusTransaction &tx = bus.transaction;
+    uint8_t batteryId = tx.batteryId;
+
+    // Broadcast émis, ou réponse d'une commande remplacée entre-temps
+    if (batteryId == 0 || !bankCommand.active || tx.commandSeq != bankCommand.seq)
+        return;
+
+    bool confirmed = false;
+    if (tx.state == MODBUS_STATE_COMPLETE)
+    {
+        BatteryData *battery = getBatteryData(batteryId);
+        if (tx.regCount > 0)
+        {
+            // Relecture après broadcast : l'état doit refléter la commande
+            confirmed = parseResponse(batteryId, DATA_REALTIME, tx.startAddr) &&
+                        getBatteryFlag(*battery, BATTERY_FLAG_CHARGE_MOSFET) == bankCommand.charge &&
+                        getBatteryFlag(*battery, BATTERY_FLAG_DISCHARGE_MOSFET) == bankCommand.discharge;
+        }
+        else
+        {
+            confirmed = classifyResponse(tx, bus.receiveBuffer, CMD_WRITE_MULTIPLE) == TRACE_OK &&
+                        writeEchoMatches(bus.sendBuffer, bus.receiveBuffer);
+            if (confirmed)
+            {
+                setBatteryFlag(*battery, BATTERY_FLAG_CHARGE_MOSFET, bankCommand.charge);
+                setBatteryFlag(*battery, BATTERY_FLAG_DISCHARGE_MOSFET, bankCommand.discharge);
+            }
+        }
+    }
+
+    recordBatteryResult(batteryId, tx.state == MODBUS_STATE_COMPLETE);
+    settleBankBattery(batteryId, confirmed);
+}
+
 // ——————— ACCÈS AUX DONNÉES ———————
 BatteryData *getBatteryData(uint8_t batteryId)
 {
-    if (batteryId < 1 || batteryId > MAX_BATTERIES)
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
         return nullptr;
-    return &batteries[batteryId - 1];
+    return &batteries[slot];
 }
 
 float getBatterySOC(uint8_t batteryId)
 {
     BatteryData *data = getBatteryData(batteryId);
-    return data && data->dataValid ? data->soc : -1.0f;
+    return data && isBatteryDataValid(*data) ? getBatterySOC(*data) : -1.0f;
 }
 
 float getBatteryVoltage(uint8_t batteryId)
 {
     BatteryData *data = getBatteryData(batteryId);
-    return data && data->dataValid ? data->totalVoltage : -1.0f;
+    return data && isBatteryDataValid(*data) ? getBatteryVoltage(*data) : -1.0f;
 }
 
 float getBatteryCurrent(uint8_t batteryId)
 {
     BatteryData *data = getBatteryData(batteryId);
-    return data && data->dataValid ? data->current : 0.0f;
+    return data && isBatteryDataValid(*data) ? getBatteryCurrent(*data) : 0.0f;
 }
 
 bool isBatteryDataValid(uint8_t batteryId)
 {
     BatteryData *data = getBatteryData(batteryId);
-    return data && data->dataValid;
+    return data && isBatteryDataValid(*data);
 }
 
 // ——————— FONCTIONS UTILITAIRES ———————
 
-int buildReadCommand(uint8_t batteryId, uint16_t startAddr, uint16_t regCount)
+int buildReadCommand(uint8_t *frame, uint8_t address, uint16_t startAddr, uint16_t regCount)
 {
-    sendBuffer[0] = MASTER_ADDR;             // Adresse maître
-    sendBuffer[1] = CMD_READ_HOLDING;        // Fonction lecture
-    sendBuffer[2] = (startAddr >> 8) & 0xFF; // Adresse start (high)
-    sendBuffer[3] = startAddr & 0xFF;        // Adresse start (low)
-    sendBuffer[4] = (regCount >> 8) & 0xFF;  // Nombre registres (high)
-    sendBuffer[5] = regCount & 0xFF;         // Nombre registres (low)
+    frame[0] = address;                    // Adresse de requête de la batterie
+    frame[1] = CMD_READ_HOLDING;           // Fonction lecture
+    frame[2] = (startAddr >> 8) & 0xFF;    // Adresse start (high)
+    frame[3] = startAddr & 0xFF;           // Adresse start (low)
+    frame[4] = (regCount >> 8) & 0xFF;     // Nombre registres (high)
+    frame[5] = regCount & 0xFF;            // Nombre registres (low)
 
-    uint16_t crc = calculateCRC16(sendBuffer, 6);
-    sendBuffer[6] = crc & 0xFF;        // CRC low
-    sendBuffer[7] = (crc >> 8) & 0xFF; // CRC high
+    uint16_t crc = calculateCRC16(frame, 6);
+    frame[6] = crc & 0xFF;        // CRC low
+    frame[7] = (crc >> 8) & 0xFF; // CRC high
 
     return 8;
 }
 
-int buildWriteCommand(uint8_t batteryId, uint16_t regAddr, uint16_t value)
+int buildWriteCommand(uint8_t *frame, uint8_t address, uint16_t regAddr, uint16_t value)
 {
-    sendBuffer[0] = MASTER_ADDR;           // Adresse maître
-    sendBuffer[1] = CMD_WRITE_SINGLE;      // Fonction écriture simple
-    sendBuffer[2] = (regAddr >> 8) & 0xFF; // Adresse reg (high)
-    sendBuffer[3] = regAddr & 0xFF;        // Adresse reg (low)
-    sendBuffer[4] = (value >> 8) & 0xFF;   // Valeur (high)
-    sendBuffer[5] = value & 0xFF;          // Valeur (low)
+    frame[0] = address;                  // Adresse de requête de la batterie
+    frame[1] = CMD_WRITE_SINGLE;         // Fonction écriture simple
+    frame[2] = (regAddr >> 8) & 0xFF;    // Adresse reg (high)
+    frame[3] = regAddr & 0xFF;           // Adresse reg (low)
+    frame[4] = (value >> 8) & 0xFF;      // Valeur (high)
+    frame[5] = value & 0xFF;             // Valeur (low)
 
-    uint16_t crc = calculateCRC16(sendBuffer, 6);
-    sendBuffer[6] = crc & 0xFF;        // CRC low
-    sendBuffer[7] = (crc >> 8) & 0xFF; // CRC high
+    uint16_t crc = calculateCRC16(frame, 6);
+    frame[6] = crc & 0xFF;        // CRC low
+    frame[7] = (crc >> 8) & 0xFF; // CRC high
 
     return 8;
 }
 
-bool parseResponse(uint8_t batteryId, ModbusDataType dataType)
+int buildMosfetCommand(uint8_t *frame, uint8_t address, bool charge, bool discharge)
+{
+    frame[0] = address;                             // Adresse (ou broadcast)
+    frame[1] = CMD_WRITE_MULTIPLE;                  // Fonction écriture multiple
+    frame[2] = (REG_CHARGE_CONTROL >> 8) & 0xFF;    // Adresse 0x0121 (high)
+    frame[3] = REG_CHARGE_CONTROL & 0xFF;           // Adresse 0x0121 (low)
+    frame[4] = 0x00;                                // Nombre de registres (high)
+    frame[5] = 0x02;                                // 0x0121 charge, 0x0122 décharge
+    frame[6] = 0x04;                                // Nombre d'octets
+    frame[7] = 0x00;
+    frame[8] = charge ? 1 : 0;
+    frame[9] = 0x00;
+    frame[10] = discharge ? 1 : 0;
+
+    uint16_t crc = calculateCRC16(frame, 11);
+    frame[11] = crc & 0xFF;        // CRC low
+    frame[12] = (crc >> 8) & 0xFF; // CRC high
+
+    return 13;
+}
+
+static void checkSettingsIdentity(uint8_t batteryId, uint16_t previousHeartbeat,
+                                  uint16_t startAddr, uint16_t regCount);
+
+bool parseResponse(uint8_t batteryId, ModbusDataType dataType, uint16_t startAddr)
+{
+    // Trame de la transaction en cours du bus de la batterie
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    return parseFrame(batteryId, dataType, startAddr, bus.receiveBuffer, bus.transaction);
+}
+
+bool parseFrame(uint8_t batteryId, ModbusDataType dataType, uint16_t startAddr,
+                const uint8_t *frame, const ModbusTransaction &tx)
 {
-    if (batteryId < 1 || batteryId > MAX_BATTERIES)
+    int8_t slot = getBatterySlot(batteryId);
+    if (slot < 0)
         return false;
 
-    BatteryData *battery = &batteries[batteryId - 1];
+    BatteryData *battery = &batteries[slot];
 
-    // Utiliser 0x50 + ID
-    uint8_t expectedAddr = 0x50 + batteryId;
-    if (receiveBuffer[0] != expectedAddr)
+    // Validation stricte : longueur, CRC, adresse, exception, fonction, nombre d'octets.
+    // Polling : la cause est dans la trace et les statistiques, pas sur Serial
+    bool verbose = MODBUS_VERBOSE || !tx.background;
+    uint16_t dataLength = tx.regCount * 2; // Le champ 8 bits déborde pour 128 registres
+    switch (classifyResponse(tx, frame, CMD_READ_HOLDING))
     {
-        Serial.printf("ERREUR: Adresse réponse incorrecte (reçu 0x%02X, attendu 0x%02X)\n",
-                      receiveBuffer[0], expectedAddr);
+    case TRACE_OK:
+        break;
+    case TRACE_TRUNCATED:
+        if (verbose)
+            Serial.printf("ERREUR: Réponse tronquée batterie ID=%d (%d/%d octets)\n",
+                          batteryId, tx.responseLength, tx.expectedLength);
+        queueRegisterRetry(tx, tx.startAddr, tx.regCount, true);
+        return false;
+    case TRACE_BAD_CRC:
+        if (verbose)
+            Serial.printf("ERREUR: CRC invalide batterie ID=%d\n", batteryId);
+        queueRegisterRetry(tx, tx.startAddr, tx.regCount, true);
+        return false;
+    case TRACE_BAD_ADDRESS:
+        if (verbose)
+            Serial.printf("ERREUR: Adresse réponse incorrecte (reçu 0x%02X, attendu 0x%02X)\n",
+                          frame[0], tx.responseAddr);
+        return false;
+    case TRACE_EXCEPTION:
+        if (verbose)
+            Serial.printf("ERREUR: Exception Modbus 0x%02X batterie ID=%d\n", frame[2], batteryId);
+        return false;
+    case TRACE_BAD_LENGTH:
+        // Réponse intègre mais plus courte que demandé : garder le début
+        // (registres temps réel seulement) et relire la suite
+        if (dataType != DATA_REALTIME || frame[2] == 0 || (frame[2] & 1) ||
+            frame[2] > dataLength || tx.responseLength != frame[2] + 5)
+        {
+            if (verbose)
+                Serial.printf("ERREUR: Nombre d'octets incohérent (reçu %d, attendu %d)\n",
+                              frame[2], dataLength);
+            return false;
+        }
+        dataLength = frame[2];
+        queueRegisterRetry(tx, tx.startAddr + dataLength / 2, tx.regCount - dataLength / 2, false);
+        break;
+    default:
+        if (verbose)
+            Serial.printf("ERREUR: Fonction incorrecte (reçu 0x%02X)\n", frame[1]);
         return false;
     }
 
-    // Vérifier la fonction
-    if (receiveBuffer[1] != CMD_READ_HOLDING)
+    if (dataType == DATA_REALTIME)
     {
-        Serial.printf("ERREUR: Fonction incorrecte (reçu 0x%02X)\n", receiveBuffer[1]);
-        return false;
-    }
+        // Parser les données temps réel (fenêtre commençant à startAddr)
+        uint16_t previousHeartbeat = battery->heartbeat;
+        parseRealtimeData(battery, &frame[3], dataLength, startAddr);
+        checkSettingsIdentity(batteryId, previousHeartbeat, startAddr, dataLength / 2);
+
+        // BATTERY_FLAG_DATA_VALID/lastUpdate suivent les valeurs principales (SOC/V/I) :
+        // une sonde ou un niveau lent ne les rafraîchit pas
+        uint16_t mainStart, mainCount;
+        getBatteryParamRange(PARAM_MAIN_VALUES, &mainStart, &mainCount);
+        if (startAddr <= mainStart && startAddr + dataLength / 2 >= mainStart + mainCount)
+        {
+            unsigned long now = millis();
+            setBatteryFlag(*battery, BATTERY_FLAG_DATA_VALID, true);
+            battery->lastUpdate = now;
 
-    // Vérifier la longueur des données
-    uint8_t dataLength = receiveBuffer[2];
-    Serial.printf("Longueur données: %d bytes\n", dataLength);
+            ModbusStats &stats = batteryStats[slot];
+            if (stats.lastRefresh)
+            {
+                stats.refreshIntervalMs = now - stats.lastRefresh;
+                if (stats.refreshIntervalMs > stats.refreshIntervalMaxMs)
+                    stats.refreshIntervalMaxMs = stats.refreshIntervalMs;
+            }
+            stats.lastRefresh = now;
+        }
 
-    if (dataType == DATA_REALTIME)
+        // Totaux du pack : seule cette batterie est recalculée
+        uint16_t windowEnd = startAddr + dataLength / 2;
+        updatePackBattery(slot, startAddr < REG_CELL_VOLTAGES_START + BATTERY_MAX_CELLS,
+                          startAddr < REG_TEMPERATURES_START + BATTERY_MAX_TEMPS &&
+                              windowEnd > REG_TEMPERATURES_START);
+    }
+    else
     {
-        // Parser les données temps réel
-        parseRealtimeData(battery, &receiveBuffer[3], dataLength);
+        parseSettingsData(batteryId, dataType, &frame[3], dataLength);
     }
 
-    battery->dataValid = true;
-    battery->lastUpdate = millis();
-
     return true;
 }
 
-void parseRealtimeData(BatteryData *battery, uint8_t *data, uint8_t length)
+static void storeRegister(BatteryData *battery, const RegisterDescriptor &desc,
+                          uint8_t index, uint16_t raw)
 {
-    // SOC (0x3A) - offset 0x3A*2 = 116
-    if (length > 116)
-    {
-        uint16_t socRaw = (data[116] << 8) | data[117];
-        battery->soc = socRaw * 0.001f; // Selon doc: 0.001, 800/1000=80%
-    }
-
-    // Tension totale (0x38) - offset 0x38*2 = 112
-    if (length > 112)
-    {
-        uint16_t voltageRaw = (data[112] << 8) | data[113];
-        battery->totalVoltage = voltageRaw / 10.0f; // Selon doc: /10
-    }
-
-    // Courant (0x39) - offset 0x39*2 = 114
-    if (length > 114)
-    {
-        uint16_t currentRaw = (data[114] << 8) | data[115];
-        // Selon doc: 0.1A, 30000 Offset, charge=négatif, décharge=positif
-        battery->current = ((int16_t)currentRaw - 30000) * 0.1f;
-    }
+    uint8_t *base = (uint8_t *)battery;
+    bool valid = !(desc.flags & REG_FLAG_ZERO_INVALID) || raw != 0;
 
-    // MOSFET charge (0x52) - offset 0x52*2 = 164
-    if (length > 164)
+    if (desc.validMaskOffset != REG_NO_FIELD)
     {
-        battery->chargeMosfet = (data[165] & 0x01) != 0; // Bit 0
+        uint8_t *mask = base + desc.validMaskOffset;
+        if (valid)
+            mask[index / 8] |= (1 << (index % 8));
+        else
+            mask[index / 8] &= ~(1 << (index % 8));
     }
 
-    // MOSFET décharge (0x53) - offset 0x53*2 = 166
-    if (length > 166)
+    uint8_t *field = desc.fieldOffset == REG_CELL_STORE ? (uint8_t *)getBatteryCellsMv(*battery)
+                                                        : base + desc.fieldOffset;
+    switch (desc.type)
     {
-        battery->dischargeMosfet = (data[167] & 0x01) != 0; // Bit 0
-    }
-
-    // Nombre de cellules (0x3C) - offset 0x3C*2 = 120
-    if (length > 120)
+    case FIELD_I16:
     {
-        battery->cellCount = data[121]; // Low byte
+        int32_t value = (desc.flags & REG_FLAG_SIGNED) ? (int32_t)(int16_t)raw : (int32_t)raw;
+        ((int16_t *)field)[index] = valid ? (int16_t)((value + desc.offset) * desc.scale) : 0;
+        break;
     }
-
-    // Nombre capteurs température (0x3D) - offset 0x3D*2 = 122
-    if (length > 122)
-    {
-        battery->tempSensorCount = data[123]; // Low byte
+    case FIELD_U8:
+        field[index] = raw & 0xFF;
+        break;
+    case FIELD_U16:
+        ((uint16_t *)field)[index] = raw;
+        break;
+    case FIELD_FLAG:
+        if (raw & 0x01)
+            *field |= desc.flagMask;
+        else
+            *field &= ~desc.flagMask;
+        break;
     }
+}
 
-    // Température MOS (0x5A) - offset 0x5A*2 = 180
-    if (length > 180)
-    {
-        uint16_t tempRaw = (data[180] << 8) | data[181];
-        battery->mosTemp = tempRaw - 40.0f; // Selon doc: offset -40
-    }
+int decodeRegisters(BatteryData *battery, const uint8_t *data, uint16_t length, uint16_t startAddr)
+{
+    // Décodage générique : seuls les registres de la fenêtre reçue sont traités.
+    // La fenêtre est calculée une seule fois à partir de la longueur de trame.
+    uint16_t windowEnd = startAddr + length / 2;
+    int decoded = 0;
 
-    // Tensions cellules (0x00~0x2F) - 48 cellules max
-    battery->validCells = 0;
-    for (int i = 0; i < 48 && (i * 2 + 1) < length; i++)
+    for (size_t i = 0; i < REGISTER_MAP_SIZE; i++)
     {
-        uint16_t cellVoltage = (data[i * 2] << 8) | data[i * 2 + 1];
-        if (cellVoltage > 0)
-        {                                           // Cellule valide
-            battery->cellVoltages[i] = cellVoltage; // En mV selon doc
-            battery->validCells++;
+        const RegisterDescriptor &desc = REALTIME_REGISTERS[i];
+        if (desc.address >= windowEnd)
+            break; // Table triée : plus rien dans la fenêtre
+        if (desc.address + desc.count <= startAddr)
+            continue;
+
+        uint16_t first = max(desc.address, startAddr);
+        uint16_t last = min((uint16_t)(desc.address + desc.count), windowEnd);
+        for (uint16_t reg = first; reg < last; reg++)
+        {
+            uint16_t offset = (reg - startAddr) * 2;
+            storeRegister(battery, desc, reg - desc.address, (data[offset] << 8) | data[offset + 1]);
+            decoded++;
         }
-    }
 
-    // Températures capteurs (0x30~0x37) - offset 0x30*2 = 96
-    battery->validTemps = 0;
-    for (int i = 0; i < 8 && (96 + i * 2 + 1) < length; i++)
-    {
-        uint16_t tempRaw = (data[96 + i * 2] << 8) | data[96 + i * 2 + 1];
-        if (tempRaw > 0)
-        {                                               // Capteur valide
-            battery->temperatures[i] = tempRaw - 40.0f; // Offset -40
-            battery->validTemps++;
+        // Recompter les éléments valides d'un tableau
+        if (desc.validCountOffset != REG_NO_FIELD)
+        {
+            const uint8_t *mask = (const uint8_t *)battery + desc.validMaskOffset;
+            uint8_t count = 0;
+            for (uint8_t n = 0; n < (desc.count + 7) / 8; n++)
+                count += __builtin_popcount(mask[n]);
+            *((uint8_t *)battery + desc.validCountOffset) = count;
         }
     }
 
-    // États de défaut (0x66, 0x67, 0x68) - offsets 204, 206, 208
-    if (length > 204)
-    {
-        battery->faultStatus1 = (data[204] << 8) | data[205];
-    }
-    if (length > 206)
-    {
-        battery->faultStatus2 = (data[206] << 8) | data[207];
-    }
-    if (length > 208)
-    {
-        battery->faultStatus3 = (data[208] << 8) | data[209];
-    }
+    return decoded;
+}
 
-    Serial.printf("Batterie ID=%d parsée: SOC=%.1f%%, V=%.1fV, I=%.1fA, Cellules=%d\n",
-                  battery->batteryId, battery->soc, battery->totalVoltage,
-                  battery->current, battery->validCells);
+void parseRealtimeData(BatteryData *battery, const uint8_t *data, uint16_t length, uint16_t startAddr)
+{
+    // Chemin du décodage recouvert : aucune sortie série (printBatteryData à la demande)
+    decodeRegisters(battery, data, length, startAddr);
 }
 
 void printBatteryData(uint8_t batteryId)
 {
     BatteryData *data = getBatteryData(batteryId);
-    if (!data || !data->dataValid)
+    if (!data || !isBatteryDataValid(*data))
     {
         Serial.printf("Batterie ID=%d: DONNÉES INVALIDES\n", batteryId);
         return;
     }
 
     Serial.printf("\n=== BATTERIE ID=%d ===\n", batteryId);
-    Serial.printf("SOC: %.1f%%\n", data->soc);
-    Serial.printf("Tension totale: %.1fV\n", data->totalVoltage);
-    Serial.printf("Courant: %.1fA %s\n", abs(data->current),
-                  data->current < 0 ? "(charge)" : "(décharge)");
-    Serial.printf("MOSFET Charge: %s\n", data->chargeMosfet ? "ON" : "OFF");
-    Serial.printf("MOSFET Décharge: %s\n", data->dischargeMosfet ? "ON" : "OFF");
-    Serial.printf("Température MOS: %.1f°C\n", data->mosTemp);
+    Serial.printf("SOC: %.1f%%\n", getBatterySOC(*data));
+    Serial.printf("Tension totale: %.1fV\n", getBatteryVoltage(*data));
+    Serial.printf("Courant: %.1fA %s\n", fabsf(getBatteryCurrent(*data)),
+                  data->currentDa < 0 ? "(charge)" : "(décharge)");
+    Serial.printf("MOSFET Charge: %s\n", getBatteryFlag(*data, BATTERY_FLAG_CHARGE_MOSFET) ? "ON" : "OFF");
+    Serial.printf("MOSFET Décharge: %s\n", getBatteryFlag(*data, BATTERY_FLAG_DISCHARGE_MOSFET) ? "ON" : "OFF");
+    Serial.printf("Température MOS: %.1f°C\n", getBatteryMosTemp(*data));
     Serial.printf("Cellules: %d validées\n", data->validCells);
     Serial.printf("Capteurs T°: %d validés\n", data->validTemps);
 
@@ -512,9 +2579,10 @@ void printBatteryData(uint8_t batteryId)
     {
         Serial.print("Tensions cellules (mV): ");
         int maxDisplay = (data->validCells < 8) ? data->validCells : 8;
+        const uint16_t *cells = getBatteryCellsMv(*data);
         for (int i = 0; i < maxDisplay; i++)
         {
-            Serial.printf("%.0f ", data->cellVoltages[i]);
+            Serial.printf("%u ", cells[i]);
         }
         if (data->validCells > 8)
             Serial.print("...");
@@ -539,9 +2607,9 @@ void printBatteryData(uint8_t batteryId)
 bool sendDisplayIdToAllBatteries(uint8_t asciiValue)
 {
 
-    for (uint8_t batteryId = 1; batteryId <= MAX_BATTERIES; batteryId++)
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
     {
-        sendDisplayIdToBattery(batteryId, asciiValue);
+        sendDisplayIdToBattery(batterySlotIds[slot], asciiValue);
         delay(2000);
     }
 
@@ -550,7 +2618,8 @@ bool sendDisplayIdToAllBatteries(uint8_t asciiValue)
 
 bool sendDisplayIdToBattery(uint8_t batteryId, uint8_t asciiValue)
 {
-    if (!modbusSerial || batteryId < 1 || batteryId > MAX_BATTERIES)
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    if (!bus.serial || getBatterySlot(batteryId) < 0)
     {
         Serial.println("ERREUR: Paramètres invalides pour affichage ID");
         return false;
@@ -558,44 +2627,36 @@ bool sendDisplayIdToBattery(uint8_t batteryId, uint8_t asciiValue)
 
     Serial.printf("Envoi H=7 à batterie ID=%d\n", batteryId);
 
+    waitModbusIdle(bus);
+
     // Construction de la trame
-    sendBuffer[0] = 0x80 + batteryId; // ID de la batterie
-    sendBuffer[1] = 0x10;             // Fonction écriture multiple
-    sendBuffer[2] = 0x01;             // Adresse registre 0x01F1 (high)
-    sendBuffer[3] = 0xF1;             // Adresse registre 0x01F1 (low)
-    sendBuffer[4] = 0x00;             // Nombre de registres (high)
-    sendBuffer[5] = 0x04;             // Nombre de registres (low)
-    sendBuffer[6] = asciiValue;       // Valeur en ASCII
-    sendBuffer[7] = 0x00;             // Reste à zéro
-    sendBuffer[8] = 0x00;
-    sendBuffer[9] = 0x00;
-    sendBuffer[10] = 0x00;
-    sendBuffer[11] = 0x00;
-    sendBuffer[12] = 0x00;
-    sendBuffer[13] = 0x00;
+    bus.sendBuffer[0] = requestAddress(bus, batteryId); // ID de la batterie
+    bus.sendBuffer[1] = 0x10;             // Fonction écriture multiple
+    bus.sendBuffer[2] = 0x01;             // Adresse registre 0x01F1 (high)
+    bus.sendBuffer[3] = 0xF1;             // Adresse registre 0x01F1 (low)
+    bus.sendBuffer[4] = 0x00;             // Nombre de registres (high)
+    bus.sendBuffer[5] = 0x04;             // Nombre de registres (low)
+    bus.sendBuffer[6] = asciiValue;       // Valeur en ASCII
+    bus.sendBuffer[7] = 0x00;             // Reste à zéro
+    bus.sendBuffer[8] = 0x00;
+    bus.sendBuffer[9] = 0x00;
+    bus.sendBuffer[10] = 0x00;
+    bus.sendBuffer[11] = 0x00;
+    bus.sendBuffer[12] = 0x00;
+    bus.sendBuffer[13] = 0x00;
 
     // Calculer le CRC sur les 14 premiers bytes
-    uint16_t crc = calculateCRC16(sendBuffer, 14);
-    sendBuffer[14] = crc & 0xFF;        // CRC low
-    sendBuffer[15] = (crc >> 8) & 0xFF; // CRC high
-
-    char label[40];
-    sprintf(label, "DISPLAY_ASCII_%d ID=%d", asciiValue, batteryId);
-    printModbusBuffer(label, sendBuffer, 16);
-
-    // Vider le buffer de réception simple
-    while (modbusSerial->available())
-    {
-        modbusSerial->read();
-    }
+    uint16_t crc = calculateCRC16(bus.sendBuffer, 14);
+    bus.sendBuffer[14] = crc & 0xFF;        // CRC low
+    bus.sendBuffer[15] = (crc >> 8) & 0xFF; // CRC high
 
     // Envoi
-    enableRS485Transmit();
-    modbusSerial->write(sendBuffer, 16);
-    modbusSerial->flush();
-    enableRS485Receive();
+    if (!startModbusTransaction(bus, batteryId, 16, MODBUS_ACK_TIMEOUT_MS,
+                                MODBUS_ACK_INTERBYTE_TIMEOUT_MS, 16))
+        return false;
 
     // Attendre l'ACK
+    char label[30];
     sprintf(label, "DISPLAY_ASCII_%d", asciiValue);
     bool ackReceived = waitForAck(batteryId, label);
 
@@ -613,52 +2674,106 @@ bool sendDisplayIdToBattery(uint8_t batteryId, uint8_t asciiValue)
 
 bool waitForAck(uint8_t batteryId, const char *operation)
 {
-    unsigned long timeout = millis() + 200;
-    int responseLength = 0;
-
-    // Nettoyer le buffer de réception
-    memset(receiveBuffer, 0, sizeof(receiveBuffer));
-
-    while (millis() < timeout && responseLength < 16)
+    ModbusBus &bus = *getBatteryBus(batteryId);
+    // La commande a été lancée via startModbusTransaction() : attendre sa fin
+    bool ackReceived = false;
+    runModbusTransaction(bus);
+
+    // Même validation que les lectures, fonction de la requête en écho attendue
+    const ModbusTransaction &tx = bus.transaction;
+    const uint8_t *request = bus.sendBuffer;
+    const uint8_t *frame = bus.receiveBuffer;
+    switch (classifyResponse(tx, frame, request[1]))
     {
-        if (modbusSerial->available())
+    case TRACE_OK:
+        if (!writeEchoMatches(request, frame))
         {
-            receiveBuffer[responseLength++] = modbusSerial->read();
-            timeout = millis() + 30; // Prolonger si on reçoit des données
+            Serial.printf("✗ Écho incorrect batterie ID=%d pour %s (reg 0x%02X%02X val 0x%02X%02X, "
+                          "attendu reg 0x%02X%02X val 0x%02X%02X)\n",
+                          batteryId, operation, frame[2], frame[3], frame[4], frame[5],
+                          request[2], request[3], request[4], request[5]);
+            break;
         }
+        Serial.printf("✓ ACK reçu de batterie ID=%d pour %s\n", batteryId, operation);
+        ackReceived = true;
+        break;
+    case TRACE_TIMEOUT:
+        Serial.printf("✗ Timeout ACK batterie ID=%d pour %s\n", batteryId, operation);
+        break;
+    case TRACE_EXCEPTION:
+        Serial.printf("✗ Exception Modbus 0x%02X batterie ID=%d pour %s\n", frame[2], batteryId, operation);
+        break;
+    case TRACE_BAD_CRC:
+        Serial.printf("✗ ACK avec CRC invalide batterie ID=%d\n", batteryId);
+        break;
+    case TRACE_BAD_ADDRESS:
+        Serial.printf("✗ ACK incorrect (reçu 0x%02X, attendu 0x%02X)\n", frame[0], tx.responseAddr);
+        break;
+    case TRACE_BAD_FUNCTION:
+        Serial.printf("✗ ACK fonction 0x%02X, attendu 0x%02X\n", frame[1], request[1]);
+        break;
+    default:
+        Serial.printf("✗ ACK tronqué batterie ID=%d (%d octets)\n", batteryId, tx.responseLength);
+        break;
     }
 
-    if (responseLength > 0)
-    {
-        char label[30];
-        sprintf(label, "ACK_%s", operation);
-        printModbusBuffer(label, receiveBuffer, responseLength);
+    releaseModbusTransaction(bus);
+    return ackReceived;
+}
 
-        uint8_t expectedAddr = 0x50 + batteryId;
-        if (receiveBuffer[0] == expectedAddr)
-        {
-            Serial.printf("✓ ACK reçu de batterie ID=%d pour %s\n", batteryId, operation);
-            return true;
-        }
-        else
-        {
-            Serial.printf("✗ ACK incorrect (reçu 0x%02X, attendu 0x%02X)\n",
-                          receiveBuffer[0], expectedAddr);
-        }
+// ——————— CRC16 ———————
+
+// Un octet traité bit à bit : sert à générer les tables à la compilation
+static constexpr uint16_t crc16Bits(uint16_t crc, int bits)
+{
+    return bits == 0 ? crc : crc16Bits((crc & 0x0001) ? (crc >> 1) ^ 0xA001 : (crc >> 1), bits - 1);
+}
+
+// Entrée i de la table k : octet i suivi de k octets nuls (slice-by-N)
+static constexpr uint16_t crc16Slice(uint16_t i, int k)
+{
+    return k == 0 ? crc16Bits(i, 8)
+                  : (crc16Slice(i, k - 1) >> 8) ^ crc16Bits(crc16Slice(i, k - 1) & 0xFF, 8);
+}
+
+#define CRC16_ROW(k, r)                                                                        \
+    crc16Slice(r * 16 + 0, k), crc16Slice(r * 16 + 1, k), crc16Slice(r * 16 + 2, k),          \
+        crc16Slice(r * 16 + 3, k), crc16Slice(r * 16 + 4, k), crc16Slice(r * 16 + 5, k),     \
+        crc16Slice(r * 16 + 6, k), crc16Slice(r * 16 + 7, k), crc16Slice(r * 16 + 8, k),     \
+        crc16Slice(r * 16 + 9, k), crc16Slice(r * 16 + 10, k), crc16Slice(r * 16 + 11, k),   \
+        crc16Slice(r * 16 + 12, k), crc16Slice(r * 16 + 13, k), crc16Slice(r * 16 + 14, k),  \
+        crc16Slice(r * 16 + 15, k)
+#define CRC16_TABLE_INIT(k)                                                                    \
+    {                                                                                          \
+        CRC16_ROW(k, 0), CRC16_ROW(k, 1), CRC16_ROW(k, 2), CRC16_ROW(k, 3), CRC16_ROW(k, 4),   \
+            CRC16_ROW(k, 5), CRC16_ROW(k, 6), CRC16_ROW(k, 7), CRC16_ROW(k, 8), CRC16_ROW(k, 9), \
+            CRC16_ROW(k, 10), CRC16_ROW(k, 11), CRC16_ROW(k, 12), CRC16_ROW(k, 13),            \
+            CRC16_ROW(k, 14), CRC16_ROW(k, 15)                                                 \
     }
-    else
+
+static_assert(crc16Slice(0x01, 0) == 0xC0C1 && crc16Slice(0xFF, 0) == 0x4040,
+              "Table CRC16 Modbus incorrecte");
+
+extern const uint16_t CRC16_TABLE[256] = CRC16_TABLE_INIT(0);
+static const uint16_t CRC16_SLICE[4][256] = {
+    CRC16_TABLE_INIT(0), CRC16_TABLE_INIT(1), CRC16_TABLE_INIT(2), CRC16_TABLE_INIT(3)};
+
+uint16_t calculateCRC16(const uint8_t *data, uint16_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++)
     {
-        Serial.printf("✗ Timeout ACK batterie ID=%d pour %s\n", batteryId, operation);
+        crc = crc16Update(crc, data[i]);
     }
-
-    return false;
+    return crc;
 }
 
-uint16_t calculateCRC16(uint8_t *data, uint8_t length)
+uint16_t calculateCRC16Bitwise(const uint8_t *data, uint16_t length)
 {
+    // Version de référence (8 itérations par octet)
     uint16_t crc = 0xFFFF;
 
-    for (int i = 0; i < length; i++)
+    for (uint16_t i = 0; i < length; i++)
     {
         crc ^= data[i];
         for (int j = 0; j < 8; j++)
@@ -677,6 +2792,58 @@ uint16_t calculateCRC16(uint8_t *data, uint8_t length)
     return crc;
 }
 
+uint16_t calculateCRC16Slice4(const uint8_t *data, uint16_t length)
+{
+    // 4 octets par itération avec 4 tables (2 Ko)
+    uint16_t crc = 0xFFFF;
+    uint16_t i = 0;
+
+    for (; i + 4 <= length; i += 4)
+    {
+        uint16_t x = crc ^ (data[i] | (data[i + 1] << 8));
+        crc = CRC16_SLICE[3][x & 0xFF] ^ CRC16_SLICE[2][x >> 8] ^
+              CRC16_SLICE[1][data[i + 2]] ^ CRC16_SLICE[0][data[i + 3]];
+    }
+    for (; i < length; i++)
+    {
+        crc = crc16Update(crc, data[i]);
+    }
+    return crc;
+}
+
+void benchmarkCRC16()
+{
+    // Cycles par octet pour une requête (8 o) et une réponse temps réel (261 o)
+    static uint8_t frame[261];
+    for (int i = 0; i < (int)sizeof(frame); i++)
+        frame[i] = (uint8_t)(i * 37 + 11);
+
+    const uint16_t sizes[] = {8, 261};
+    const char *names[] = {"bit a bit", "table", "slice-by-4"};
+    uint16_t (*variants[])(const uint8_t *, uint16_t) = {
+        calculateCRC16Bitwise, calculateCRC16, calculateCRC16Slice4};
+    const int iterations = 200;
+
+    Serial.println("\n=== BENCHMARK CRC16 ===");
+    for (int s = 0; s < 2; s++)
+    {
+        uint16_t reference = calculateCRC16Bitwise(frame, sizes[s]);
+        for (int v = 0; v < 3; v++)
+        {
+            volatile uint16_t result = 0;
+            uint32_t start = ESP.getCycleCount();
+            for (int n = 0; n < iterations; n++)
+                result = variants[v](frame, sizes[s]);
+            uint32_t cycles = ESP.getCycleCount() - start;
+
+            Serial.printf("%3d octets %-10s : %6.1f cycles/octet %s\n", sizes[s], names[v],
+                          (float)cycles / ((float)iterations * sizes[s]),
+                          result == reference ? "OK" : "ERREUR");
+        }
+    }
+    Serial.println("=======================\n");
+}
+
 void printModbusBuffer(const char *label, uint8_t *buffer, int length)
 {
     Serial.printf("%s [%d bytes]: ", label, length);
@@ -4,11 +4,57 @@
 #include <Arduino.h>
 #include <HardwareSerial.h>
 #include "Config.h"
+#include "TraceManager.h"
 
 // ——————— CONSTANTES MODBUS ———————
-#define BAUD_RATE 9600
-#define MASTER_ADDR 0x81
-#define RESPONSE_ADDR_BASE 0x50 // Les BMS répondent avec 0x50 + ID
+// Vitesse par défaut et famille de BMS par bus : voir config.h
+#define BATTERY_ID_MAX 247 // Plus grande adresse esclave Modbus
+
+// Timings des transactions (ms)
+#define MODBUS_RESPONSE_TIMEOUT_MS 500    // Attente du premier octet (lecture bloc)
+#define MODBUS_PARAM_TIMEOUT_MS 300       // Attente du premier octet (lecture ciblée)
+#define MODBUS_ACK_TIMEOUT_MS 200         // Attente du premier octet (ACK écriture)
+#define MODBUS_INTERBYTE_TIMEOUT_MS 50    // Trame tronquée : abandon après ce silence
+#define MODBUS_ACK_INTERBYTE_TIMEOUT_MS 30 // Idem pour un ACK
+#define MODBUS_BITS_PER_CHAR 11           // 8E1 : start + 8 data + parité + stop
+#define MODBUS_T35_MIN_US 1750            // T3.5 fixe au-delà de 19200 bauds (spec Modbus)
+#define MODBUS_RX_BUFFER_SIZE 264         // Bloc temps réel : 3 + 256 + 2 = 261 octets
+#define MODBUS_RX_BUFFERS 2               // Réception de N+1 pendant le décodage de N
+#define MODBUS_INTER_REQUEST_GAP_MS 5     // Pause entre deux requêtes du cycle
+
+// Périodes par défaut des niveaux de polling (ms)
+#define MODBUS_TIER_FAST_MS 1000   // SOC/V/I + MOSFET (chaque cycle)
+#define MODBUS_TIER_CELLS_MS 10000 // Tensions cellules
+#define MODBUS_TIER_TEMPS_MS 10000 // Températures
+#define MODBUS_TIER_FAULTS_MS 5000 // Mots de défaut
+#define MODBUS_MAX_TIER_PARAMS 4
+
+// Suivi de liaison par batterie
+#define MODBUS_OFFLINE_AFTER_FAILURES 3 // Échecs consécutifs avant OFFLINE
+#define MODBUS_PROBE_TIMEOUT_MS 100     // Sonde courte (REG_HEARTBEAT seul)
+#define MODBUS_BACKOFF_MIN_MS 1000      // Premier intervalle de re-sonde
+#define MODBUS_BACKOFF_MAX_MS 60000     // Intervalle max (doublé à chaque échec)
+#define MODBUS_DATA_STALE_MS 10000      // Données invalidées au-delà de cet âge
+
+// Découverte des batteries (ID sans emplacement, sondés quand le bus est libre)
+#define MODBUS_SCAN_PERIOD_MS 30000 // Pause entre deux passes complètes de la plage d'ID
+
+// Statistiques : histogramme de latence (requête émise → dernier octet reçu)
+#define MODBUS_LATENCY_BUCKETS 8 // Bornes : 5, 10, 20, 50, 100, 200, 500 ms, au-delà
+
+// Négociation de la vitesse
+#define MODBUS_BAUD_PROBE_READS 3        // Lectures REG_HEARTBEAT réussies exigées par batterie
+#define MODBUS_BAUD_FALLBACK_ERRORS 8    // Erreurs consécutives avant repli sur MODBUS_BAUD
+
+// Relecture partielle (réponse tronquée, corrompue ou incomplète)
+#define MODBUS_RETRY_SLOTS 4        // Plages en attente par bus
+#define MODBUS_RETRY_MAX_ATTEMPTS 2 // Relectures d'une même plage avant abandon
+#define MODBUS_RETRY_CHUNK_REGS 64  // Trame corrompue : relue par morceaux de N registres
+
+// Commande MOSFET groupée
+#define MODBUS_BROADCAST_ADDR 0x00           // Pas de réponse des esclaves
+#define MODBUS_BROADCAST_TURNAROUND_MS 20    // Délai de traitement après un broadcast
+#define MODBUS_MOSFET_RETRIES 3              // Tentatives par batterie (écriture ou relecture)
 
 // Commandes Modbus
 #define CMD_READ_HOLDING 0x03
@@ -25,6 +71,10 @@
 #define ADDR_SETTING3_START 0x01E0
 #define ADDR_SETTING3_END 0x01FD
 
+// Cache des réglages : SETTING1/2/3 sont contigus (0x0100~0x01FD)
+#define SETTINGS_REG_COUNT (ADDR_SETTING3_END - ADDR_SETTING1_START + 1)
+#define SETTINGS_BLOCKS_ALL 0x07 // Bits DATA_SETTING1..3
+
 // Registres importants (temps réel)
 #define REG_CELL_VOLTAGES_START 0x00 // 0x00~0x2F
 #define REG_TEMPERATURES_START 0x30  // 0x30~0x37
@@ -63,6 +113,16 @@ enum ModbusDataType
     DATA_SETTING3 = 3
 };
 
+// États du moteur de transactions non bloquant
+enum ModbusTransactionState
+{
+    MODBUS_STATE_IDLE = 0,              // Aucune transaction en cours
+    MODBUS_STATE_TRANSMITTING = 1,      // Trame en cours d'émission (DE/RE haut)
+    MODBUS_STATE_AWAITING_RESPONSE = 2, // Réception en cours
+    MODBUS_STATE_COMPLETE = 3,          // Réponse complète dans receiveBuffer
+    MODBUS_STATE_TIMED_OUT = 4          // Aucune réponse dans le délai
+};
+
 enum BatteryParam
 {
     PARAM_SOC = 0,
@@ -73,61 +133,400 @@ enum BatteryParam
     PARAM_DISCHARGE_MOSFET = 5,
     PARAM_CELL_VOLTAGES = 6,
     PARAM_TEMPERATURES = 7,
-    PARAM_FAULT_STATUS = 8
+    PARAM_FAULT_STATUS = 8,
+    PARAM_MAIN_VALUES = 9,   // Tension, courant et SOC (0x38~0x3A)
+    PARAM_MOSFET_STATES = 10, // MOSFET charge et décharge (0x52~0x53)
+    PARAM_CELL_COUNT = 11,    // Heartbeat, nombre de cellules et de capteurs (0x3B~0x3D)
+    PARAM_HEARTBEAT = 12      // Compteur de vie (0x3B)
+};
+
+// État de liaison d'une batterie
+enum BatteryLinkState
+{
+    LINK_ONLINE = 0,  // Répond normalement
+    LINK_SUSPECT = 1, // Échecs récents, toujours interrogée
+    LINK_OFFLINE = 2  // Retirée du polling, re-sondée avec backoff
+};
+
+// Niveaux du planificateur de polling (par ordre de priorité)
+enum PollTier
+{
+    TIER_FAST = 0,
+    TIER_CELLS = 1,
+    TIER_TEMPERATURES = 2,
+    TIER_FAULTS = 3,
+    TIER_COUNT = 4
 };
 
 // ——————— STRUCTURES ———————
+// Valeurs rangées dans l'unité des registres (entiers 16 bits) : ~150 octets
+// par batterie au lieu de ~280 en float. Les accesseurs plus bas rendent les
+// unités physiques.
+#define BATTERY_MAX_CELLS 48 // 0x00~0x2F
+#define BATTERY_MAX_TEMPS 8  // 0x30~0x37
+
+// BatteryData::flags
+#define BATTERY_FLAG_DATA_VALID 0x01
+#define BATTERY_FLAG_CHARGE_MOSFET 0x02
+#define BATTERY_FLAG_DISCHARGE_MOSFET 0x04
+
 struct BatteryData
 {
     uint8_t batteryId;
-    bool dataValid;
+    uint8_t flags; // BATTERY_FLAG_*
+    uint8_t cellCount;
+    uint8_t tempSensorCount;
     unsigned long lastUpdate;
 
     // Données principales
-    float soc;          // %
-    float totalVoltage; // V
-    float current;      // A (+ = décharge, - = charge)
-    uint8_t cellCount;
+    uint16_t socRaw;   // Brut du registre 0x3A (x 0.001)
+    uint16_t voltageDv; // 0.1 V
+    int16_t currentDa; // 0.1 A (+ = décharge, - = charge)
+    uint16_t heartbeat;
+    int16_t mosTempDc; // 0.1 °C
+
+    // États de défaut
+    uint16_t faultStatus1;
+    uint16_t faultStatus2;
+    uint16_t faultStatus3;
+
+    // Masques de validité : bit i = cellule / capteur i valide
+    uint8_t validCells;
+    uint8_t validTemps;
+    uint8_t cellValidMask[(BATTERY_MAX_CELLS + 7) / 8];
+    uint8_t tempValidMask;
+
+    int16_t temperaturesDc[BATTERY_MAX_TEMPS]; // 0.1 °C, 0 = capteur absent
+#if !BATTERY_CELLS_SOA
+    uint16_t cellVoltagesMv[BATTERY_MAX_CELLS]; // mV, 0 = cellule absente
+#endif
+};
+
+// Familles de BMS : adresses de requête et de réponse dérivées de l'ID
+enum BmsFamily
+{
+    BMS_FAMILY_DEFAULT = 0, // Requête 0x80 + ID, réponse 0x50 + ID
+    BMS_FAMILY_MODBUS = 1,  // Modbus RTU standard : adresse = ID
+    BMS_FAMILY_COUNT = 2
+};
+
+struct BmsAddressScheme
+{
+    const char *name;
+    uint8_t requestBase;  // Adresse de requête = requestBase + ID
+    uint8_t responseBase; // Adresse attendue en réponse = responseBase + ID
+    uint8_t maxId;        // Plage d'ID balayée par la découverte (1..maxId)
+};
+
+// Transaction Modbus en cours (une seule à la fois par bus)
+struct ModbusTransaction
+{
+    ModbusTransactionState state;
+    uint8_t batteryId;
+    uint8_t responseAddr; // Adresse attendue en réponse (famille du bus)
+    bool background; // Lancée par le polling de loop() (true) ou par un appel bloquant
+    bool probe;      // Sonde de redécouverte d'une batterie hors ligne
+    bool scan;       // Sonde de découverte d'un ID sans emplacement
+    bool command;    // Transaction de la commande MOSFET groupée
+    uint8_t commandSeq; // Commande à laquelle elle appartient
+
+    // Émission
+    uint8_t requestLength;
+    unsigned long txStartUs;
+    unsigned long txDurationUs;
+
+    // Réception
+    int responseLength;
+    int maxResponseLength;
+    unsigned long awaitStart; // ms, début de l'attente de réponse
+    unsigned long lastByteUs; // µs, dernier octet reçu
+    uint16_t responseTimeoutMs;
+    uint16_t interByteTimeoutMs;
+    int expectedLength;       // Longueur déduite de l'en-tête (0 = inconnue)
+    uint16_t rxCrc;           // CRC cumulé des octets reçus (0 = trame intègre)
+    unsigned long t35Us;      // Silence inter-trame T3.5
+
+    // Fenêtre de registres demandée (pour le décodage)
+    uint16_t startAddr;
+    uint16_t regCount;
+
+    // Relecture partielle
+    uint8_t attempt;    // 0 = lecture normale, sinon n° de relecture
+    uint16_t blockRegs; // Taille de la lecture d'origine
+};
+
+// Plage de registres temps réel à relire (manquante ou invalide)
+struct ModbusRetry
+{
+    uint8_t batteryId;
+    uint8_t attempt;
+    uint16_t startAddr;
+    uint16_t regCount;
+    uint16_t blockRegs; // Lecture d'origine : coût d'une relecture complète
+};
+
+// Réglages d'une batterie (registres bruts), persistés en NVS
+struct BatterySettings
+{
+    uint16_t regs[SETTINGS_REG_COUNT]; // Indexé par (adresse - ADDR_SETTING1_START)
+    uint8_t blockMask;                 // Blocs lus depuis la dernière invalidation
+    bool valid;                        // Jeu complet disponible (lu ou restauré)
+    bool restored;                     // Restauré depuis la flash, pas encore relu
+    bool refreshNeeded;                // À relire (identité / heartbeat suspects)
+    uint32_t hash;                     // FNV-1a des registres
+    uint8_t cellCount;                 // Identité au moment de la lecture
     uint8_t tempSensorCount;
+};
 
-    // États MOSFET
-    bool chargeMosfet;
-    bool dischargeMosfet;
+// Suivi de la liaison avec une batterie
+struct BatteryLink
+{
+    BatteryLinkState state;
+    uint8_t consecutiveFailures;
+    unsigned long backoffMs;
+    unsigned long nextProbe;
+    unsigned long lastSeen;
+    uint32_t probesSent;
+    uint32_t skippedTransactions; // Transactions évitées car hors ligne
+};
 
-    // Températures
-    float mosTemp;     // °C
-    float ambientTemp; // °C
+// Un niveau de polling : un groupe de paramètres relu à sa propre période
+struct PollTierState
+{
+    const char *name;
+    BatteryParam params[MODBUS_MAX_TIER_PARAMS];
+    uint8_t paramCount;
+    unsigned long periodMs;
 
-    // Tensions cellules (max 48 selon 0x00~0x2F)
-    float cellVoltages[48];
-    uint8_t validCells;
+    // Balayage en cours
+    bool sweeping;
+    uint8_t nextBattery;
+    uint8_t nextParam;
+    unsigned long sweepStart;
+    bool yieldTurn; // Céder une transaction aux niveaux inférieurs
 
-    // Températures capteurs (max 8 selon 0x30~0x37)
-    float temperatures[8];
-    uint8_t validTemps;
+    // Mesures
+    unsigned long lastSweepStart;
+    unsigned long lastSweepDurationMs;
+    unsigned long achievedIntervalMs; // Intervalle réel entre deux rafraîchissements
+    uint32_t sweepCount;
+};
 
-    // États de défaut
-    uint16_t faultStatus1;
-    uint16_t faultStatus2;
-    uint16_t faultStatus3;
+// Compteurs d'échanges, par batterie et par bus
+struct ModbusStats
+{
+    uint32_t requests;
+    uint32_t responses;      // Réponses intègres (adresse, fonction, CRC)
+    uint32_t timeouts;
+    uint32_t truncated;      // Réponse interrompue
+    uint32_t crcErrors;
+    uint32_t addressErrors;  // Adresse différente de celle attendue pour l'ID
+    uint32_t functionErrors; // Fonction différente de la requête
+    uint32_t exceptions;     // Réponse d'exception (fonction | 0x80)
+    uint32_t lengthErrors;   // Nombre d'octets différent de la demande
+    uint32_t latencyHist[MODBUS_LATENCY_BUCKETS];
+    uint32_t latencyTotalMs;
+    uint32_t latencyMaxUs;
+
+    // Batteries : intervalle réel entre deux mises à jour des valeurs principales
+    unsigned long lastRefresh;
+    unsigned long refreshIntervalMs;
+    unsigned long refreshIntervalMaxMs;
+
+    // Bus : relectures partielles (octets requête + réponse)
+    uint32_t retries;
+    uint32_t retryBytes;
+    uint32_t wholeBlockBytes; // Coût des mêmes relectures en blocs complets
+    uint32_t retryAbandoned;
+};
+
+// Diffusion de la commande MOSFET groupée
+enum MosfetDispatchMode
+{
+    MOSFET_DISPATCH_PIPELINED = 0, // Une écriture 0x10 acquittée par batterie
+    MOSFET_DISPATCH_BROADCAST = 1  // Une écriture par bus, confirmation par relecture (MODBUS_MOSFET_BROADCAST)
+};
+
+// Commande MOSFET groupée (charge + décharge) vers toutes les batteries joignables
+struct BankMosfetCommand
+{
+    bool active;
+    bool charge;
+    bool discharge;
+    MosfetDispatchMode mode;
+    uint8_t seq;
+    unsigned long startUs;
+    bool broadcastPending[MODBUS_BUS_COUNT];
+    uint8_t attempts[MAX_BATTERIES]; // Par emplacement
+
+    // Résultat (masques : bit i = emplacement i)
+    uint32_t targetMask;
+    uint32_t pendingMask;
+    uint32_t confirmedMask;
+    uint32_t failedMask;
+    unsigned long lastDurationUs;  // Commande → toutes confirmées (ou abandon)
+    unsigned long worstDurationUs; // Pire cas observé
+    uint32_t commandCount;
+};
+
+// Un bus RS485 : UART, pilotage DE/RE, buffers, transaction en cours et
+// planificateur propres. Chaque bus ne balaie que les batteries qui lui
+// sont affectées (batteryBusMap).
+struct ModbusBus
+{
+    uint8_t index;
+    HardwareSerial *serial; // nullptr = bus non initialisé
+    int8_t deRePin;
+    unsigned long baud;
+    bool baudStored;           // Vitesse lue en NVS (sinon à négocier)
+    uint8_t consecutiveErrors; // Timeouts / CRC d'affilée (repli de vitesse)
+    bool baudFallbackPending;  // Repli à appliquer dès que le bus est libre
+    ModbusStats stats;
+    uint8_t sendBuffer[256];
+    uint8_t rxBuffers[MODBUS_RX_BUFFERS][MODBUS_RX_BUFFER_SIZE];
+    uint8_t rxIndex;
+    uint8_t *receiveBuffer; // Buffer de la transaction en cours
+    ModbusTransaction transaction;
+
+    // Trame de polling terminée, décodée pendant la transaction suivante
+    ModbusTransaction completed;
+    uint8_t *completedBuffer; // nullptr = rien à décoder
+    PollTierState tiers[TIER_COUNT];
+    unsigned long lastTransactionEnd;
+
+    // Registres à relire, servis avant les niveaux de polling
+    ModbusRetry retries[MODBUS_RETRY_SLOTS];
+    uint8_t retryCount;
+
+    // Découverte : famille de BMS et prochain ID à sonder
+    uint8_t family; // BmsFamily
+    uint8_t scanNextId;
+    unsigned long nextScanPass;
+    uint32_t scanProbes;
+    uint32_t scanPasses;
+};
+
+// Description d'un registre (ou d'un tableau de registres) temps réel,
+// rangé dans BatteryData à fieldOffset
+enum RegisterFieldType
+{
+    FIELD_I16 = 0,  // int16 = (brut + offset) * scale, en entiers
+    FIELD_U8 = 1,   // Octet bas
+    FIELD_U16 = 2,  // Brut 16 bits
+    FIELD_FLAG = 3  // Bit 0 du brut -> bit flagMask de BatteryData::flags
+};
+
+#define REG_FLAG_SIGNED 0x01       // Brut interprété en int16
+#define REG_FLAG_ZERO_INVALID 0x02 // 0 = capteur/cellule absent
+#define REG_NO_FIELD 0xFFFF
+#define REG_CELL_STORE 0xFFFE // Tableau commun batteryCellVoltagesMv (BATTERY_CELLS_SOA)
+
+struct RegisterDescriptor
+{
+    uint16_t address;         // Premier registre
+    uint8_t count;            // Registres consécutifs (tableau si > 1)
+    uint8_t type;             // RegisterFieldType
+    uint8_t flags;            // REG_FLAG_*
+    int16_t scale;
+    int16_t offset;
+    uint16_t fieldOffset;     // offsetof(BatteryData, champ)
+    uint16_t validMaskOffset; // Masque de validité (tableaux), ou REG_NO_FIELD
+    uint16_t validCountOffset; // Compteur d'éléments valides, ou REG_NO_FIELD
+    uint16_t params;          // Masque des BatteryParam qui couvrent ce registre
+    uint8_t flagMask;         // FIELD_FLAG : bit BATTERY_FLAG_* à recopier
 };
 
 // ——————— VARIABLES GLOBALES ———————
-extern HardwareSerial *modbusSerial;
-extern uint8_t sendBuffer[256];
-extern uint8_t receiveBuffer[256];
+extern ModbusBus modbusBuses[MODBUS_BUS_COUNT];
+// Tableaux par emplacement : batterySlotIds[slot] = ID, getBatterySlot(ID) = slot
+extern uint8_t batteryCount; // Emplacements occupés
+extern uint8_t batterySlotIds[MAX_BATTERIES];
+extern uint8_t batteryBusMap[MAX_BATTERIES]; // Index de bus par emplacement
 extern BatteryData batteries[MAX_BATTERIES];
+#if BATTERY_CELLS_SOA
+// Tensions cellules de toutes les batteries, contiguës (par emplacement)
+extern uint16_t batteryCellVoltagesMv[MAX_BATTERIES][BATTERY_MAX_CELLS];
+#endif
+extern BatteryLink batteryLinks[MAX_BATTERIES];
+extern BatterySettings batterySettings[MAX_BATTERIES];
+extern ModbusStats batteryStats[MAX_BATTERIES];
 
 // ——————— FONCTIONS PUBLIQUES ———————
 
 // Initialisation
 void initModbus(HardwareSerial *serial);
-void enableRS485Transmit();
-void enableRS485Receive();
+void initModbusBus(uint8_t busIndex, HardwareSerial *serial, int8_t rxPin, int8_t txPin, int8_t deRePin);
+void enableRS485Transmit(ModbusBus &bus);
+void enableRS485Receive(ModbusBus &bus);
+
+// Vitesse de liaison (par bus, persistée)
+unsigned long getModbusBaud(uint8_t busIndex);
+bool setModbusBaud(uint8_t busIndex, unsigned long baud, bool persist);
+unsigned long negotiateModbusBaud(uint8_t busIndex);
+void negotiateUnsetModbusBauds();
+
+// Registre des batteries découvertes (persisté en NVS)
+int8_t getBatterySlot(uint8_t batteryId); // -1 = ID inconnu
+int8_t registerBattery(uint8_t batteryId, uint8_t busIndex);
+void resetBatteryRegistry();
+void setBusBmsFamily(uint8_t busIndex, BmsFamily family);
+uint8_t getBatteryRequestAddress(uint8_t batteryId);
+uint8_t getBatteryResponseAddress(uint8_t batteryId);
+
+// Affectation des batteries aux bus
+ModbusBus *getBatteryBus(uint8_t batteryId);
+void setBatteryBus(uint8_t batteryId, uint8_t busIndex);
+
+// Moteur de transactions non bloquant (une transaction par bus)
+bool startModbusTransaction(ModbusBus &bus, uint8_t batteryId, int frameLength, uint16_t responseTimeoutMs,
+                            uint16_t interByteTimeoutMs, int maxResponseLength);
+bool startReadTransaction(uint8_t batteryId, uint16_t startAddr, uint16_t regCount,
+                          uint16_t responseTimeoutMs);
+void pollModbusBus(ModbusBus &bus);
+void pollModbus(); // Tous les bus
+ModbusTransactionState runModbusTransaction(ModbusBus &bus);
+void releaseModbusTransaction(ModbusBus &bus);
+void waitModbusIdle(ModbusBus &bus);
+ModbusTransactionState getModbusState(const ModbusBus &bus);
+int expectedFrameLength(const uint8_t *frame, int length, uint16_t requestedRegs);
+unsigned long modbusT35Us(unsigned long baud);
+bool isModbusIdle(const ModbusBus &bus);
+
+// Polling non bloquant (à appeler dans loop)
+void updateModbusPolling();
+void setModbusPollingEnabled(bool enabled);
+void setPollTierPeriod(PollTier tier, unsigned long periodMs);
+const PollTierState *getPollTierState(uint8_t busIndex, PollTier tier);
+unsigned long getPollTierWireTimeUs(uint8_t busIndex, PollTier tier);
+void printPollingStats();
+
+// Suivi de liaison
+void recordBatteryResult(uint8_t batteryId, bool success);
+void expireStaleBatteryData();
+BatteryLinkState getBatteryLinkState(uint8_t batteryId);
+uint8_t getOnlineBatteryCount();
+unsigned long getLinkTimeSavedMs();
+
+// Statistiques d'échanges
+const ModbusStats *getBatteryStats(uint8_t batteryId);
+const ModbusStats *getBusStats(uint8_t busIndex);
+uint16_t getLatencyBucketLimitMs(uint8_t bucket); // 0xFFFF pour le dernier
+uint16_t getLatencyPercentileMs(const ModbusStats &stats, uint8_t percent);
+uint32_t getStatsErrorCount(const ModbusStats &stats);
+void resetModbusStats();
+void printModbusStats();
+
+// Cache des réglages (SETTING1/2/3)
+void restoreBatterySettings();
+void requestSettingsRefresh(uint8_t batteryId);
+const BatterySettings *getBatterySettings(uint8_t batteryId);
+bool getBatterySettingRegister(uint8_t batteryId, uint16_t regAddr, uint16_t *value);
+uint32_t hashBatterySettings(const uint16_t *regs, uint16_t count);
 
 // Fonctions de lecture modulaires
 bool readBatteryData(uint8_t batteryId, ModbusDataType dataType = DATA_REALTIME);
 bool readBatteryParam(uint8_t batteryId, BatteryParam param);
+bool getBatteryParamRange(BatteryParam param, uint16_t *startAddr, uint16_t *regCount);
 bool readAllBatteriesData(ModbusDataType dataType = DATA_REALTIME);
 
 // Fonctions d'écriture avec validation
@@ -139,6 +538,12 @@ bool waitForAck(uint8_t batteryId, const char *operation);
 // Contrôles MOSFET
 bool setChargeMosfet(uint8_t batteryId, bool enable);
 bool setDischargeMosfet(uint8_t batteryId, bool enable);
+bool setBatteryMosfets(uint8_t batteryId, bool charge, bool discharge);
+
+// Commande MOSFET groupée, non bloquante (acquittements collectés par updateModbusPolling)
+bool setBankMosfets(bool charge, bool discharge, MosfetDispatchMode mode = MOSFET_DISPATCH_PIPELINED);
+bool isBankMosfetCommandPending();
+const BankMosfetCommand *getBankMosfetCommand();
 
 // Accès aux données
 BatteryData *getBatteryData(uint8_t batteryId);
@@ -147,15 +552,82 @@ float getBatteryVoltage(uint8_t batteryId);
 float getBatteryCurrent(uint8_t batteryId);
 bool isBatteryDataValid(uint8_t batteryId);
 
+// Accesseurs sur le stockage compact (unités physiques)
+inline bool getBatteryFlag(const BatteryData &battery, uint8_t flag)
+{
+    return (battery.flags & flag) != 0;
+}
+
+inline void setBatteryFlag(BatteryData &battery, uint8_t flag, bool value)
+{
+    if (value)
+        battery.flags |= flag;
+    else
+        battery.flags &= ~flag;
+}
+
+inline bool isBatteryDataValid(const BatteryData &battery)
+{
+    return getBatteryFlag(battery, BATTERY_FLAG_DATA_VALID);
+}
+
+inline float getBatterySOC(const BatteryData &battery) { return battery.socRaw * 0.001f; }
+inline float getBatteryVoltage(const BatteryData &battery) { return battery.voltageDv * 0.1f; }
+inline float getBatteryCurrent(const BatteryData &battery) { return battery.currentDa * 0.1f; }
+inline float getBatteryMosTemp(const BatteryData &battery) { return battery.mosTempDc * 0.1f; }
+
+inline float getBatteryTemperature(const BatteryData &battery, uint8_t sensor)
+{
+    return battery.temperaturesDc[sensor] * 0.1f; // °C
+}
+
+// Tensions cellules en mV (BatteryData ou tableau commun selon BATTERY_CELLS_SOA)
+inline uint16_t *getBatteryCellsMv(BatteryData &battery)
+{
+#if BATTERY_CELLS_SOA
+    return batteryCellVoltagesMv[&battery - batteries];
+#else
+    return battery.cellVoltagesMv;
+#endif
+}
+
+inline const uint16_t *getBatteryCellsMv(const BatteryData &battery)
+{
+    return getBatteryCellsMv(const_cast<BatteryData &>(battery));
+}
+
+inline float getCellVoltage(const BatteryData &battery, uint8_t cell)
+{
+    return getBatteryCellsMv(battery)[cell]; // mV
+}
+
+// CRC16 Modbus (polynôme 0xA001 réfléchi, init 0xFFFF)
+extern const uint16_t CRC16_TABLE[256];
+
+// Intègre un octet au CRC courant (réception octet par octet)
+inline uint16_t crc16Update(uint16_t crc, uint8_t data)
+{
+    return (crc >> 8) ^ CRC16_TABLE[(crc ^ data) & 0xFF];
+}
+
+uint16_t calculateCRC16(const uint8_t *data, uint16_t length);
+uint16_t calculateCRC16Bitwise(const uint8_t *data, uint16_t length);
+uint16_t calculateCRC16Slice4(const uint8_t *data, uint16_t length);
+void benchmarkCRC16();
+
 // Fonctions utilitaires
-uint16_t calculateCRC16(uint8_t *data, uint8_t length);
-int buildReadCommand(uint8_t batteryId, uint16_t startAddr, uint16_t regCount);
-int buildWriteCommand(uint8_t batteryId, uint16_t regAddr, uint16_t value);
-bool parseResponse(uint8_t batteryId, ModbusDataType dataType);
+int buildReadCommand(uint8_t *frame, uint8_t address, uint16_t startAddr, uint16_t regCount);
+int buildWriteCommand(uint8_t *frame, uint8_t address, uint16_t regAddr, uint16_t value);
+int buildMosfetCommand(uint8_t *frame, uint8_t address, bool charge, bool discharge);
+bool parseResponse(uint8_t batteryId, ModbusDataType dataType, uint16_t startAddr = 0);
+bool parseFrame(uint8_t batteryId, ModbusDataType dataType, uint16_t startAddr,
+                const uint8_t *frame, const ModbusTransaction &tx);
+void parseSettingsData(uint8_t batteryId, ModbusDataType dataType, const uint8_t *data, uint16_t length);
 void printModbusBuffer(const char *label, uint8_t *buffer, int length);
 void printBatteryData(uint8_t batteryId);
 
 // Déclaration de la fonction de parsing
-void parseRealtimeData(BatteryData *battery, uint8_t *data, uint8_t length);
+void parseRealtimeData(BatteryData *battery, const uint8_t *data, uint16_t length, uint16_t startAddr = 0);
+int decodeRegisters(BatteryData *battery, const uint8_t *data, uint16_t length, uint16_t startAddr);
 
 #endif
\ No newline at end of file
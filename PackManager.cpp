@@ -0,0 +1,268 @@
+#include "PackManager.h"
+#include "ModbusManager.h"
+
+// ——————— VARIABLES ———————
+
+// Dernière contribution de chaque emplacement aux totaux
+struct PackContribution
+{
+    bool active; // Comptée dans les sommes et les extrema
+    int16_t currentDa;
+    uint16_t socRaw;
+    uint16_t voltageDv;
+    uint8_t extremumMask; // Bit i = valeur PackExtremum i disponible
+    int32_t extremum[PACK_EXTREMA];
+    CellStatsAccumulator cells; // Dernier bloc cellules lu
+};
+
+// +1 : minimum, -1 : maximum
+static const int8_t EXTREMUM_SIGN[PACK_EXTREMA] = {1, 1, -1, 1, -1};
+
+static PackContribution contributions[MAX_BATTERIES];
+static int32_t currentSum;
+static int32_t socSum;
+static int32_t voltageSum;
+static uint8_t activeCount;
+static uint32_t cellCount;
+static uint32_t cellSum;
+static uint64_t cellSquares;
+static int8_t extremumSlot[PACK_EXTREMA] = {-1, -1, -1, -1, -1};
+static int32_t extremumValue[PACK_EXTREMA];
+static PackSnapshot snapshot;
+
+// Statistiques : reparcours des contributions (détenteur d'un extremum dégradé)
+static uint32_t extremumRescans;
+
+// ——————— EXTREMA ———————
+
+static bool beats(uint8_t kind, int32_t a, int32_t b)
+{
+    return EXTREMUM_SIGN[kind] > 0 ? a < b : a > b;
+}
+
+static bool contributes(const PackContribution &c, uint8_t kind)
+{
+    return c.active && (c.extremumMask & (1 << kind));
+}
+
+static void rescanExtremum(uint8_t kind)
+{
+    // Parcours des résumés par batterie (pas des cellules)
+    extremumSlot[kind] = -1;
+    for (uint8_t slot = 0; slot < batteryCount; slot++)
+    {
+        const PackContribution &c = contributions[slot];
+        if (contributes(c, kind) &&
+            (extremumSlot[kind] < 0 || beats(kind, c.extremum[kind], extremumValue[kind])))
+        {
+            extremumSlot[kind] = slot;
+            extremumValue[kind] = c.extremum[kind];
+        }
+    }
+    extremumRescans++;
+}
+
+static void updateExtremum(uint8_t kind, uint8_t slot)
+{
+    const PackContribution &c = contributions[slot];
+    bool has = contributes(c, kind);
+
+    if (extremumSlot[kind] == slot)
+    {
+        // Détenteur : il reste en tête s'il ne s'est pas dégradé
+        if (has && !beats(kind, extremumValue[kind], c.extremum[kind]))
+            extremumValue[kind] = c.extremum[kind];
+        else
+            rescanExtremum(kind);
+    }
+    else if (has && (extremumSlot[kind] < 0 || beats(kind, c.extremum[kind], extremumValue[kind])))
+    {
+        extremumSlot[kind] = slot;
+        extremumValue[kind] = c.extremum[kind];
+    }
+}
+
+// ——————— RÉSUMÉ D'UNE BATTERIE ———————
+
+static void summarizeCells(PackContribution &c, const BatteryData &battery)
+{
+    // Cellule absente = 0 (REG_FLAG_ZERO_INVALID) : ignorée par le noyau
+    resetCellStats(c.cells);
+    accumulateCellStats(c.cells, getBatteryCellsMv(battery), BATTERY_MAX_CELLS);
+
+    c.extremumMask &= ~((1 << PACK_CELL_MIN) | (1 << PACK_CELL_MAX));
+    if (c.cells.count)
+    {
+        c.extremum[PACK_CELL_MIN] = c.cells.minMv;
+        c.extremum[PACK_CELL_MAX] = c.cells.maxMv;
+        c.extremumMask |= (1 << PACK_CELL_MIN) | (1 << PACK_CELL_MAX);
+    }
+}
+
+static void summarizeTemps(PackContribution &c, const BatteryData &battery)
+{
+    int16_t minDc = INT16_MAX, maxDc = INT16_MIN;
+    for (uint8_t i = 0; i < BATTERY_MAX_TEMPS; i++)
+    {
+        if (!(battery.tempValidMask & (1 << i)))
+            continue;
+        minDc = min(minDc, battery.temperaturesDc[i]);
+        maxDc = max(maxDc, battery.temperaturesDc[i]);
+    }
+
+    c.extremumMask &= ~((1 << PACK_TEMP_MIN) | (1 << PACK_TEMP_MAX));
+    if (battery.validTemps)
+    {
+        c.extremum[PACK_TEMP_MIN] = minDc;
+        c.extremum[PACK_TEMP_MAX] = maxDc;
+        c.extremumMask |= (1 << PACK_TEMP_MIN) | (1 << PACK_TEMP_MAX);
+    }
+}
+
+// ——————— PUBLICATION ———————
+
+static void publishSnapshot()
+{
+    PackSnapshot next;
+    next.onlineCount = activeCount;
+    next.currentDa = currentSum;
+    next.voltageDv = activeCount ? (voltageSum + activeCount / 2) / activeCount : 0;
+    next.socAvgRaw = activeCount ? (socSum + activeCount / 2) / activeCount : 0;
+    for (uint8_t kind = 0; kind < PACK_EXTREMA; kind++)
+    {
+        bool has = extremumSlot[kind] >= 0;
+        next.extremum[kind] = has ? extremumValue[kind] : 0;
+        next.extremumId[kind] = has ? batterySlotIds[extremumSlot[kind]] : 0;
+    }
+
+    // Min/max des extrema (détenteurs suivis), sommes cumulées pour moyenne et écart-type
+    CellStatsAccumulator cells;
+    cells.count = cellCount;
+    cells.minMv = extremumSlot[PACK_CELL_MIN] >= 0 ? extremumValue[PACK_CELL_MIN] : 0xFFFF;
+    cells.maxMv = extremumSlot[PACK_CELL_MAX] >= 0 ? extremumValue[PACK_CELL_MAX] : 0;
+    cells.sumMv = cellSum;
+    cells.sumSquares = cellSquares;
+    next.cells = finishCellStats(cells);
+
+    next.seq = snapshot.seq + 1;
+    next.lastUpdate = millis();
+    snapshot = next;
+}
+
+// ——————— FONCTIONS PUBLIQUES ———————
+
+void updatePackBattery(uint8_t slot, bool cellsChanged, bool tempsChanged)
+{
+    if (slot >= batteryCount)
+        return;
+
+    const BatteryData &battery = batteries[slot];
+    PackContribution &c = contributions[slot];
+
+    // Retirer l'ancienne contribution, ajouter la nouvelle
+    if (c.active)
+    {
+        currentSum -= c.currentDa;
+        socSum -= c.socRaw;
+        voltageSum -= c.voltageDv;
+        activeCount--;
+        cellCount -= c.cells.count;
+        cellSum -= c.cells.sumMv;
+        cellSquares -= c.cells.sumSquares;
+    }
+
+    c.active = isBatteryDataValid(battery);
+    c.currentDa = battery.currentDa;
+    c.socRaw = battery.socRaw;
+    c.voltageDv = battery.voltageDv;
+    c.extremum[PACK_SOC_MIN] = battery.socRaw;
+    c.extremumMask |= 1 << PACK_SOC_MIN;
+    if (cellsChanged)
+        summarizeCells(c, battery);
+    if (tempsChanged)
+        summarizeTemps(c, battery);
+
+    if (c.active)
+    {
+        currentSum += c.currentDa;
+        socSum += c.socRaw;
+        voltageSum += c.voltageDv;
+        activeCount++;
+        cellCount += c.cells.count;
+        cellSum += c.cells.sumMv;
+        cellSquares += c.cells.sumSquares;
+    }
+
+    for (uint8_t kind = 0; kind < PACK_EXTREMA; kind++)
+    {
+        updateExtremum(kind, slot);
+    }
+    publishSnapshot();
+}
+
+void resetPack()
+{
+    // Emplacements réattribués : repartir de totaux vides
+    memset(contributions, 0, sizeof(contributions));
+    currentSum = socSum = voltageSum = 0;
+    activeCount = 0;
+    cellCount = cellSum = 0;
+    cellSquares = 0;
+    for (uint8_t kind = 0; kind < PACK_EXTREMA; kind++)
+    {
+        extremumSlot[kind] = -1;
+    }
+    publishSnapshot();
+}
+
+const PackSnapshot &getPackSnapshot()
+{
+    return snapshot;
+}
+
+bool getPackBatteryExtrema(uint8_t slot, int32_t extremum[PACK_EXTREMA], uint8_t &mask)
+{
+    // Résumé déjà tenu pour les extrema du pack (pas de reparcours des cellules)
+    if (slot >= batteryCount || !contributions[slot].active)
+        return false;
+    memcpy(extremum, contributions[slot].extremum, sizeof(contributions[slot].extremum));
+    mask = contributions[slot].extremumMask;
+    return true;
+}
+
+float getPackSocPercent()
+{
+    return snapshot.socAvgRaw * 0.1f;
+}
+
+float getPackVoltage()
+{
+    return snapshot.voltageDv * 0.1f;
+}
+
+float getPackCurrent()
+{
+    return snapshot.currentDa * 0.1f;
+}
+
+void printPackSnapshot()
+{
+    const PackSnapshot &pack = snapshot;
+    Serial.println("\n=== PACK ===");
+    Serial.printf("Batteries comptées: %d/%d\n", pack.onlineCount, batteryCount);
+    Serial.printf("SOC moyen: %.1f%%, min: %.1f%% (ID=%d)\n", getPackSocPercent(),
+                  pack.extremum[PACK_SOC_MIN] * 0.1f, pack.extremumId[PACK_SOC_MIN]);
+    Serial.printf("Tension: %.1fV, courant total: %.1fA\n", getPackVoltage(), getPackCurrent());
+    Serial.printf("Cellules: min %ldmV (ID=%d), max %ldmV (ID=%d)\n",
+                  (long)pack.extremum[PACK_CELL_MIN], pack.extremumId[PACK_CELL_MIN],
+                  (long)pack.extremum[PACK_CELL_MAX], pack.extremumId[PACK_CELL_MAX]);
+    Serial.printf("Cellules: %lu, moyenne %.1fmV, écart-type %.2fmV, écart %umV\n",
+                  (unsigned long)pack.cells.count, pack.cells.meanMv, pack.cells.stddevMv,
+                  pack.cells.imbalanceMv);
+    Serial.printf("Températures: min %.1f°C (ID=%d), max %.1f°C (ID=%d)\n",
+                  pack.extremum[PACK_TEMP_MIN] * 0.1f, pack.extremumId[PACK_TEMP_MIN],
+                  pack.extremum[PACK_TEMP_MAX] * 0.1f, pack.extremumId[PACK_TEMP_MAX]);
+    Serial.printf("Publications: %lu, reparcours d'extremum: %lu\n",
+                  (unsigned long)pack.seq, (unsigned long)extremumRescans);
+    Serial.println("============");
+}
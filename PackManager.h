@@ -0,0 +1,60 @@
+#ifndef PACK_MANAGER_H
+#define PACK_MANAGER_H
+
+#include <Arduino.h>
+#include "Config.h"
+#include "CellStats.h"
+
+// ——————— AGRÉGATION DU PACK ———————
+// Totaux du parc de batteries (en parallèle), mis à jour à chaque trame
+// temps réel décodée pour la seule batterie concernée : retrait de son
+// ancienne contribution, ajout de la nouvelle. Les cellules ne sont
+// parcourues que pour cette batterie, et seulement quand son bloc cellules
+// a été relu. Le CAN et l'écran lisent l'instantané publié, en O(1).
+
+// Extrema suivis, avec l'ID de la batterie qui les détient
+enum PackExtremum
+{
+    PACK_SOC_MIN = 0,
+    PACK_CELL_MIN = 1,
+    PACK_CELL_MAX = 2,
+    PACK_TEMP_MIN = 3,
+    PACK_TEMP_MAX = 4,
+    PACK_EXTREMA = 5
+};
+
+// Instantané cohérent (copié en une fois après chaque mise à jour).
+// Unités des registres, comme BatteryData.
+struct PackSnapshot
+{
+    uint8_t onlineCount; // Batteries aux données valides (comptées)
+    int32_t currentDa;   // Somme des courants, 0.1 A (+ = décharge)
+    uint16_t voltageDv;  // Moyenne des tensions batterie, 0.1 V
+    uint16_t socAvgRaw;  // Moyenne des SOC bruts (1000 = 100 %)
+
+    // Extrema : valeur et ID de la batterie (0 = aucune valeur)
+    int32_t extremum[PACK_EXTREMA]; // SOC brut, mV, 0.1 °C selon l'index
+    uint8_t extremumId[PACK_EXTREMA];
+
+    // Cellules des batteries comptées (sommes entières cumulées par batterie)
+    CellStats cells;
+
+    uint32_t seq; // Incrémenté à chaque publication
+    unsigned long lastUpdate;
+};
+
+// ——————— FONCTIONS PUBLIQUES ———————
+
+// Mise à jour (appelée par ModbusManager, emplacement de la batterie)
+void updatePackBattery(uint8_t slot, bool cellsChanged, bool tempsChanged);
+void resetPack();
+
+// Lecture
+const PackSnapshot &getPackSnapshot();
+bool getPackBatteryExtrema(uint8_t slot, int32_t extremum[PACK_EXTREMA], uint8_t &mask); // false : non comptée
+float getPackSocPercent();
+float getPackVoltage();
+float getPackCurrent();
+void printPackSnapshot();
+
+#endif
@@ -0,0 +1,76 @@
+#include "TraceManager.h"
+
+// ——————— RING DE TRACE ———————
+// Remplace l'affichage hexadécimal des trames : une entrée binaire de taille
+// fixe par trame, écrasant les plus anciennes. Le contenu n'est imprimé que
+// sur demande (commande série "trace").
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "TRACE_RING_SIZE doit être une puissance de 2");
+static_assert(sizeof(TraceEntry) == 12 + TRACE_PAYLOAD_BYTES, "Format d'entrée attendu par trace_decode.py");
+
+static TraceEntry traceRing[TRACE_RING_SIZE];
+static uint32_t traceCount = 0;
+static bool traceEnabled = true;
+
+void traceRecord(TraceDirection direction, uint8_t bus, uint8_t batteryId, uint16_t id,
+                 const uint8_t *data, uint16_t length, TraceResult result)
+{
+    if (!traceEnabled)
+        return;
+
+    TraceEntry &entry = traceRing[traceCount++ & (TRACE_RING_SIZE - 1)];
+    entry.timestampUs = micros();
+    entry.id = id;
+    entry.length = length;
+    entry.direction = direction;
+    entry.bus = bus;
+    entry.batteryId = batteryId;
+    entry.result = result;
+
+    uint16_t kept = min(length, (uint16_t)TRACE_PAYLOAD_BYTES);
+    memcpy(entry.payload, data, kept);
+    memset(entry.payload + kept, 0, TRACE_PAYLOAD_BYTES - kept);
+}
+
+void setTraceEnabled(bool enabled)
+{
+    traceEnabled = enabled;
+}
+
+void clearTrace()
+{
+    traceCount = 0;
+}
+
+uint32_t getTraceCount()
+{
+    return traceCount;
+}
+
+void dumpTrace(Print &out)
+{
+    // En-tête : version, taille d'entrée, nombre d'entrées, horloge actuelle
+    uint32_t available = min(traceCount, (uint32_t)TRACE_RING_SIZE);
+    uint32_t first = traceCount - available;
+    out.printf("#TRACE %d %d %lu %lu\n", TRACE_FORMAT_VERSION, (int)sizeof(TraceEntry),
+               (unsigned long)available, (unsigned long)micros());
+
+    char line[2 * sizeof(TraceEntry) + 4];
+    static const char hex[] = "0123456789ABCDEF";
+    for (uint32_t i = first; i < traceCount; i++)
+    {
+        // Copie de l'entrée telle qu'en mémoire (little-endian)
+        const uint8_t *raw = (const uint8_t *)&traceRing[i & (TRACE_RING_SIZE - 1)];
+        int pos = 0;
+        line[pos++] = 'T';
+        line[pos++] = ' ';
+        for (size_t b = 0; b < sizeof(TraceEntry); b++)
+        {
+            line[pos++] = hex[raw[b] >> 4];
+            line[pos++] = hex[raw[b] & 0x0F];
+        }
+        line[pos] = '\0';
+        out.println(line);
+    }
+    out.println("#END");
+}
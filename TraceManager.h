@@ -0,0 +1,60 @@
+#ifndef TRACE_MANAGER_H
+#define TRACE_MANAGER_H
+
+#include <Arduino.h>
+#include "Config.h"
+
+// ——————— CONSTANTES TRACE ———————
+#define TRACE_RING_SIZE 256    // Entrées (puissance de 2)
+#define TRACE_PAYLOAD_BYTES 16 // Début de trame conservé
+#define TRACE_FORMAT_VERSION 1 // Format du dump (tools/trace_decode.py)
+
+// Sens et bus physique de la trame
+enum TraceDirection
+{
+    TRACE_MODBUS_TX = 0,
+    TRACE_MODBUS_RX = 1,
+    TRACE_CAN_TX = 2,
+    TRACE_CAN_RX = 3
+};
+
+// Résultat associé à la trame
+enum TraceResult
+{
+    TRACE_OK = 0,
+    TRACE_TIMEOUT = 1,     // Aucune réponse
+    TRACE_TRUNCATED = 2,   // Réponse interrompue avant la longueur attendue
+    TRACE_BAD_CRC = 3,
+    TRACE_BAD_ADDRESS = 4, // Réponse d'une autre adresse que celle attendue pour l'ID
+    TRACE_EXCEPTION = 5,   // Fonction | 0x80
+    TRACE_TX_FAILED = 6,   // File d'émission pleine / pilote en erreur
+    TRACE_BAD_FUNCTION = 7, // Réponse à une autre fonction que la requête
+    TRACE_BAD_LENGTH = 8    // Nombre d'octets différent des registres demandés
+};
+
+// Une entrée du ring (28 octets, little-endian, format du dump)
+struct TraceEntry
+{
+    uint32_t timestampUs;
+    uint16_t id;        // CAN : identifiant ; réponse Modbus : registre de départ demandé
+    uint16_t length;    // Longueur réelle de la trame
+    uint8_t direction;  // TraceDirection
+    uint8_t bus;        // Index du bus Modbus (0 pour le CAN)
+    uint8_t batteryId;  // 0 = broadcast / sans objet
+    uint8_t result;     // TraceResult
+    uint8_t payload[TRACE_PAYLOAD_BYTES];
+};
+
+// ——————— FONCTIONS PUBLIQUES ———————
+
+// Enregistrement (quelques µs : copie de l'en-tête et du début de trame)
+void traceRecord(TraceDirection direction, uint8_t bus, uint8_t batteryId, uint16_t id,
+                 const uint8_t *data, uint16_t length, TraceResult result);
+void setTraceEnabled(bool enabled);
+void clearTrace();
+uint32_t getTraceCount(); // Entrées enregistrées depuis le dernier effacement
+
+// Dump texte hexadécimal, de la plus ancienne à la plus récente entrée
+void dumpTrace(Print &out);
+
+#endif
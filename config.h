@@ -21,6 +21,16 @@
 #define MODBUS_DE_RE_PIN 18
 #define MODBUS_SERIAL Serial2
 
+// Second bus RS485 (Serial1, pins remappés), en option : MODBUS_BUS_COUNT 2
+// seulement si le transceiver est câblé sur ces pins
+#ifndef MODBUS_BUS_COUNT
+#define MODBUS_BUS_COUNT 1
+#endif
+#define MODBUS2_RX_PIN 26
+#define MODBUS2_TX_PIN 27
+#define MODBUS2_DE_RE_PIN 25
+#define MODBUS2_SERIAL Serial1
+
 // ——————— CONFIGURATION SYSTÈME ———————
 // Code d'accès admin (3 chiffres)
 #define ADMIN_CODE_1 0
@@ -51,7 +61,9 @@ enum ScreenType
     SCREEN_MENU = 1,
     SCREEN_CODE_INPUT = 2,
     SCREEN_CODE_RESULT = 3,
-    SCREEN_CAN_FRAMES = 4
+    SCREEN_CAN_FRAMES = 4,
+    SCREEN_MODBUS_STATS = 5,
+    SCREEN_CAN_HEALTH = 6
 };
 
 enum MenuActions
@@ -62,7 +74,10 @@ enum MenuActions
     ACTION_ADMIN_CODE = 4,
     ACTION_PAIRING = 5,
     ACTION_SYSTEM_SETTINGS = 6,
-    ACTION_CAN_FRAMES = 7
+    ACTION_CAN_FRAMES = 7,
+    ACTION_MODBUS_BAUD = 8,
+    ACTION_MODBUS_STATS = 9,
+    ACTION_CAN_HEALTH = 10
 };
 
 // ——————— STRUCTURES ———————
@@ -82,9 +97,17 @@ struct MenuItem
 };
 
 // ——————— CONFIGURATION MODBUS ———————
-#define MODBUS_BAUD 9600
+#define MODBUS_BAUD 9600      // Vitesse par défaut et de repli
+#define MODBUS_AUTO_BAUD 1    // 1 = négocier la vitesse si aucune n'est enregistrée (au démarrage,
+                              // sinon à la fin de la première passe de découverte qui trouve une batterie)
 #define MODBUS_CONFIG SERIAL_8E1 // ⭐ CORRECTION : 8E1 au lieu de 8N1
-#define MAX_BATTERIES 9
-#define MASTER_ADDR 0x81
+#define MAX_BATTERIES 32 // Emplacements : batteries présentes en même temps (ID 1..247)
+#define MODBUS_BMS_FAMILY BMS_FAMILY_DEFAULT  // Adressage des BMS du bus 1 (BmsFamily)
+#define MODBUS2_BMS_FAMILY BMS_FAMILY_DEFAULT // Idem bus 2
+#define MODBUS_VERBOSE 0 // 1 = erreurs de trame et timeouts du polling sur Serial (sinon trace et stats)
+#define MODBUS_MOSFET_BROADCAST 0 // 1 = commande MOSFET groupée à l'adresse 0x00 (si les BMS l'acceptent)
+#define BATTERY_CELLS_SOA 0 // 1 = tensions cellules de toutes les batteries dans un tableau commun
+#define MODBUS_CRC_BENCHMARK 0 // 1 = mesurer les variantes de CRC16 au démarrage
+#define CELL_STATS_BENCHMARK 0 // 1 = mesurer les variantes du noyau de statistiques cellules
 
 #endif
\ No newline at end of file
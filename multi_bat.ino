@@ -6,15 +6,17 @@
 #include "ButtonManager.h"
 #include "ModbusManager.h"
 #include "CanBusManager.h"
+#include "TraceManager.h"
+#include "PackManager.h"
+#include "LimitManager.h"
+#include "CellStats.h"
 
 // ——————— OBJETS HARDWARE ———————
 U8G2_SH1106_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, OLED_SCL_PIN, OLED_SDA_PIN, OLED_RESET);
 
 // ——————— VARIABLES DE TIMING ———————
 unsigned long lastDisplayUpdate = 0;
-unsigned long lastConsigneUpdate = 0;
-#define DISPLAY_UPDATE_INTERVAL 500   // Mettre à jour l'affichage toutes les 500ms
-#define CONSIGNE_UPDATE_INTERVAL 5000 // Changer les consignes toutes les 5s (pour test)
+#define DISPLAY_UPDATE_INTERVAL 500 // Mettre à jour l'affichage toutes les 500ms
 
 // ——————— SETUP ———————
 void setup()
@@ -28,9 +30,22 @@ void setup()
   setDebounceDelay(DEBOUNCE_DELAY);
   // Initialisation du Modbus
   initModbus(&MODBUS_SERIAL);
+#if MODBUS_BUS_COUNT > 1
+  initModbusBus(1, &MODBUS2_SERIAL, MODBUS2_RX_PIN, MODBUS2_TX_PIN, MODBUS2_DE_RE_PIN);
+#endif
+#if MODBUS_AUTO_BAUD
+  negotiateUnsetModbusBauds();
+#endif
+#if MODBUS_CRC_BENCHMARK
+  benchmarkCRC16();
+#endif
+#if CELL_STATS_BENCHMARK
+  benchmarkCellStats();
+#endif
 
   // Initialisation du CAN Bus
-  if (!initCanBus())
+  bool canReady = initCanBus();
+  if (!canReady)
   {
     Serial.println("ERREUR: Impossible d'initialiser le CAN!");
     showMessage("ERREUR", "Echec init CAN");
@@ -39,13 +54,13 @@ void setup()
 
   initMenu();
 
-  // Consignes initiales temporaire
-  setChargeCurrentSetpoint(10.0);    // 10A comme sur le doc
-  setDischargeCurrentSetpoint(10.0); // 10A comme sur le doc
+  // Consignes opérateur : plafonds, déclassés par le moteur de limites
+  setChargeCurrentSetpoint(MAX_CHARGE_CURRENT_A);
+  setDischargeCurrentSetpoint(MAX_DISCHARGE_CURRENT_A);
 
   Serial.println("Système prêt !");
-  Serial.println("Consignes variables: 0-600A pour charge/décharge");
-  showMessage("SYSTEME", "Pret ! CAN actif");
+  Serial.println("Limites CCL/DCL/CVL calculées depuis les données du pack");
+  showMessage("SYSTEME", canReady ? "Pret ! CAN actif" : "Pret ! CAN inactif");
   delay(1000);
 }
 
@@ -54,16 +69,21 @@ void loop()
 {
   unsigned long now = millis();
 
+  // LECTURE MODBUS NON BLOQUANTE (fait avancer la transaction en cours)
+  updateModbusPolling();
+
+  // Commandes de diagnostic sur le port série
+  handleSerialCommands();
+
+  // RÉCEPTION CAN (vidage de la file, présence de l'onduleur)
+  receiveCanData();
+
+  // SANTÉ DU CONTRÔLEUR CAN (compteurs d'erreurs, reprise après bus-off)
+  updateCanHealth();
+
   // ENVOI PÉRIODIQUE DES DONNÉES CAN
   sendCanData();
 
-  // Faire varier les consignes automatiquement
-  if (now - lastConsigneUpdate >= CONSIGNE_UPDATE_INTERVAL)
-  {
-    testVariableConsignes();
-    lastConsigneUpdate = now;
-  }
-
   // Mettre à jour les boutons
   updateButtons();
 
@@ -99,64 +119,6 @@ void loop()
   delay(10);
 }
 
-// ——————— TEST DES CONSIGNES VARIABLES ———————
-/*
-avec mode dégradé : 10/10
-Seconde 0  : "Limite charge=10A, décharge=10A"    ← Très restrictif
-Seconde 5  : "Limite charge=50A, décharge=100A"
-Seconde 10 : "Limite charge=200A, décharge=300A"
-Seconde 15 : "Limite charge=500A, décharge=600A"  ← Limite MAX
-Seconde 20 : "Limite charge=0A, décharge=0A"      ← STOP complet !
-Seconde 25 : "Limite charge=347A, décharge=82A"   ← Aléatoire
-Seconde 30 : "Limite charge=156A, décharge=423A"  ← Aléatoire
-Seconde 35 : "Limite charge=10A, décharge=10A"    ← Retour au début
-*/
-void testVariableConsignes()
-{
-  static int testStep = 0;
-
-  switch (testStep)
-  {
-  case 0:
-    setChargeCurrentSetpoint(10.0);
-    setDischargeCurrentSetpoint(10.0);
-    Serial.println("TEST: Consignes 10A/10A");
-    break;
-  case 1:
-    setChargeCurrentSetpoint(50.0);
-    setDischargeCurrentSetpoint(100.0);
-    Serial.println("TEST: Consignes 50A/100A");
-    break;
-  case 2:
-    setChargeCurrentSetpoint(200.0);
-    setDischargeCurrentSetpoint(300.0);
-    Serial.println("TEST: Consignes 200A/300A");
-    break;
-  case 3:
-    setChargeCurrentSetpoint(500.0);
-    setDischargeCurrentSetpoint(600.0);
-    Serial.println("TEST: Consignes 500A/600A (MAX)");
-    break;
-  case 4:
-    setChargeCurrentSetpoint(0.0);
-    setDischargeCurrentSetpoint(0.0);
-    Serial.println("TEST: Consignes 0A/0A (STOP)");
-    break;
-  default:
-    // Consignes aléatoires
-    float randomCharge = random(0, 601);    // 0-600A
-    float randomDischarge = random(0, 601); // 0-600A
-    setChargeCurrentSetpoint(randomCharge);
-    setDischargeCurrentSetpoint(randomDischarge);
-    Serial.printf("TEST: Consignes aléatoires %.0fA/%.0fA\n", randomCharge, randomDischarge);
-    break;
-  }
-
-  testStep++;
-  if (testStep > 8)
-    testStep = 0; // Boucle de test
-}
-
 // ——————— GESTION BOUTON OK ———————
 void handleOkButton()
 {
@@ -164,12 +126,83 @@ void handleOkButton()
   selectMenuItem();
 }
 
+// ——————— COMMANDES SÉRIE ———————
+// Une commande par ligne : "trace" (dump du ring, à décoder avec
+// tools/trace_decode.py), "trace clear", "modbus" (statistiques de polling),
+// "stats" / "stats reset" (compteurs d'échanges par bus et par batterie),
+// "scan" (oublie les batteries enregistrées et relance la découverte),
+// "pack" (totaux et extrema du pack), "can" / "can rx" (statistiques
+// d'émission / de réception), "can frames" (octets en cache), "can health"
+// (compteurs d'erreurs du contrôleur, bus-off), "limits" (CCL/DCL/CVL et causes),
+// "can pylontech" (protocole onduleur, enregistré en NVS)
+void handleSerialCommands()
+{
+  static char line[32];
+  static int length = 0;
+
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    if (c == '\r')
+      continue;
+    if (c != '\n')
+    {
+      if (length < (int)sizeof(line) - 1)
+        line[length++] = c;
+      continue;
+    }
+
+    line[length] = '\0';
+    length = 0;
+
+    if (strcmp(line, "trace") == 0)
+      dumpTrace(Serial);
+    else if (strcmp(line, "trace clear") == 0)
+    {
+      clearTrace();
+      Serial.println("Trace effacée");
+    }
+    else if (strcmp(line, "modbus") == 0)
+      printPollingStats();
+    else if (strcmp(line, "stats") == 0)
+      printModbusStats();
+    else if (strcmp(line, "stats reset") == 0)
+    {
+      resetModbusStats();
+      Serial.println("Statistiques remises à zéro");
+    }
+    else if (strcmp(line, "scan") == 0)
+      resetBatteryRegistry();
+    else if (strcmp(line, "pack") == 0)
+      printPackSnapshot();
+    else if (strcmp(line, "limits") == 0)
+      printPackLimits();
+    else if (strcmp(line, "can") == 0)
+      printCanTxStats();
+    else if (strcmp(line, "can rx") == 0)
+      printCanRxStats();
+    else if (strcmp(line, "can frames") == 0)
+      printCanFrameCache();
+    else if (strcmp(line, "can health") == 0)
+      printCanHealth();
+    else if (strncmp(line, "can ", 4) == 0)
+    {
+      if (!setCanProtocolByName(line + 4))
+        Serial.println("Protocoles: pylontech");
+    }
+    else if (line[0])
+      Serial.println("Commandes: trace, trace clear, modbus, stats, stats reset, scan, pack, limits, can, can rx, can frames, can health, can <protocole>");
+  }
+}
+
 // ——————— FONCTIONS UTILITAIRES ———————
 void printSystemStatus()
 {
   Serial.println("\n=== STATUS SYSTÈME ===");
   Serial.printf("Consigne charge: %.1fA\n", getChargeCurrentSetpoint());
   Serial.printf("Consigne décharge: %.1fA\n", getDischargeCurrentSetpoint());
+  Serial.printf("Limites envoyées: charge %.1fA, décharge %.1fA\n", getChargeCurrentLimitA(),
+                getDischargeCurrentLimitA());
   Serial.printf("Uptime: %lu s\n", millis() / 1000);
   Serial.println("========================\n");
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+// Test hôte des octets des trames CAN de chaque protocole (CanBusManager.cpp).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh can_frames
+//
+// Conditions de référence des tables (commentaires de CanBusManager.cpp) :
+// une batterie, SOC 20 %, 42.00 V, 0 A, 27 °C, onduleur muet (courants au
+// plafond de sécurité). La batterie passe par le Modbus simulé, le pack et le
+// moteur de limites ; les trames émises sont comparées octet par octet aux
+// captures de référence. Toute trame d'une table doit avoir sa référence.
+// Sélection : un protocole hors table (par valeur, par nom ou enregistré en
+// NVS) est refusé et laisse le protocole par défaut.
+
+#include "host/host.h"
+#include "host/host_can.h"
+#include "ModbusManager.h"
+#include "CanBusManager.h"
+#include <Preferences.h>
+
+struct ReferenceFrame
+{
+    CanProtocol protocol;
+    uint32_t identifier;
+    uint8_t data[8];
+};
+
+static const ReferenceFrame REFERENCES[] = {
+    {PROTOCOL_PYLONTECH, 0x351, {0x04, 0x02, 0x64, 0x00, 0x64, 0x00, 0xC9, 0x01}},
+    {PROTOCOL_PYLONTECH, 0x355, {0x14, 0x00, 0x64, 0x00, 0xD0, 0x07, 0x00, 0x00}},
+    {PROTOCOL_PYLONTECH, 0x356, {0x68, 0x10, 0x00, 0x00, 0x0E, 0x01, 0x00, 0x00}},
+    {PROTOCOL_PYLONTECH, 0x359, {0x00, 0x00, 0x04, 0x00, 0x01, 0x00, 0x00, 0x00}},
+    {PROTOCOL_PYLONTECH, 0x35C, {0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}},
+    {PROTOCOL_PYLONTECH, 0x35E, {0x50, 0x59, 0x4C, 0x4F, 0x4E, 0x20, 0x20, 0x20}},
+};
+
+// ——————— TRAMES ÉMISES ———————
+
+#define SEEN_MAX 16
+
+static CanFrame seen[SEEN_MAX]; // Dernière trame émise par identifiant
+static uint8_t seenCount = 0;
+
+static bool mockWrite(const CanFrame &frame)
+{
+    uint8_t i = 0;
+    while (i < seenCount && seen[i].identifier != frame.identifier)
+        i++;
+    if (i == SEEN_MAX)
+        return true;
+    seen[i] = frame;
+    if (i == seenCount)
+        seenCount++;
+    return true;
+}
+
+static const CanFrame *findSeen(uint32_t identifier)
+{
+    for (uint8_t i = 0; i < seenCount; i++)
+    {
+        if (seen[i].identifier == identifier)
+            return &seen[i];
+    }
+    return nullptr;
+}
+
+static const ReferenceFrame *findReference(CanProtocol protocol, uint32_t identifier)
+{
+    for (size_t i = 0; i < sizeof(REFERENCES) / sizeof(REFERENCES[0]); i++)
+    {
+        if (REFERENCES[i].protocol == protocol && REFERENCES[i].identifier == identifier)
+            return &REFERENCES[i];
+    }
+    return nullptr;
+}
+
+// ——————— SCÉNARIO ———————
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        receiveCanData();
+        sendCanData();
+        hostAdvanceMs(1);
+    }
+}
+
+static void checkProtocol(CanProtocol protocol)
+{
+    setCanProtocol(protocol, false);
+    seenCount = 0;
+    runLoop(6000); // Plus longue période : 35E toutes les 5 s
+
+    const CanProtocolTable &table = getCanProtocolTable();
+    for (uint8_t f = 0; f < table.frameCount; f++)
+    {
+        uint32_t id = table.frames[f].identifier;
+        const ReferenceFrame *reference = findReference(protocol, id);
+        const CanFrame *frame = findSeen(id);
+        if (!hostCheck(reference != nullptr, "%s %03lX : capture de référence présente", table.name,
+                       (unsigned long)id) ||
+            !hostCheck(frame != nullptr, "%s %03lX : trame émise", table.name, (unsigned long)id))
+            continue;
+
+        char got[32];
+        char expected[32];
+        for (int i = 0; i < 8; i++)
+        {
+            snprintf(got + i * 3, 4, "%02X ", frame->data[i]);
+            snprintf(expected + i * 3, 4, "%02X ", reference->data[i]);
+        }
+        hostCheck(frame->data_length_code == 8 && !frame->extd && memcmp(frame->data, reference->data, 8) == 0,
+                  "%s %03lX : %s(attendu %s)", table.name, (unsigned long)id, got, expected);
+    }
+    hostCheck(seenCount == table.frameCount, "%s : %d identifiants émis pour %d trames", table.name, seenCount,
+              table.frameCount);
+}
+
+static void testProtocolSelection()
+{
+    hostCheck(!setCanProtocol(PROTOCOL_COUNT, false) && getCanProtocol() == PROTOCOL_PYLONTECH,
+              "protocole hors table refusé");
+    hostCheck(!setCanProtocolByName("solis") && setCanProtocolByName("pylontech") &&
+                  getCanProtocol() == PROTOCOL_PYLONTECH,
+              "sélection par nom : seuls les protocoles de la table");
+
+    // Valeur enregistrée par un firmware qui proposait un autre protocole
+    Preferences prefs;
+    prefs.begin("can", false);
+    prefs.putUChar("protocol", PROTOCOL_COUNT);
+    prefs.end();
+    initCanBus();
+    hostCheck(getCanProtocol() == CAN_DEFAULT_PROTOCOL && getCanProtocolTable().frames[0].identifier == PYLON_ID_LIMITS,
+              "protocole enregistré inconnu : %s au démarrage", getCanProtocolTable().name);
+}
+
+int main()
+{
+    hostResetBms();
+    hostAddBms(1, 0);
+    HostBms &bms = hostBms[1];
+    bms.regs[0x30] = bms.regs[0x31] = 67; // 27 °C (offset 40)
+    bms.regs[0x38] = 420;                 // 42.0 V
+    bms.regs[0x3A] = 200;                 // 20 %
+
+    initModbus(hostSerial(0));
+    registerBattery(1, 0);
+    setModbusPollingEnabled(true);
+    hostCanDriver.write = mockWrite;
+    setCanDriver(&hostCanDriver);
+    runLoop(10000); // Toutes les familles de registres lues au moins une fois
+
+    for (uint8_t p = 0; p < PROTOCOL_COUNT; p++)
+        checkProtocol((CanProtocol)p);
+    testProtocolSelection();
+    return hostReport("can_frames_test");
+}
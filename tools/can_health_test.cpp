@@ -0,0 +1,177 @@
+// Test hôte de la reprise après bus-off (updateCanHealth).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh can_health
+//
+// Pilote simulé qui suit les états du contrôleur TWAI : recover() le met en
+// REPRISE, la reprise se termine (ARRETE) avant l'échantillon suivant,
+// restart() le relance. Un défaut de câblage le remet en bus-off dès qu'il
+// tourne. Vérifie : délai de reprise doublé à chaque tentative depuis
+// CAN_RECOVERY_MIN_INTERVAL_MS jusqu'à CAN_RECOVERY_MAX_INTERVAL_MS, que le
+// contrôleur soit relancé entre deux bus-off ou que la reprise reste sans
+// effet ; aucune émission hors EN MARCHE ; délai minimal rétabli après un bus
+// stable.
+
+#include "host/host.h"
+#include "host/host_can.h"
+#include "CanBusManager.h"
+#include <vector>
+
+static twai_state_t busState = TWAI_STATE_RUNNING;
+static bool wiringFault = false;   // Le contrôleur repasse en bus-off dès qu'il tourne
+static bool recoveryWorks = true;  // recover() sort du bus-off
+static std::vector<unsigned long> busOffAt;
+static std::vector<unsigned long> recoverAt;
+static uint32_t writesOffBus = 0;
+
+static bool mockWrite(const CanFrame &)
+{
+    if (busState != TWAI_STATE_RUNNING)
+        writesOffBus++;
+    return true;
+}
+
+static bool mockStatus(twai_status_info_t &info)
+{
+    if (busState == TWAI_STATE_RUNNING && wiringFault)
+    {
+        busState = TWAI_STATE_BUS_OFF;
+        busOffAt.push_back(millis());
+    }
+    else if (busState == TWAI_STATE_RECOVERING)
+    {
+        busState = TWAI_STATE_STOPPED; // 128 x 11 bits récessifs : bien moins qu'une période
+    }
+    memset(&info, 0, sizeof(info));
+    info.state = busState;
+    info.tx_error_counter = busState == TWAI_STATE_BUS_OFF ? 256 : 0;
+    return true;
+}
+
+static bool mockRecover()
+{
+    recoverAt.push_back(millis());
+    if (recoveryWorks)
+        busState = TWAI_STATE_RECOVERING;
+    return true;
+}
+
+static bool mockRestart()
+{
+    busState = TWAI_STATE_RUNNING;
+    return true;
+}
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateCanHealth();
+        sendCanData();
+        hostAdvanceMs(1);
+    }
+}
+
+static unsigned long expectedDelayMs(size_t attempt)
+{
+    unsigned long delayMs = CAN_RECOVERY_MIN_INTERVAL_MS;
+    for (size_t i = 0; i < attempt; i++)
+        delayMs = min(delayMs * 2, (unsigned long)CAN_RECOVERY_MAX_INTERVAL_MS);
+    return delayMs;
+}
+
+static void clearFault()
+{
+    // Bus sain au-delà de CAN_RECOVERY_MAX_INTERVAL_MS : délai minimal rétabli
+    wiringFault = false;
+    runLoop(CAN_RECOVERY_MAX_INTERVAL_MS + 3 * CAN_HEALTH_PERIOD_MS);
+    hostCheck(getCanHealth().state == TWAI_STATE_RUNNING && isCanBusHealthy(), "bus de nouveau en marche");
+    hostCheck(getCanHealth().recoveryIntervalMs == CAN_RECOVERY_MIN_INTERVAL_MS, "délai ramené à %d ms après bus stable",
+              CAN_RECOVERY_MIN_INTERVAL_MS);
+}
+
+static void testRepeatedBusOff()
+{
+    // Chaque reprise relance le contrôleur, le défaut le remet en bus-off
+    busOffAt.clear();
+    recoverAt.clear();
+    uint32_t busOffCount = getCanHealth().busOffCount;
+    uint32_t recoveries = getCanHealth().recoveries;
+    wiringFault = true;
+    recoveryWorks = true;
+    runLoop(300000);
+
+    bool doubling = recoverAt.size() >= 8 && busOffAt.size() >= recoverAt.size();
+    for (size_t i = 0; doubling && i < recoverAt.size(); i++)
+    {
+        unsigned long waitedMs = recoverAt[i] - busOffAt[i];
+        doubling = hostCheck(waitedMs == expectedDelayMs(i), "bus-off %u : reprise après %lu ms", (unsigned)(i + 1),
+                             waitedMs);
+    }
+    hostCheck(doubling, "délais doublés jusqu'à %d ms sur %u reprises", CAN_RECOVERY_MAX_INTERVAL_MS,
+              (unsigned)recoverAt.size());
+    hostCheck(getCanHealth().busOffCount - busOffCount == busOffAt.size(), "%u bus-off comptés",
+              (unsigned)busOffAt.size());
+    hostCheck(getCanHealth().recoveries - recoveries >= recoverAt.size() - 1, "contrôleur relancé après chaque reprise");
+    hostCheck(writesOffBus == 0, "aucune trame émise hors EN MARCHE (%lu)", (unsigned long)writesOffBus);
+    clearFault();
+}
+
+static void testStuckBusOff()
+{
+    // Reprise sans effet : le même bus-off est retenté avec un délai doublé
+    busOffAt.clear();
+    recoverAt.clear();
+    uint32_t busOffCount = getCanHealth().busOffCount;
+    wiringFault = true;
+    recoveryWorks = false;
+    runLoop(300000);
+
+    bool doubling = recoverAt.size() >= 8 && busOffAt.size() == 1;
+    unsigned long previous = busOffAt.empty() ? 0 : busOffAt[0];
+    for (size_t i = 0; doubling && i < recoverAt.size(); i++)
+    {
+        doubling = recoverAt[i] - previous == expectedDelayMs(i);
+        previous = recoverAt[i];
+    }
+    hostCheck(doubling, "tentatives espacées de 1, 2, 4 ... %d s (%u tentatives)", CAN_RECOVERY_MAX_INTERVAL_MS / 1000,
+              (unsigned)recoverAt.size());
+    hostCheck(getCanHealth().busOffCount - busOffCount == 1, "un seul bus-off compté");
+    hostCheck(getCanHealth().recoveryAttempts >= recoverAt.size(), "tentatives comptées");
+    hostCheck(!isCanBusHealthy(), "bus signalé en défaut");
+    hostCheck(writesOffBus == 0, "aucune trame émise en bus-off (%lu)", (unsigned long)writesOffBus);
+
+    recoveryWorks = true;
+    runLoop(CAN_RECOVERY_MAX_INTERVAL_MS + 2 * CAN_HEALTH_PERIOD_MS);
+    clearFault();
+}
+
+static void testShortBusOffAfterStable()
+{
+    // Après un bus stable, un nouveau bus-off repart du délai minimal
+    busOffAt.clear();
+    recoverAt.clear();
+    wiringFault = true;
+    runLoop(CAN_HEALTH_PERIOD_MS + CAN_RECOVERY_MIN_INTERVAL_MS);
+    wiringFault = false;
+    runLoop(3 * CAN_HEALTH_PERIOD_MS);
+    hostCheck(recoverAt.size() == 1 && recoverAt[0] - busOffAt[0] == CAN_RECOVERY_MIN_INTERVAL_MS,
+              "reprise après %d ms", CAN_RECOVERY_MIN_INTERVAL_MS);
+    hostCheck(getCanHealth().state == TWAI_STATE_RUNNING, "contrôleur relancé");
+}
+
+int main()
+{
+    hostCanDriver.write = mockWrite;
+    hostCanDriver.status = mockStatus;
+    hostCanDriver.recover = mockRecover;
+    hostCanDriver.restart = mockRestart;
+    setCanDriver(&hostCanDriver);
+    runLoop(5000);
+    hostCheck(isCanBusHealthy(), "bus sain au départ");
+
+    testRepeatedBusOff();
+    testStuckBusOff();
+    testShortBusOffAfterStable();
+    return hostReport("can_health_test");
+}
@@ -0,0 +1,137 @@
+// Test hôte de la présence de l'onduleur (réception CAN, chien de garde).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh can_inverter
+//
+// La trame de présence vient de la table du protocole actif (keepaliveId).
+// Vérifie : onduleur absent au démarrage et courants de 0x351 plafonnés à
+// CAN_SAFE_CURRENT_A ; une trame d'un autre identifiant ne compte pas ; la
+// trame de présence lève le plafond ; le silence au-delà de
+// CAN_INVERTER_TIMEOUT_MS le rétablit. Chaque table déclare une trame de
+// présence valide (11 bits, hors de ses trames émises) ou CAN_NO_KEEPALIVE.
+
+#include "host/host.h"
+#include "host/host_can.h"
+#include "ModbusManager.h"
+#include "LimitManager.h"
+#include "CanBusManager.h"
+#include <deque>
+
+static std::deque<CanFrame> rxQueue;
+static CanFrame lastLimits;
+
+static bool mockWrite(const CanFrame &frame)
+{
+    if (frame.identifier == PYLON_ID_LIMITS)
+        lastLimits = frame;
+    return true;
+}
+
+static bool mockRead(CanFrame &frame)
+{
+    if (rxQueue.empty())
+        return false;
+    frame = rxQueue.front();
+    rxQueue.pop_front();
+    return true;
+}
+
+static void inject(uint32_t identifier)
+{
+    CanFrame frame = {};
+    frame.identifier = identifier;
+    frame.data_length_code = 8;
+    rxQueue.push_back(frame);
+}
+
+// loop() ; trame de présence toutes les keepaliveMs (0 = aucune)
+static void runLoop(unsigned long durationMs, unsigned long keepaliveMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        if (keepaliveMs && millis() % keepaliveMs == 0)
+            inject(getCanProtocolTable().keepaliveId);
+        updateModbusPolling();
+        receiveCanData();
+        sendCanData();
+        hostAdvanceMs(1);
+    }
+}
+
+static uint16_t publishedChargeDa()
+{
+    return lastLimits.data[2] | (lastLimits.data[3] << 8);
+}
+
+static uint16_t publishedDischargeDa()
+{
+    return lastLimits.data[4] | (lastLimits.data[5] << 8);
+}
+
+static void testTables()
+{
+    for (uint8_t p = 0; p < PROTOCOL_COUNT; p++)
+    {
+        setCanProtocol((CanProtocol)p, false);
+        const CanProtocolTable &table = getCanProtocolTable();
+        bool valid = table.keepaliveId == CAN_NO_KEEPALIVE || table.keepaliveId <= 0x7FF;
+        for (uint8_t f = 0; f < table.frameCount; f++)
+            valid = valid && table.frames[f].identifier != table.keepaliveId;
+        hostCheck(valid, "%s : trame de présence %03lX valide", table.name, (unsigned long)table.keepaliveId);
+        hostCheck(isInverterWatchdogActive() == (table.keepaliveId != CAN_NO_KEEPALIVE),
+                  "%s : chien de garde %s", table.name, isInverterWatchdogActive() ? "actif" : "inactif");
+    }
+    setCanProtocol(PROTOCOL_PYLONTECH, false);
+    hostCheck(getCanProtocolTable().keepaliveId == PYLON_ID_INVERTER_KEEPALIVE, "pylontech : présence sur 0x305");
+}
+
+static void testWatchdog()
+{
+    const int16_t safeDa = CAN_SAFE_CURRENT_A * 10;
+
+    // Démarrage : onduleur pas encore entendu, limites montées à leur cible
+    runLoop(30000, 0);
+    const PackLimits &limits = getPackLimits();
+    hostCheck(limits.chargeCurrentDa > safeDa && limits.dischargeCurrentDa > safeDa,
+              "limites du pack au-dessus du plafond (%d / %d dA)", limits.chargeCurrentDa, limits.dischargeCurrentDa);
+    hostCheck(!isInverterPresent(), "onduleur absent au démarrage");
+    hostCheck(publishedChargeDa() == safeDa && publishedDischargeDa() == safeDa,
+              "0x351 plafonnée à %d A (%u / %u dA)", CAN_SAFE_CURRENT_A, publishedChargeDa(), publishedDischargeDa());
+
+    // Une autre trame reçue n'est pas une preuve de présence
+    inject(0x123);
+    runLoop(2000, 0);
+    hostCheck(!isInverterPresent() && publishedChargeDa() == safeDa, "trame 0x123 ignorée");
+
+    // Trame de présence toutes les secondes : plafond levé
+    runLoop(5000, 1000);
+    hostCheck(isInverterPresent(), "onduleur présent");
+    hostCheck(publishedChargeDa() == limits.chargeCurrentDa && publishedDischargeDa() == limits.dischargeCurrentDa,
+              "0x351 aux limites du pack (%u / %u dA)", publishedChargeDa(), publishedDischargeDa());
+
+    // Silence : plafond rétabli après CAN_INVERTER_TIMEOUT_MS
+    inject(getCanProtocolTable().keepaliveId);
+    runLoop(CAN_INVERTER_TIMEOUT_MS - 500, 0);
+    hostCheck(isInverterPresent(), "présent avant l'échéance du chien de garde");
+    runLoop(2500, 0);
+    hostCheck(!isInverterPresent(), "absent après %d ms de silence", CAN_INVERTER_TIMEOUT_MS);
+    hostCheck(publishedChargeDa() == safeDa && publishedDischargeDa() == safeDa, "0x351 de nouveau plafonnée");
+}
+
+int main()
+{
+    hostResetBms();
+    hostAddBms(1, 0);
+    initModbus(hostSerial(0));
+    registerBattery(1, 0);
+    setModbusPollingEnabled(true);
+    hostCanDriver.write = mockWrite;
+    hostCanDriver.read = mockRead;
+    setCanDriver(&hostCanDriver);
+    setChargeCurrentSetpoint(MAX_CHARGE_CURRENT_A);
+    setDischargeCurrentSetpoint(MAX_DISCHARGE_CURRENT_A);
+
+    testTables();
+    testWatchdog();
+    return hostReport("can_inverter_test");
+}
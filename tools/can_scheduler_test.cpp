@@ -0,0 +1,189 @@
+// Test hôte de l'ordonnanceur d'émission CAN (sendCanData).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh can_scheduler
+//
+// Pilote simulé dont l'occupation de la file est imposée par le test.
+// Vérifie : chaque trame part à sa phase puis à sa période exacte, une trame
+// au plus par appel, les critiques avant les normales, les places réservées
+// de la file (normales refusées, critiques acceptées), le réessai des
+// critiques et le saut de période des normales quand la file est pleine, et
+// l'absence de rafale après un long arrêt de loop().
+
+#include "host/host.h"
+#include "host/host_can.h"
+#include "CanBusManager.h"
+#include <vector>
+
+struct SentFrame
+{
+    uint32_t identifier;
+    unsigned long ms;
+};
+
+static std::vector<SentFrame> sent;
+static uint32_t queuePending = 0; // Occupation de la file vue par l'ordonnanceur
+
+static bool mockWrite(const CanFrame &frame)
+{
+    sent.push_back({frame.identifier, millis()});
+    return true;
+}
+
+static uint32_t mockTxPending() { return queuePending; }
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        sendCanData();
+        hostAdvanceMs(1);
+    }
+}
+
+static int countSent(uint32_t identifier)
+{
+    int n = 0;
+    for (size_t i = 0; i < sent.size(); i++)
+        n += sent[i].identifier == identifier;
+    return n;
+}
+
+static void restart()
+{
+    queuePending = 0;
+    setCanProtocol(PROTOCOL_PYLONTECH, false);
+    sent.clear();
+}
+
+static void testPhasesAndPeriods()
+{
+    restart();
+    unsigned long start = millis();
+    runLoop(10500);
+
+    const CanProtocolTable &table = getCanProtocolTable();
+    for (uint8_t f = 0; f < table.frameCount; f++)
+    {
+        const CanFrameSpec &spec = table.frames[f];
+        std::vector<unsigned long> times;
+        for (size_t i = 0; i < sent.size(); i++)
+        {
+            if (sent[i].identifier == spec.identifier)
+                times.push_back(sent[i].ms - start);
+        }
+        bool onTime = !times.empty();
+        for (size_t i = 0; i < times.size(); i++)
+            onTime = onTime && times[i] == spec.phaseMs + i * spec.periodMs;
+        hostCheck(onTime, "%03lX : phase %u ms puis toutes les %u ms (%u émissions)",
+                  (unsigned long)spec.identifier, spec.phaseMs, spec.periodMs, (unsigned)times.size());
+        hostCheck(getCanTxStats(f).maxJitterMs == 0, "%03lX : gigue nulle", (unsigned long)spec.identifier);
+    }
+}
+
+static void testOneFramePerCallAndPriority()
+{
+    // Toutes les trames dues au même instant : une par appel, critiques d'abord
+    restart();
+    hostAdvanceMs(5000);
+    sendCanData();
+    hostCheck(sent.size() == CAN_TX_FRAMES_PER_CALL, "%u trame(s) pour un appel", (unsigned)sent.size());
+
+    for (int i = 0; i < 10; i++)
+        sendCanData();
+    const CanProtocolTable &table = getCanProtocolTable();
+    hostCheck(sent.size() == table.frameCount, "%u trames dues émises une fois chacune", (unsigned)sent.size());
+
+    // Ordre attendu : critiques par échéance, puis normales par échéance
+    bool criticalFirst = true;
+    bool seenNormal = false;
+    for (size_t i = 0; i < sent.size(); i++)
+    {
+        uint8_t priority = CAN_PRIORITY_NORMAL;
+        for (uint8_t f = 0; f < table.frameCount; f++)
+        {
+            if (table.frames[f].identifier == sent[i].identifier)
+                priority = table.frames[f].priority;
+        }
+        if (priority == CAN_PRIORITY_NORMAL)
+            seenNormal = true;
+        else if (seenNormal)
+            criticalFirst = false;
+    }
+    hostCheck(criticalFirst, "critiques (351, 359, 35C) avant les normales");
+    hostCheck(sent[0].identifier == PYLON_ID_LIMITS, "0x351 (phase 0) en premier");
+}
+
+static void testReservedSlots()
+{
+    // File occupée jusqu'aux places réservées : seules les critiques passent
+    restart();
+    queuePending = CAN_TX_QUEUE_SIZE - CAN_TX_RESERVED_SLOTS;
+    runLoop(3000);
+    hostCheck(countSent(PYLON_ID_LIMITS) == 3 && countSent(PYLON_ID_ALARMS) == 3 &&
+                  countSent(PYLON_ID_REQUESTS) == 3,
+              "critiques émises dans les places réservées (%d/%d/%d)", countSent(PYLON_ID_LIMITS),
+              countSent(PYLON_ID_ALARMS), countSent(PYLON_ID_REQUESTS));
+    hostCheck(countSent(PYLON_ID_SOC_SOH) == 0 && countSent(PYLON_ID_VOLTAGE_CURRENT) == 0 &&
+                  countSent(PYLON_ID_MANUFACTURER) == 0,
+              "normales refusées au-delà de %d trames en file", CAN_TX_QUEUE_SIZE - CAN_TX_RESERVED_SLOTS);
+    hostCheck(getCanTxStats(1).dropped == 3, "0x355 : 3 périodes sautées (%lu)", (unsigned long)getCanTxStats(1).dropped);
+}
+
+static void testFullQueue()
+{
+    // File pleine : la critique reste due et part dès qu'une place se libère,
+    // la normale attend sa période suivante
+    restart();
+    unsigned long start = millis();
+    queuePending = CAN_TX_QUEUE_SIZE;
+    runLoop(250); // 351 (phase 0) et 355 (phase 200) dues, refusées
+    hostCheck(sent.empty(), "rien d'émis file pleine");
+    hostCheck(getCanTxStats(0).retries > 0, "0x351 réessayée (%lu)", (unsigned long)getCanTxStats(0).retries);
+    hostCheck(getCanTxStats(1).dropped == 1, "0x355 : période sautée");
+
+    queuePending = 0;
+    runLoop(1);
+    hostCheck(sent.size() == 1 && sent[0].identifier == PYLON_ID_LIMITS && sent[0].ms - start == 250,
+              "0x351 émise dès la place libérée");
+    runLoop(1000);
+    hostCheck(countSent(PYLON_ID_SOC_SOH) == 1 && sent[1].identifier == PYLON_ID_VOLTAGE_CURRENT,
+              "0x355 reprend à sa période suivante");
+    unsigned long nextLimits = 0;
+    for (size_t i = 1; i < sent.size() && !nextLimits; i++)
+    {
+        if (sent[i].identifier == PYLON_ID_LIMITS)
+            nextLimits = sent[i].ms - start;
+    }
+    hostCheck(nextLimits == 1000, "0x351 garde sa phase après le réessai (%lu ms)", nextLimits);
+}
+
+static void testNoBurstAfterStall()
+{
+    // loop() arrêtée 5 s : une émission par trame, pas les périodes manquées
+    restart();
+    runLoop(2000);
+    hostAdvanceMs(5000);
+    sent.clear();
+    runLoop(100);
+    hostCheck(countSent(PYLON_ID_LIMITS) == 1 && countSent(PYLON_ID_SOC_SOH) == 1,
+              "une seule émission par trame après l'arrêt (%u trames)", (unsigned)sent.size());
+    sent.clear();
+    runLoop(2100);
+    hostCheck(countSent(PYLON_ID_LIMITS) == 2, "0x351 repart à sa période (%d en 2.1 s)", countSent(PYLON_ID_LIMITS));
+}
+
+int main()
+{
+    hostCanDriver.write = mockWrite;
+    hostCanDriver.txPending = mockTxPending;
+    setCanDriver(&hostCanDriver);
+    hostAdvanceMs(1000);
+
+    testPhasesAndPeriods();
+    testOneFramePerCallAndPriority();
+    testReservedSlots();
+    testFullQueue();
+    testNoBurstAfterStall();
+    return hostReport("can_scheduler_test");
+}
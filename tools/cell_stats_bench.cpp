@@ -0,0 +1,112 @@
+// Benchmark hôte du noyau de statistiques cellules (CellStats.h).
+//
+// Compilation (depuis la racine du dépôt) :
+//     g++ -O3 -march=native -I. -o cell_stats_bench tools/cell_stats_bench.cpp CellStats.cpp
+//
+// Vérifie d'abord que chaque variante rend exactement les accumulateurs de
+// la référence scalaire (cellules absentes, longueurs impaires, tableaux non
+// alignés), puis mesure les cycles par cellule pour 9 et 32 batteries x 48.
+// Sur la cible, voir benchmarkCellStats() (CELL_STATS_BENCHMARK dans config.h).
+
+#include "CellStats.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+static const char *CYCLE_UNIT = "cycles TSC";
+#else
+static uint64_t cycles()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char *CYCLE_UNIT = "ns";
+#endif
+
+typedef void (*Variant)(CellStatsAccumulator &, const uint16_t *, size_t);
+
+static const char *NAMES[] = {"scalaire", "sans branche", "mots 32 bits"};
+static const Variant VARIANTS[] = {accumulateCellStatsScalar, accumulateCellStatsVector,
+                                   accumulateCellStatsWords};
+static const int VARIANT_COUNT = 3;
+
+static int checkExactness()
+{
+    std::vector<uint16_t> cells(32 * 48 + 1);
+    int failures = 0;
+    srand(7);
+    for (int round = 0; round < 2000; round++)
+    {
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            int r = rand() % 100;
+            cells[i] = r < 30 ? 0 : r < 32 ? 0xFFFF : r < 34 ? 1 : (uint16_t)(2500 + rand() % 1200);
+        }
+        size_t offset = rand() % 2; // Début non aligné sur 32 bits
+        size_t count = rand() % (cells.size() - offset);
+
+        CellStatsAccumulator reference;
+        resetCellStats(reference);
+        accumulateCellStatsScalar(reference, cells.data() + offset, count);
+        for (int v = 1; v < VARIANT_COUNT; v++)
+        {
+            CellStatsAccumulator acc;
+            resetCellStats(acc);
+            VARIANTS[v](acc, cells.data() + offset, count);
+            if (!sameCellStats(acc, reference))
+                failures++;
+        }
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = checkExactness();
+    printf("Exactitude (2000 tirages x %d variantes): %s\n", VARIANT_COUNT - 1,
+           failures ? "ERREUR" : "OK");
+
+    std::vector<uint16_t> cells(32 * 48);
+    for (size_t i = 0; i < cells.size(); i++)
+        cells[i] = (i % 48) < 16 ? (uint16_t)(3200 + (i * 37) % 250) : 0;
+
+    const int iterations = 20000;
+    const int batteries[] = {9, 32};
+    for (int b : batteries)
+    {
+        size_t count = b * 48;
+        for (int v = 0; v < VARIANT_COUNT; v++)
+        {
+            CellStatsAccumulator acc;
+            uint64_t best = ~0ULL;
+            for (int run = 0; run < 5; run++)
+            {
+                uint64_t start = cycles();
+                for (int n = 0; n < iterations; n++)
+                {
+                    resetCellStats(acc);
+                    VARIANTS[v](acc, cells.data(), count);
+                    __asm__ volatile("" : : "r"(&acc) : "memory");
+                }
+                uint64_t elapsed = cycles() - start;
+                if (elapsed < best)
+                    best = elapsed;
+            }
+            printf("%2d x 48 %-13s : %6.3f %s/cellule\n", b, NAMES[v],
+                   (double)best / ((double)iterations * count), CYCLE_UNIT);
+        }
+    }
+
+    CellStatsAccumulator acc;
+    resetCellStats(acc);
+    accumulateCellStats(acc, cells.data(), cells.size());
+    CellStats stats = finishCellStats(acc);
+    printf("min=%u max=%u moyenne=%.1f écart-type=%.2f écart=%u mV (%u cellules)\n", stats.minMv,
+           stats.maxMv, stats.meanMv, stats.stddevMv, stats.imbalanceMv, stats.count);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+// Benchmark hôte des variantes de CRC16 Modbus (ModbusManager.cpp).
+//
+// Compilation (depuis la racine du dépôt) :
+//     g++ -std=gnu++11 -O3 -march=native -Itools/host -I. -o crc16_bench tools/crc16_bench.cpp
+//         ModbusManager.cpp PackManager.cpp CellStats.cpp TraceManager.cpp LimitManager.cpp
+//         CanBusManager.cpp tools/host/host_arduino.cpp tools/host/host_bms.cpp
+// (ModbusManager.cpp porte les CRC : environnement simulé de tools/host)
+//
+// Vérifie d'abord que la table, le slice-by-4 et le repli octet par octet
+// (crc16Update, comme à la réception) rendent exactement la référence bit à
+// bit, sur des longueurs tirées au-delà de 255 octets, des débuts non alignés
+// et toutes les longueurs de queue, puis mesure les cycles par octet pour une
+// requête (8 o) et une réponse temps réel (261 o). Sur la cible, voir
+// benchmarkCRC16() (MODBUS_CRC_BENCHMARK dans config.h).
+
+#include "ModbusManager.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static uint64_t cycles() { return __rdtsc(); }
+static const char *CYCLE_UNIT = "cycles TSC";
+#else
+static uint64_t cycles()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static const char *CYCLE_UNIT = "ns";
+#endif
+
+static uint16_t calculateCRC16Fold(const uint8_t *data, uint16_t length)
+{
+    // Repli de la réception : un octet à la fois, au fil de l'arrivée
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i = 0; i < length; i++)
+        crc = crc16Update(crc, data[i]);
+    return crc;
+}
+
+typedef uint16_t (*Variant)(const uint8_t *, uint16_t);
+
+static const char *NAMES[] = {"bit a bit", "table", "slice-by-4", "repli"};
+static const Variant VARIANTS[] = {calculateCRC16Bitwise, calculateCRC16, calculateCRC16Slice4,
+                                   calculateCRC16Fold};
+static const int VARIANT_COUNT = 4;
+
+static int checkExactness()
+{
+    std::vector<uint8_t> buffer(1024 + 8);
+    int failures = 0;
+    srand(7);
+    for (int round = 0; round < 20000; round++)
+    {
+        for (size_t i = 0; i < buffer.size(); i++)
+            buffer[i] = (uint8_t)rand();
+        size_t offset = rand() % 4; // Début non aligné sur 32 bits
+        // Une moitié au-delà de 255 octets, l'autre sur les trames courtes (queues 0 à 3)
+        uint16_t length = round % 2 ? (uint16_t)(256 + rand() % 769) : (uint16_t)(rand() % 64);
+
+        const uint8_t *data = buffer.data() + offset;
+        uint16_t reference = calculateCRC16Bitwise(data, length);
+        for (int v = 1; v < VARIANT_COUNT; v++)
+        {
+            if (VARIANTS[v](data, length) != reference)
+                failures++;
+        }
+
+        // Trame complétée par son CRC (octet bas d'abord) : résidu nul
+        uint8_t *tail = buffer.data() + offset + length;
+        tail[0] = reference & 0xFF;
+        tail[1] = reference >> 8;
+        if (calculateCRC16(data, length + 2) != 0)
+            failures++;
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = checkExactness();
+    printf("Exactitude (20000 tirages x %d variantes): %s\n", VARIANT_COUNT - 1, failures ? "ERREUR" : "OK");
+
+    static uint8_t frame[261];
+    for (int i = 0; i < (int)sizeof(frame); i++)
+        frame[i] = (uint8_t)(i * 37 + 11);
+
+    const int iterations = 200000;
+    const uint16_t sizes[] = {8, 261};
+    for (uint16_t size : sizes)
+    {
+        for (int v = 0; v < VARIANT_COUNT; v++)
+        {
+            uint64_t best = ~0ULL;
+            for (int run = 0; run < 5; run++)
+            {
+                uint64_t start = cycles();
+                for (int n = 0; n < iterations; n++)
+                {
+                    volatile uint16_t result = VARIANTS[v](frame, size);
+                    (void)result;
+                    __asm__ volatile("" : : "r"(frame) : "memory");
+                }
+                uint64_t elapsed = cycles() - start;
+                if (elapsed < best)
+                    best = elapsed;
+            }
+            printf("%3u octets %-10s : %6.2f %s/octet\n", size, NAMES[v],
+                   (double)best / ((double)iterations * size), CYCLE_UNIT);
+        }
+    }
+    return failures ? 1 : 0;
+}
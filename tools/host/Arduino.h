@@ -0,0 +1,94 @@
+// Cœur Arduino minimal pour compiler les modules sur l'hôte (tests, bancs).
+// Horloge, UART et NVS sont simulés dans host_arduino.cpp / host_bms.cpp.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define SERIAL_8N1 0x800001c
+#define SERIAL_8E1 0x800001e
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+long random(long low, long high);
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+class Stream
+{
+public:
+    virtual ~Stream() {}
+    virtual int available() { return 0; }
+    virtual int read() { return -1; }
+    virtual int peek() { return -1; }
+    virtual size_t write(uint8_t) { return 1; }
+    virtual size_t write(const uint8_t *, size_t n) { return n; }
+    virtual int availableForWrite() { return 128; }
+    virtual void flush() {}
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char *text);
+    size_t print(int value);
+    size_t println(const char *text = "");
+    size_t println(int value);
+    int readBytes(uint8_t *buffer, size_t length);
+    int readBytesUntil(char terminator, char *buffer, size_t length);
+};
+
+typedef Stream Print;
+
+class HardwareSerial : public Stream
+{
+public:
+    virtual void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1);
+    virtual void end() {}
+    virtual void updateBaudRate(unsigned long baud);
+    virtual uint32_t baudRate() { return baud; }
+    size_t setRxBufferSize(size_t size) { return size; }
+    size_t setTxBufferSize(size_t size) { return size; }
+
+protected:
+    unsigned long baud = 0;
+};
+
+extern HardwareSerial Serial;   // Console
+extern HardwareSerial &Serial1; // Bus RS485 simulés (host_bms.cpp)
+extern HardwareSerial &Serial2;
+
+class EspClass
+{
+public:
+    uint32_t getCycleCount();
+    uint32_t getFreeHeap() { return 100000; }
+};
+
+extern EspClass ESP;
+
+#endif
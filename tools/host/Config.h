@@ -0,0 +1,2 @@
+// Le dépôt inclut "Config.h" ; le fichier s'appelle config.h
+#include "../../config.h"
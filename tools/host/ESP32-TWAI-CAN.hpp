@@ -0,0 +1,40 @@
+// Interface de la bibliothèque ESP32-TWAI-CAN (sans contrôleur sur l'hôte :
+// les tests passent par setCanDriver)
+
+#ifndef HOST_ESP32_TWAI_CAN_HPP
+#define HOST_ESP32_TWAI_CAN_HPP
+
+#include "Arduino.h"
+#include "driver/twai.h"
+
+typedef twai_message_t CanFrame;
+
+enum TwaiSpeed
+{
+    TWAI_SPEED_125KBPS,
+    TWAI_SPEED_250KBPS,
+    TWAI_SPEED_500KBPS,
+    TWAI_SPEED_1000KBPS
+};
+
+class TwaiCAN
+{
+public:
+    bool begin() { return false; }
+    void end() {}
+    bool setPins(int, int) { return true; }
+    void setRxQueueSize(uint16_t) {}
+    void setTxQueueSize(uint16_t) {}
+    void setSpeed(TwaiSpeed) {}
+    TwaiSpeed convertSpeed(uint16_t) { return TWAI_SPEED_500KBPS; }
+    bool writeFrame(const CanFrame &, uint32_t = 0) { return false; }
+    bool writeFrame(const CanFrame *, uint32_t = 0) { return false; }
+    bool readFrame(CanFrame &, uint32_t = 1000) { return false; }
+    bool readFrame(CanFrame *, uint32_t = 1000) { return false; }
+    uint32_t inTxQueue() { return 0; }
+    uint32_t inRxQueue() { return 0; }
+};
+
+extern TwaiCAN ESP32Can;
+
+#endif
@@ -0,0 +1,30 @@
+// NVS simulée en mémoire (host_arduino.cpp)
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() {}
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+    size_t putUChar(const char *key, uint8_t value);
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0);
+    size_t putUInt(const char *key, uint32_t value);
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytes(const char *key, void *buffer, size_t length);
+    size_t getBytesLength(const char *key);
+
+private:
+    char space[16];
+};
+
+void hostClearPreferences();
+
+#endif
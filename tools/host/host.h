@@ -0,0 +1,98 @@
+// Environnement hôte des tests (tools/*_test.cpp) : horloge simulée, bus RS485
+// avec BMS simulés, vérifications.
+//
+// Le temps n'avance que par hostAdvanceUs() (ou delay()/yield() appelés par le
+// code testé) : un appel qui ne bloque pas laisse l'horloge inchangée.
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <Arduino.h>
+#include <vector>
+
+// ——————— HORLOGE ———————
+
+extern uint64_t hostNowUs;
+extern uint32_t hostDelayCalls; // delay()/delayMicroseconds() appelés par le code testé
+void hostAdvanceUs(uint64_t us);
+inline void hostAdvanceMs(unsigned long ms) { hostAdvanceUs((uint64_t)ms * 1000); }
+
+// ——————— CONSOLE ———————
+
+extern bool hostVerbose;        // Sortie série recopiée sur stdout (HOST_VERBOSE=1)
+extern bool hostSerialCost;     // Chaque caractère coûte son temps UART à 115200 bauds
+extern uint32_t hostSerialBytes; // Caractères écrits sur Serial
+
+// ——————— BUS RS485 ET BMS SIMULÉS ———————
+
+#define HOST_BUSES 2
+#define HOST_BMS_MAX_ID 32
+#define HOST_BMS_REGS 0x200 // Registres 0x0000~0x01FF
+
+enum HostAckMode
+{
+    HOST_ACK_ECHO = 0,         // Écho conforme (adresse registre, valeur/quantité)
+    HOST_ACK_EXCEPTION = 1,    // Exception : fonction | 0x80, code 0x02
+    HOST_ACK_BAD_FUNCTION = 2, // Fonction différente de la requête
+    HOST_ACK_BAD_ECHO = 3,     // Adresse de registre différente dans l'écho
+    HOST_ACK_SILENT = 4        // Écriture appliquée, pas de réponse
+};
+
+struct HostBms
+{
+    bool present;
+    uint8_t bus;
+    uint16_t regs[HOST_BMS_REGS];
+    uint8_t ackMode;       // HostAckMode
+    uint32_t turnaroundUs; // Requête reçue → premier octet de réponse
+    uint16_t gapAfterByte; // Silence inséré après cet octet de la réponse (0 = aucun)
+    uint32_t gapUs;
+    uint8_t rawFunction;   // ≠ 0 : répond à une lecture par cette fonction (longueur inconnue)
+    uint8_t rawLength;     // Octets de données de cette réponse
+    unsigned long maxBaud; // ≠ 0 : requête plus rapide illisible, pas de réponse
+    uint16_t corruptByte;  // ≠ 0 : cet octet de la réponse (1 = adresse) est inversé
+    uint16_t corruptReg;   // ≠ 0 : lecture couvrant ce registre rendue avec sa valeur altérée
+    uint8_t corruptReplies; // Avec corruptReg : réponses encore altérées (0 = toutes)
+    uint16_t truncateAfter; // ≠ 0 : réponse coupée après cet octet
+    uint16_t replyRegs;    // ≠ 0 : lecture servie avec au plus ce nombre de registres
+    uint32_t requests;
+    uint32_t writes;
+};
+
+// Requête au CRC valide vue sur un bus (BMS présent ou non)
+struct HostRequest
+{
+    uint64_t us; // Fin de la trame sur le fil
+    uint8_t bus;
+    uint8_t id; // 0 = broadcast
+    uint8_t function;
+    uint16_t start; // Premier registre
+    uint16_t count; // Quantité (0x03/0x10), valeur écrite (0x06)
+    uint16_t length; // Octets de la requête
+    uint16_t replyLength; // Octets de la réponse (0 = aucune)
+};
+
+extern HostBms hostBms[HOST_BMS_MAX_ID + 1];
+extern bool hostBroadcastApplied; // Les BMS appliquent les écritures à l'adresse 0x00
+extern uint32_t hostBusRequests[HOST_BUSES];
+extern uint32_t hostBroadcasts[HOST_BUSES];
+extern bool hostLogRequests; // Remplit hostRequestLog (vidé par hostResetBms)
+extern std::vector<HostRequest> hostRequestLog;
+
+HardwareSerial *hostSerial(uint8_t bus);
+unsigned long hostBusBaud(uint8_t bus);
+bool hostBusBusy(uint8_t bus); // Trame en émission ou réponse en cours sur le fil
+
+// BMS présent, valeurs plausibles (16 cellules, 2 sondes, MOSFET fermés)
+void hostAddBms(uint8_t id, uint8_t bus);
+void hostResetBms();
+
+// Courant en 0.1 A (+ = décharge), SOC en 0.1 %
+void hostSetBmsCurrent(uint8_t id, int16_t currentDa);
+
+// ——————— VÉRIFICATIONS ———————
+
+bool hostCheck(bool ok, const char *format, ...) __attribute__((format(printf, 2, 3)));
+int hostReport(const char *name); // Code de sortie : 0 si tout est passé
+
+#endif
@@ -0,0 +1,275 @@
+// Horloge, console, NVS et périphériques absents de l'hôte
+
+#include "host.h"
+#include <Preferences.h>
+#include <ESP32-TWAI-CAN.hpp>
+#include <stdarg.h>
+#include <map>
+#include <string>
+
+void hostBmsStep();
+
+// ——————— HORLOGE ———————
+
+uint64_t hostNowUs = 0;
+uint32_t hostDelayCalls = 0;
+
+void hostAdvanceUs(uint64_t us)
+{
+    // Par pas de 20 us : les octets du bus arrivent à leur heure
+    uint64_t end = hostNowUs + us;
+    while (hostNowUs < end)
+    {
+        hostNowUs = min(end, hostNowUs + 20);
+        hostBmsStep();
+    }
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(hostNowUs / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)hostNowUs;
+}
+
+void delay(unsigned long ms)
+{
+    hostDelayCalls++;
+    hostAdvanceMs(ms);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    hostDelayCalls++;
+    hostAdvanceUs(us);
+}
+
+void yield()
+{
+    hostAdvanceUs(20);
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return HIGH; }
+
+long random(long low, long high)
+{
+    return high > low ? low + rand() % (high - low) : low;
+}
+
+EspClass ESP;
+
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)(hostNowUs * 240); // 240 MHz
+}
+
+// ——————— CONSOLE ———————
+
+bool hostVerbose = getenv("HOST_VERBOSE") != nullptr;
+bool hostSerialCost = false;
+uint32_t hostSerialBytes = 0;
+
+static size_t consoleWrite(const char *text, size_t length)
+{
+    hostSerialBytes += length;
+    if (hostSerialCost)
+        hostAdvanceUs(length * 10ULL * 1000000ULL / 115200);
+    if (hostVerbose)
+        fwrite(text, 1, length, stdout);
+    return length;
+}
+
+size_t Stream::printf(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    return consoleWrite(buffer, min((size_t)max(length, 0), sizeof(buffer) - 1));
+}
+
+size_t Stream::print(const char *text)
+{
+    return consoleWrite(text, strlen(text));
+}
+
+size_t Stream::print(int value)
+{
+    char buffer[16];
+    return consoleWrite(buffer, snprintf(buffer, sizeof(buffer), "%d", value));
+}
+
+size_t Stream::println(const char *text)
+{
+    return print(text) + consoleWrite("\r\n", 2);
+}
+
+size_t Stream::println(int value)
+{
+    return print(value) + consoleWrite("\r\n", 2);
+}
+
+int Stream::readBytes(uint8_t *, size_t)
+{
+    return 0;
+}
+
+int Stream::readBytesUntil(char, char *, size_t)
+{
+    return 0;
+}
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(unsigned long speed, uint32_t, int8_t, int8_t)
+{
+    baud = speed;
+}
+
+void HardwareSerial::updateBaudRate(unsigned long speed)
+{
+    baud = speed;
+}
+
+// ——————— NVS ———————
+
+static std::map<std::string, std::string> nvs;
+
+static std::string nvsKey(const char *space, const char *key)
+{
+    return std::string(space) + "/" + key;
+}
+
+void hostClearPreferences()
+{
+    nvs.clear();
+}
+
+bool Preferences::begin(const char *name, bool)
+{
+    snprintf(space, sizeof(space), "%s", name);
+    return true;
+}
+
+bool Preferences::clear()
+{
+    std::string prefix = std::string(space) + "/";
+    for (auto it = nvs.begin(); it != nvs.end();)
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? nvs.erase(it) : std::next(it);
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    return nvs.erase(nvsKey(space, key)) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return nvs.count(nvsKey(space, key)) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    nvs[nvsKey(space, key)] = std::string((const char *)value, length);
+    return length;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+    auto it = nvs.find(nvsKey(space, key));
+    if (it == nvs.end())
+        return 0;
+    size_t n = min(length, it->second.size());
+    memcpy(buffer, it->second.data(), n);
+    return n;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    auto it = nvs.find(nvsKey(space, key));
+    return it == nvs.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::putUChar(const char *key, uint8_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint8_t Preferences::getUChar(const char *key, uint8_t defaultValue)
+{
+    uint8_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value)
+{
+    return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue)
+{
+    uint32_t value = defaultValue;
+    getBytes(key, &value, sizeof(value));
+    return value;
+}
+
+// ——————— CAN ET ÉCRAN ABSENTS ———————
+// Les tests CAN passent par setCanDriver() ; l'écran n'existe pas sur l'hôte.
+
+TwaiCAN ESP32Can;
+
+esp_err_t twai_get_status_info(twai_status_info_t *)
+{
+    return ESP_FAIL;
+}
+
+esp_err_t twai_initiate_recovery()
+{
+    return ESP_FAIL;
+}
+
+esp_err_t twai_start()
+{
+    return ESP_FAIL;
+}
+
+void clearDisplay() {}
+void showDisplay() {}
+void drawTitle(const char *) {}
+void drawText(int, int, const char *, bool, bool) {}
+
+// ——————— VÉRIFICATIONS ———————
+
+static int checks = 0;
+static int failures = 0;
+
+bool hostCheck(bool ok, const char *format, ...)
+{
+    checks++;
+    if (!ok)
+        failures++;
+    if (!ok || hostVerbose)
+    {
+        va_list args;
+        va_start(args, format);
+        printf("  %s: ", ok ? "ok" : "ÉCHEC");
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+    }
+    return ok;
+}
+
+int hostReport(const char *name)
+{
+    printf("%s: %d/%d vérifications passées\n", name, checks - failures, checks);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,305 @@
+// Bus RS485 simulés : UART à la vitesse configurée, BMS qui répondent aux
+// lectures 0x03 et aux écritures 0x06/0x10 (adressage 0x80+ID / 0x50+ID).
+
+#include "host.h"
+#include <deque>
+#include <vector>
+
+#define HOST_REQUEST_BASE 0x80
+#define HOST_RESPONSE_BASE 0x50
+#define HOST_REG_CHARGE_CONTROL 0x0121
+#define HOST_REG_CHARGE_MOSFET 0x52
+
+HostBms hostBms[HOST_BMS_MAX_ID + 1];
+bool hostBroadcastApplied = true;
+uint32_t hostBusRequests[HOST_BUSES];
+uint32_t hostBroadcasts[HOST_BUSES];
+bool hostLogRequests = false;
+std::vector<HostRequest> hostRequestLog;
+
+// ——————— UART ———————
+
+class HostBus : public HardwareSerial
+{
+public:
+    std::deque<std::pair<uint64_t, uint8_t>> rx; // Heure d'arrivée, octet
+    std::vector<uint8_t> request;
+    uint64_t requestEndUs = 0;
+
+    uint64_t byteUs() const { return 11ULL * 1000000ULL / (baud ? baud : 9600); } // 8E1
+
+    int available() override
+    {
+        int n = 0;
+        for (auto &b : rx)
+        {
+            if (b.first > hostNowUs)
+                break;
+            n++;
+        }
+        return n;
+    }
+
+    int read() override
+    {
+        if (!available())
+            return -1;
+        uint8_t b = rx.front().second;
+        rx.pop_front();
+        return b;
+    }
+
+    size_t write(uint8_t b) override { return write(&b, 1); }
+
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        // La trame part à la suite d'une éventuelle émission en cours
+        uint64_t start = max(hostNowUs, requestEndUs);
+        request.insert(request.end(), data, data + length);
+        requestEndUs = start + length * byteUs();
+        return length;
+    }
+
+    void flush() override
+    {
+        if (hostNowUs < requestEndUs)
+            hostAdvanceUs(requestEndUs - hostNowUs);
+    }
+};
+
+static HostBus buses[HOST_BUSES];
+HardwareSerial &Serial2 = buses[0];
+HardwareSerial &Serial1 = buses[1];
+
+HardwareSerial *hostSerial(uint8_t bus)
+{
+    return &buses[bus];
+}
+
+unsigned long hostBusBaud(uint8_t bus)
+{
+    return buses[bus].baudRate();
+}
+
+bool hostBusBusy(uint8_t bus)
+{
+    const HostBus &b = buses[bus];
+    return !b.request.empty() || (!b.rx.empty() && b.rx.back().first > hostNowUs);
+}
+
+// ——————— BMS ———————
+
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+    return crc;
+}
+
+void hostResetBms()
+{
+    memset(hostBms, 0, sizeof(hostBms));
+    hostBroadcastApplied = true;
+    hostRequestLog.clear();
+    for (int i = 0; i < HOST_BUSES; i++)
+    {
+        buses[i].rx.clear();
+        buses[i].request.clear();
+        hostBusRequests[i] = hostBroadcasts[i] = 0;
+    }
+}
+
+void hostAddBms(uint8_t id, uint8_t bus)
+{
+    HostBms &bms = hostBms[id];
+    memset(&bms, 0, sizeof(bms));
+    bms.present = true;
+    bms.bus = bus;
+    bms.turnaroundUs = 20000;
+    for (int cell = 0; cell < 16; cell++)
+        bms.regs[cell] = 3300 + cell;
+    bms.regs[0x30] = bms.regs[0x31] = 65; // 25 °C (offset 40)
+    bms.regs[0x38] = 530;                 // 53.0 V
+    bms.regs[0x39] = 30000;               // 0 A
+    bms.regs[0x3A] = 600;                 // 60 %
+    bms.regs[0x3B] = 1;                   // Heartbeat
+    bms.regs[0x3C] = 16;
+    bms.regs[0x3D] = 2;
+    bms.regs[0x52] = bms.regs[0x53] = 1;
+    bms.regs[HOST_REG_CHARGE_CONTROL] = bms.regs[HOST_REG_CHARGE_CONTROL + 1] = 1;
+}
+
+void hostSetBmsCurrent(uint8_t id, int16_t currentDa)
+{
+    hostBms[id].regs[0x39] = (uint16_t)(30000 + currentDa);
+}
+
+static void writeRegister(HostBms &bms, uint16_t reg, uint16_t value)
+{
+    if (reg >= HOST_BMS_REGS)
+        return;
+    bms.regs[reg] = value;
+    bms.writes++;
+    // Commande MOSFET : l'état relu suit la commande
+    if (reg == HOST_REG_CHARGE_CONTROL || reg == HOST_REG_CHARGE_CONTROL + 1)
+        bms.regs[HOST_REG_CHARGE_MOSFET + reg - HOST_REG_CHARGE_CONTROL] = value & 1;
+}
+
+static bool applyWrite(HostBms &bms, const std::vector<uint8_t> &f)
+{
+    uint16_t reg = (f[2] << 8) | f[3];
+    if (f[1] == 0x06)
+    {
+        writeRegister(bms, reg, (f[4] << 8) | f[5]);
+        return true;
+    }
+    uint16_t count = (f[4] << 8) | f[5];
+    if (f.size() < 9u + count * 2)
+        return false;
+    for (uint16_t i = 0; i < count; i++)
+        writeRegister(bms, reg + i, (f[7 + i * 2] << 8) | f[8 + i * 2]);
+    return true;
+}
+
+static void reply(HostBus &bus, const HostBms &bms, std::vector<uint8_t> r, size_t corruptAt = 0)
+{
+    uint16_t crc = crc16(r.data(), r.size());
+    r.push_back(crc & 0xFF);
+    r.push_back(crc >> 8);
+
+    if (!corruptAt)
+        corruptAt = bms.corruptByte;
+    if (corruptAt && corruptAt <= r.size())
+        r[corruptAt - 1] ^= 0xFF;
+    if (bms.truncateAfter && bms.truncateAfter < r.size())
+        r.resize(bms.truncateAfter);
+    if (hostLogRequests)
+        hostRequestLog.back().replyLength = r.size();
+
+    uint64_t t = hostNowUs + bms.turnaroundUs;
+    for (size_t i = 0; i < r.size(); i++)
+    {
+        t += bus.byteUs();
+        bus.rx.push_back(std::make_pair(t, r[i]));
+        if (bms.gapAfterByte && i + 1 == bms.gapAfterByte)
+            t += bms.gapUs;
+    }
+}
+
+static void handleRequest(HostBus &bus, uint8_t busIndex, const std::vector<uint8_t> &f)
+{
+    if (f.size() < 8 || crc16(f.data(), f.size()) != 0)
+        return;
+    hostBusRequests[busIndex]++;
+    if (hostLogRequests)
+    {
+        HostRequest logged = {hostNowUs, busIndex, (uint8_t)(f[0] >= HOST_REQUEST_BASE ? f[0] - HOST_REQUEST_BASE : 0),
+                              f[1], (uint16_t)((f[2] << 8) | f[3]), (uint16_t)((f[4] << 8) | f[5]),
+                              (uint16_t)f.size(), 0};
+        hostRequestLog.push_back(logged);
+    }
+
+    if (f[0] == 0x00)
+    {
+        // Broadcast : appliqué sans réponse (si les BMS l'acceptent)
+        hostBroadcasts[busIndex]++;
+        if (!hostBroadcastApplied || (f[1] != 0x06 && f[1] != 0x10))
+            return;
+        for (int id = 1; id <= HOST_BMS_MAX_ID; id++)
+        {
+            if (hostBms[id].present && hostBms[id].bus == busIndex)
+                applyWrite(hostBms[id], f);
+        }
+        return;
+    }
+
+    int id = f[0] - HOST_REQUEST_BASE;
+    if (id < 1 || id > HOST_BMS_MAX_ID || !hostBms[id].present || hostBms[id].bus != busIndex)
+        return;
+    HostBms &bms = hostBms[id];
+    if (bms.maxBaud && bus.baudRate() > bms.maxBaud)
+        return;
+    bms.requests++;
+
+    std::vector<uint8_t> r;
+    r.push_back(HOST_RESPONSE_BASE + id);
+    if (f[1] == 0x03)
+    {
+        if (bms.rawFunction)
+        {
+            r.push_back(bms.rawFunction);
+            for (uint8_t i = 0; i < bms.rawLength; i++)
+                r.push_back(i);
+            reply(bus, bms, r);
+            return;
+        }
+        uint16_t start = (f[2] << 8) | f[3];
+        uint16_t count = (f[4] << 8) | f[5];
+        if (bms.replyRegs && count > bms.replyRegs)
+            count = bms.replyRegs;
+        r.push_back(0x03);
+        r.push_back((count * 2) & 0xFF);
+        for (uint16_t i = 0; i < count; i++)
+        {
+            uint16_t reg = start + i;
+            uint16_t v = reg < HOST_BMS_REGS ? bms.regs[reg] : 0;
+            r.push_back(v >> 8);
+            r.push_back(v & 0xFF);
+        }
+
+        // Registre altéré : octet bas de sa valeur (après l'adresse, la fonction et le nombre d'octets)
+        size_t corruptAt = 0;
+        if (bms.corruptReg && bms.corruptReg >= start && bms.corruptReg < start + count)
+        {
+            corruptAt = 3 + (bms.corruptReg - start) * 2 + 2;
+            if (bms.corruptReplies && --bms.corruptReplies == 0)
+                bms.corruptReg = 0;
+        }
+        reply(bus, bms, r, corruptAt);
+        return;
+    }
+
+    if (f[1] != 0x06 && f[1] != 0x10)
+        return;
+    if (bms.ackMode != HOST_ACK_EXCEPTION && !applyWrite(bms, f))
+        return;
+    switch (bms.ackMode)
+    {
+    case HOST_ACK_SILENT:
+        return;
+    case HOST_ACK_EXCEPTION:
+        r.push_back(f[1] | 0x80);
+        r.push_back(0x02); // Adresse de registre illégale
+        reply(bus, bms, r);
+        return;
+    case HOST_ACK_BAD_FUNCTION:
+        r.push_back(f[1] == 0x10 ? 0x06 : 0x10);
+        break;
+    default:
+        r.push_back(f[1]);
+        break;
+    }
+    for (int i = 2; i < 6; i++)
+        r.push_back(f[i]);
+    if (bms.ackMode == HOST_ACK_BAD_ECHO)
+        r[3] ^= 0x01;
+    reply(bus, bms, r);
+}
+
+void hostBmsStep()
+{
+    for (uint8_t i = 0; i < HOST_BUSES; i++)
+    {
+        HostBus &bus = buses[i];
+        if (bus.request.empty() || hostNowUs < bus.requestEndUs)
+            continue;
+        std::vector<uint8_t> frame;
+        frame.swap(bus.request);
+        handleRequest(bus, i, frame);
+    }
+}
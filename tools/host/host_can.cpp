@@ -0,0 +1,18 @@
+// Pilote CAN simulé au repos (host_can.h)
+
+#include "host_can.h"
+
+static bool idleWrite(const CanFrame &) { return true; }
+static uint32_t idleTxPending() { return 0; }
+static bool idleRead(CanFrame &) { return false; }
+
+static bool idleStatus(twai_status_info_t &info)
+{
+    memset(&info, 0, sizeof(info));
+    info.state = TWAI_STATE_RUNNING;
+    return true;
+}
+
+static bool idleOk() { return true; }
+
+CanDriver hostCanDriver = {idleWrite, idleTxPending, idleRead, idleStatus, idleOk, idleOk};
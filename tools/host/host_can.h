@@ -0,0 +1,16 @@
+// Pilote CAN simulé des tests (tools/can_*_test.cpp)
+//
+// Pilote au repos : toute trame est acceptée, rien n'est reçu, file
+// d'émission vide, contrôleur EN MARCHE. Un test remplace les seules
+// fonctions qu'il observe puis l'installe :
+//     hostCanDriver.write = recordFrame;
+//     setCanDriver(&hostCanDriver);
+
+#ifndef HOST_CAN_H
+#define HOST_CAN_H
+
+#include "CanBusManager.h"
+
+extern CanDriver hostCanDriver;
+
+#endif
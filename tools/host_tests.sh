@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compile et lance les tests hôte (tools/*_test.cpp) contre les modules du
+# dépôt, avec l'environnement simulé de tools/host.
+#
+# Usage (depuis la racine du dépôt) :
+#     sh tools/host_tests.sh            # tous les tests
+#     sh tools/host_tests.sh can        # ceux dont le nom contient "can"
+#     HOST_VERBOSE=1 sh tools/host_tests.sh modbus_transaction
+
+set -e
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/multi_bat_host_tests}
+mkdir -p "$OUT"
+
+SOURCES="ModbusManager.cpp PackManager.cpp CellStats.cpp TraceManager.cpp LimitManager.cpp CanBusManager.cpp
+         tools/host/host_arduino.cpp tools/host/host_bms.cpp tools/host/host_can.cpp"
+
+status=0
+for test in tools/*_test.cpp; do
+    name=$(basename "$test" .cpp)
+    case "$name" in *"$1"*) ;; *) continue ;; esac
+    flags=$(sed -n 's|^// Options: ||p' "$test")
+    $CXX -std=gnu++11 -O1 -Wall -Wno-unused-function -Itools/host -I. $flags -o "$OUT/$name" "$test" $SOURCES
+    "$OUT/$name" || status=1
+done
+exit $status
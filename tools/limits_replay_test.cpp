@@ -0,0 +1,228 @@
+// Test hôte du moteur de limites : traces rejouées par updatePackBattery
+// puis updateLimits, sans Modbus ni CAN.
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh limits_replay
+//
+// 3 batteries de 150 A (LIMIT_BATTERY_*_CURRENT_A), consignes à 600 A, pack
+// à 51.2 V. La trace fait monter une cellule jusqu'à la pleine charge, refroidit
+// un capteur, ouvre des MOSFET, vide un SOC. À chaque événement : cible, cause
+// et batterie limitante attendues (facteurs des courbes calculés à la main),
+// CVL tenue à la tension du pack dès LIMIT_CELL_FULL_MV. Sur toute la trace :
+// baisse appliquée au même appel, hausse d'au plus 5 A par seconde.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+#include "PackManager.h"
+#include "LimitManager.h"
+#include "CanBusManager.h"
+
+#define BATTERIES 3
+#define PACK_VOLTAGE_DV 512
+#define FULL_BANK_DA 4500 // 3 x 150 A, sous la consigne de 600 A
+
+enum TraceField
+{
+    TRACE_CELL_MAX,         // mV de la cellule 0
+    TRACE_TEMP,             // 0.1 °C du capteur 0
+    TRACE_SOC,              // Brut, 1000 = 100 %
+    TRACE_CHARGE_MOSFET     // 0 = ouvert
+};
+
+struct TraceEvent
+{
+    unsigned long ms;
+    uint8_t id;
+    uint8_t field; // TraceField
+    int16_t value;
+};
+
+// Résultat attendu après le dernier événement de l'instant
+struct TraceExpect
+{
+    unsigned long ms;
+    uint16_t chargeTargetDa;
+    uint8_t chargeReason;
+    uint8_t chargeLimiterId;
+    uint16_t dischargeTargetDa;
+    uint8_t dischargeReason;
+    uint16_t chargeVoltageDv;
+};
+
+static const TraceEvent TRACE[] = {
+    {100000, 2, TRACE_CELL_MAX, 3430}, // Facteur 180/256
+    {110000, 2, TRACE_CELL_MAX, 3480}, // 74
+    {120000, 2, TRACE_CELL_MAX, 3520}, // 23
+    {130000, 2, TRACE_CELL_MAX, 3549}, // 1
+    {140000, 2, TRACE_CELL_MAX, 3550}, // 0, cellule pleine
+    {150000, 2, TRACE_CELL_MAX, 3350},
+    {250000, 1, TRACE_TEMP, 30}, // 3 °C : charge 30/256, décharge intacte
+    {260000, 1, TRACE_TEMP, 250},
+    {350000, 3, TRACE_CHARGE_MOSFET, 0},
+    {360000, 1, TRACE_CHARGE_MOSFET, 0},
+    {360000, 2, TRACE_CHARGE_MOSFET, 0},
+    {370000, 1, TRACE_CHARGE_MOSFET, 1},
+    {370000, 2, TRACE_CHARGE_MOSFET, 1},
+    {370000, 3, TRACE_CHARGE_MOSFET, 1},
+    {380000, 1, TRACE_SOC, 80}, // 8 % : décharge 38/256
+};
+
+static const TraceExpect EXPECTS[] = {
+    {100000, FULL_BANK_DA * 180 / 256, LIMIT_CELL_VOLTAGE, 2, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {110000, FULL_BANK_DA * 74 / 256, LIMIT_CELL_VOLTAGE, 2, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {120000, FULL_BANK_DA * 23 / 256, LIMIT_CELL_VOLTAGE, 2, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {130000, FULL_BANK_DA * 1 / 256, LIMIT_CELL_VOLTAGE, 2, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {140000, 0, LIMIT_CELL_VOLTAGE, 2, FULL_BANK_DA, LIMIT_RATED, PACK_VOLTAGE_DV},
+    {150000, FULL_BANK_DA, LIMIT_RATED, 0, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {250000, FULL_BANK_DA * 30 / 256, LIMIT_TEMPERATURE, 1, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {260000, FULL_BANK_DA, LIMIT_RATED, 0, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {350000, 2 * 1500, LIMIT_RATED, 0, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {360000, 0, LIMIT_MOSFET, 0, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {370000, FULL_BANK_DA, LIMIT_RATED, 0, FULL_BANK_DA, LIMIT_RATED, LIMIT_CHARGE_VOLTAGE_DV},
+    {380000, FULL_BANK_DA, LIMIT_RATED, 0, FULL_BANK_DA * 38 / 256, LIMIT_SOC, LIMIT_CHARGE_VOLTAGE_DV},
+};
+
+#define TRACE_END_MS 400000
+#define SLEW_WINDOW_MS 1000
+
+// ——————— BATTERIES SIMULÉES ———————
+
+static void initBattery(uint8_t id)
+{
+    int8_t slot = registerBattery(id, 0);
+    BatteryData &battery = batteries[slot];
+    battery.batteryId = id;
+    battery.socRaw = 600;
+    battery.voltageDv = PACK_VOLTAGE_DV;
+    battery.currentDa = 0;
+    uint16_t *cells = getBatteryCellsMv(battery);
+    for (uint8_t i = 0; i < 16; i++)
+        cells[i] = 3300 + i;
+    battery.validCells = 16;
+    battery.tempValidMask = 0x03;
+    battery.validTemps = 2;
+    battery.temperaturesDc[0] = battery.temperaturesDc[1] = 250;
+    setBatteryFlag(battery, BATTERY_FLAG_DATA_VALID, true);
+    setBatteryFlag(battery, BATTERY_FLAG_CHARGE_MOSFET, true);
+    setBatteryFlag(battery, BATTERY_FLAG_DISCHARGE_MOSFET, true);
+}
+
+static void applyEvent(const TraceEvent &event)
+{
+    int8_t slot = getBatterySlot(event.id);
+    BatteryData &battery = batteries[slot];
+    switch (event.field)
+    {
+    case TRACE_CELL_MAX:
+        getBatteryCellsMv(battery)[0] = event.value;
+        break;
+    case TRACE_TEMP:
+        battery.temperaturesDc[0] = event.value;
+        break;
+    case TRACE_SOC:
+        battery.socRaw = event.value;
+        break;
+    case TRACE_CHARGE_MOSFET:
+        setBatteryFlag(battery, BATTERY_FLAG_CHARGE_MOSFET, event.value);
+        break;
+    }
+    updatePackBattery(slot, event.field == TRACE_CELL_MAX, event.field == TRACE_TEMP);
+}
+
+// ——————— REJEU ———————
+
+static const char *reasonName(uint8_t reason)
+{
+    static const char *names[] = {"aucun", "cellule", "température", "SOC", "MOSFET", "sans données", "nominal",
+                                  "partage"};
+    return reason < sizeof(names) / sizeof(names[0]) ? names[reason] : "?";
+}
+
+static void checkExpect(const TraceExpect &expect)
+{
+    const PackLimits &limits = getPackLimits();
+    hostCheck(limits.chargeTargetDa == expect.chargeTargetDa && limits.chargeReason == expect.chargeReason &&
+                  limits.chargeLimiterId == expect.chargeLimiterId,
+              "t=%lus charge : cible %u dA (%u), cause %s (%s), ID %u", expect.ms / 1000, limits.chargeTargetDa,
+              expect.chargeTargetDa, reasonName(limits.chargeReason), reasonName(expect.chargeReason),
+              limits.chargeLimiterId);
+    hostCheck(limits.dischargeTargetDa == expect.dischargeTargetDa && limits.dischargeReason == expect.dischargeReason,
+              "t=%lus décharge : cible %u dA (%u), cause %s (%s)", expect.ms / 1000, limits.dischargeTargetDa,
+              expect.dischargeTargetDa, reasonName(limits.dischargeReason), reasonName(expect.dischargeReason));
+    hostCheck(limits.chargeVoltageDv == expect.chargeVoltageDv, "t=%lus CVL %u dV (%u)", expect.ms / 1000,
+              limits.chargeVoltageDv, expect.chargeVoltageDv);
+}
+
+int main()
+{
+    hostResetBms();
+    initModbus(hostSerial(0));
+    setChargeCurrentSetpoint(MAX_CHARGE_CURRENT_A);
+    setDischargeCurrentSetpoint(MAX_DISCHARGE_CURRENT_A);
+    updateLimits(); // Pack vide : point de départ de la pente
+
+    hostAdvanceMs(1000);
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        initBattery(id);
+        updatePackBattery(getBatterySlot(id), true, true);
+    }
+
+    // Sorties des SLEW_WINDOW_MS dernières millisecondes (hausse sur une fenêtre)
+    static uint16_t chargeHistory[SLEW_WINDOW_MS];
+    static uint16_t dischargeHistory[SLEW_WINDOW_MS];
+    uint16_t previousCharge = 0, previousDischarge = 0;
+    uint32_t slewViolations = 0, lateDecreases = 0;
+    unsigned long rampStartMs = millis(), rampDoneMs = 0;
+    size_t event = 0, expect = 0;
+
+    const unsigned long start = millis();
+    for (unsigned long ms = 0; ms + start < TRACE_END_MS; ms++)
+    {
+        unsigned long now = millis();
+        while (event < sizeof(TRACE) / sizeof(TRACE[0]) && TRACE[event].ms == now)
+            applyEvent(TRACE[event++]);
+        updateLimits();
+
+        const PackLimits &limits = getPackLimits();
+        if (expect < sizeof(EXPECTS) / sizeof(EXPECTS[0]) && EXPECTS[expect].ms == now)
+            checkExpect(EXPECTS[expect++]);
+
+        // Baisse : la sortie rejoint la cible au même appel
+        if ((limits.chargeTargetDa < previousCharge && limits.chargeCurrentDa != limits.chargeTargetDa) ||
+            (limits.dischargeTargetDa < previousDischarge && limits.dischargeCurrentDa != limits.dischargeTargetDa))
+            lateDecreases++;
+
+        // Hausse : au plus LIMIT_SLEW_UP_DA_PER_S sur toute fenêtre d'une seconde
+        uint16_t &chargeBefore = chargeHistory[now % SLEW_WINDOW_MS];
+        uint16_t &dischargeBefore = dischargeHistory[now % SLEW_WINDOW_MS];
+        if (ms >= SLEW_WINDOW_MS && (limits.chargeCurrentDa > chargeBefore + LIMIT_SLEW_UP_DA_PER_S ||
+                                     limits.dischargeCurrentDa > dischargeBefore + LIMIT_SLEW_UP_DA_PER_S))
+            slewViolations++;
+        chargeBefore = limits.chargeCurrentDa;
+        dischargeBefore = limits.dischargeCurrentDa;
+
+        // Remontée après la cellule pleine : durée de la rampe 0 -> pleine cible
+        if (now == 150000)
+            rampStartMs = now;
+        if (now > 150000 && !rampDoneMs && limits.chargeCurrentDa == FULL_BANK_DA)
+            rampDoneMs = now;
+        if (now == 100000)
+            hostCheck(previousCharge == FULL_BANK_DA && previousDischarge == FULL_BANK_DA,
+                      "rampe de démarrage terminée avant la trace (%u / %u dA)", previousCharge, previousDischarge);
+
+        previousCharge = limits.chargeCurrentDa;
+        previousDischarge = limits.dischargeCurrentDa;
+        hostAdvanceMs(1);
+    }
+
+    hostCheck(event == sizeof(TRACE) / sizeof(TRACE[0]) && expect == sizeof(EXPECTS) / sizeof(EXPECTS[0]),
+              "trace rejouée en entier");
+    hostCheck(lateDecreases == 0, "baisses appliquées au même appel (%lu en retard)", (unsigned long)lateDecreases);
+    hostCheck(slewViolations == 0, "hausse d'au plus %d dA par seconde (%lu dépassements)", LIMIT_SLEW_UP_DA_PER_S,
+              (unsigned long)slewViolations);
+    unsigned long expectedRampMs = FULL_BANK_DA * 1000UL / LIMIT_SLEW_UP_DA_PER_S;
+    hostCheck(rampDoneMs && rampDoneMs - rampStartMs >= expectedRampMs - 1 && rampDoneMs - rampStartMs <= expectedRampMs + 1,
+              "0 -> %d A en %lu ms (attendu %lu ms)", FULL_BANK_DA / 10, rampDoneMs - rampStartMs, expectedRampMs);
+    return hostReport("limits_replay_test");
+}
@@ -0,0 +1,175 @@
+// Test hôte du partage de courant et de la perte d'une batterie dans le
+// moteur de limites (measureSharing, filterSharing, nominal du banc).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh limits_sharing
+//
+// 3 batteries de 150 A, consignes à 600 A, relues à tour de rôle toutes les
+// 100 ms (updatePackBattery puis updateLimits). Vérifie : nominal du banc
+// pris de la config (aucun registre de réglage par défaut) ; partage
+// 150/100/50 A mesuré à 170/256 (la batterie à 150 A fixe le banc à 300 A),
+// lissé sur 1/8 par publication sans dépasser la mesure ; facteur conservé
+// sous LIMIT_SHARING_MIN_DA ; retour à 256 sur un partage équilibré ; une
+// batterie hors ligne retire aussitôt son nominal, et sa reprise remonte en
+// pente.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+#include "PackManager.h"
+#include "LimitManager.h"
+#include "CanBusManager.h"
+
+#define BATTERIES 3
+#define BATTERY_RATED_DA (LIMIT_BATTERY_DISCHARGE_CURRENT_A * 10)
+#define POLL_PERIOD_MS 100
+
+static uint8_t nextSlot = 0;
+
+static void initBattery(uint8_t id)
+{
+    int8_t slot = registerBattery(id, 0);
+    BatteryData &battery = batteries[slot];
+    battery.batteryId = id;
+    battery.socRaw = 600;
+    battery.voltageDv = 530;
+    battery.currentDa = 0;
+    uint16_t *cells = getBatteryCellsMv(battery);
+    for (uint8_t i = 0; i < 16; i++)
+        cells[i] = 3300 + i;
+    battery.tempValidMask = 0x03;
+    battery.validTemps = 2;
+    battery.temperaturesDc[0] = battery.temperaturesDc[1] = 250;
+    setBatteryFlag(battery, BATTERY_FLAG_DATA_VALID, true);
+    setBatteryFlag(battery, BATTERY_FLAG_CHARGE_MOSFET, true);
+    setBatteryFlag(battery, BATTERY_FLAG_DISCHARGE_MOSFET, true);
+    updatePackBattery(slot, true, true);
+}
+
+static void setCurrents(int16_t b1, int16_t b2, int16_t b3)
+{
+    batteries[getBatterySlot(1)].currentDa = b1;
+    batteries[getBatterySlot(2)].currentDa = b2;
+    batteries[getBatterySlot(3)].currentDa = b3;
+}
+
+// Relecture d'une batterie (à tour de rôle) puis recalcul des limites
+static void poll()
+{
+    updatePackBattery(nextSlot, false, false);
+    nextSlot = (nextSlot + 1) % batteryCount;
+    updateLimits();
+    hostAdvanceMs(POLL_PERIOD_MS);
+}
+
+static void runPolls(unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+        poll();
+}
+
+static void testRatedFromConfig()
+{
+    // Pente de démarrage complète : 450 A à 5 A/s
+    runPolls(BATTERIES * BATTERY_RATED_DA * 1000UL / LIMIT_SLEW_UP_DA_PER_S / POLL_PERIOD_MS + 10);
+    const PackLimits &limits = getPackLimits();
+    hostCheck(limits.ratedFromSettings == 0, "nominal pris de la config pour toutes les batteries");
+    hostCheck(limits.dischargeRatedDa == BATTERIES * BATTERY_RATED_DA &&
+                  limits.chargeRatedDa == BATTERIES * LIMIT_BATTERY_CHARGE_CURRENT_A * 10,
+              "nominal du banc %u / %u dA", limits.chargeRatedDa, limits.dischargeRatedDa);
+    hostCheck(limits.dischargeSharing == LIMIT_FACTOR_ONE && limits.dischargeReason == LIMIT_RATED &&
+                  limits.dischargeCurrentDa == limits.dischargeRatedDa,
+              "sans courant : partage 256, DCL au nominal (%u dA)", limits.dischargeCurrentDa);
+}
+
+static void testUnbalancedSharing()
+{
+    // 150/100/50 A : la batterie 1 atteint son nominal quand le banc débite
+    // 150 × 300 / 150 = 300 A, soit 300/450 du nominal = 170/256
+    setCurrents(1500, 1000, 500);
+    const uint16_t measured = 3000 * LIMIT_FACTOR_ONE / (BATTERIES * BATTERY_RATED_DA);
+    const PackLimits &limits = getPackLimits();
+
+    poll();
+    uint16_t first = limits.dischargeSharing;
+    hostCheck(first == 245, "première publication : 256 -> %u (lissage 1/8)", first);
+
+    uint16_t previous = first;
+    bool monotonic = true;
+    unsigned polls = 1;
+    while (limits.dischargeSharing != measured && polls < 200)
+    {
+        poll();
+        polls++;
+        monotonic = monotonic && limits.dischargeSharing <= previous && limits.dischargeSharing >= measured;
+        previous = limits.dischargeSharing;
+    }
+    hostCheck(limits.dischargeSharing == measured, "partage convergé à %u/256 en %u publications", measured, polls);
+    hostCheck(monotonic, "décroissance monotone, sans dépasser la mesure");
+    hostCheck(limits.dischargeTargetDa == BATTERIES * BATTERY_RATED_DA * measured / LIMIT_FACTOR_ONE &&
+                  limits.dischargeReason == LIMIT_SHARING,
+              "DCL %u dA, cause partage", limits.dischargeTargetDa);
+    hostCheck(limits.dischargeCurrentDa == limits.dischargeTargetDa, "baisse appliquée sans pente");
+    hostCheck(limits.chargeSharing == LIMIT_FACTOR_ONE, "charge sans courant : partage intact");
+
+    // Courant trop faible pour juger : dernier facteur conservé
+    setCurrents(40, 30, 20);
+    runPolls(30);
+    hostCheck(limits.dischargeSharing == measured, "sous %d dA : facteur conservé (%u)", LIMIT_SHARING_MIN_DA,
+              limits.dischargeSharing);
+
+    // Partage équilibré : retour au nominal complet
+    setCurrents(1000, 1000, 1000);
+    runPolls(200);
+    hostCheck(limits.dischargeSharing == LIMIT_FACTOR_ONE && limits.dischargeReason == LIMIT_RATED,
+              "partage équilibré : retour à 256");
+}
+
+static void testBatteryDrop()
+{
+    // Batterie 3 hors ligne (comme ModbusManager : donnée invalide, republiée)
+    const PackLimits &limits = getPackLimits();
+    runPolls(2000); // Pente remontée après le partage
+    hostCheck(limits.dischargeCurrentDa == BATTERIES * BATTERY_RATED_DA, "DCL au nominal du banc avant la perte");
+
+    BatteryData &battery = batteries[getBatterySlot(3)];
+    setBatteryFlag(battery, BATTERY_FLAG_DATA_VALID, false);
+    updatePackBattery(getBatterySlot(3), false, false);
+    updateLimits();
+    hostCheck(getPackSnapshot().onlineCount == BATTERIES - 1, "%u batteries comptées", getPackSnapshot().onlineCount);
+    hostCheck(limits.dischargeRatedDa == (BATTERIES - 1) * BATTERY_RATED_DA &&
+                  limits.dischargeTargetDa == (BATTERIES - 1) * BATTERY_RATED_DA,
+              "nominal %u dA, cible %u dA", limits.dischargeRatedDa, limits.dischargeTargetDa);
+    hostCheck(limits.dischargeCurrentDa == limits.dischargeTargetDa, "DCL réduite à la même publication");
+
+    // Les deux restantes portent le courant : partage toujours équilibré
+    setCurrents(1500, 1500, 0);
+    runPolls(50);
+    hostCheck(limits.dischargeSharing == LIMIT_FACTOR_ONE && limits.dischargeTargetDa == (BATTERIES - 1) * BATTERY_RATED_DA,
+              "batterie absente hors du partage (%u/256)", limits.dischargeSharing);
+
+    // Retour : nominal rétabli aussitôt, sortie remontée en pente
+    setBatteryFlag(battery, BATTERY_FLAG_DATA_VALID, true);
+    setCurrents(1000, 1000, 1000);
+    uint16_t before = limits.dischargeCurrentDa;
+    runPolls(10);
+    hostCheck(limits.dischargeTargetDa == BATTERIES * BATTERY_RATED_DA, "batterie revenue : cible %u dA",
+              limits.dischargeTargetDa);
+    hostCheck(limits.dischargeCurrentDa > before &&
+                  limits.dischargeCurrentDa <= before + LIMIT_SLEW_UP_DA_PER_S * 10 * POLL_PERIOD_MS / 1000,
+              "remontée en pente (%u -> %u dA en 1 s)", before, limits.dischargeCurrentDa);
+}
+
+int main()
+{
+    hostResetBms();
+    initModbus(hostSerial(0));
+    setChargeCurrentSetpoint(MAX_CHARGE_CURRENT_A);
+    setDischargeCurrentSetpoint(MAX_DISCHARGE_CURRENT_A);
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+        initBattery(id);
+
+    testRatedFromConfig();
+    testUnbalancedSharing();
+    testBatteryDrop();
+    return hostReport("limits_sharing_test");
+}
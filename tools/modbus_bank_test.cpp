@@ -0,0 +1,73 @@
+// Test hôte de la commande MOSFET groupée (setBankMosfets).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_bank
+//
+// Configuration par défaut (MODBUS_MOSFET_BROADCAST 0) : une demande de
+// broadcast repasse en écritures individuelles, aucune trame n'est émise à
+// l'adresse 0x00, chaque batterie acquitte sa commande ; une batterie muette
+// finit en échec après MODBUS_MOSFET_RETRIES tentatives.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+
+#define BATTERIES 3
+
+static void runUntilSettled(unsigned long limitMs)
+{
+    for (unsigned long ms = 0; ms < limitMs && isBankMosfetCommandPending(); ms++)
+    {
+        updateModbusPolling();
+        hostAdvanceMs(1);
+    }
+}
+
+static void testBroadcastDisabled()
+{
+    hostCheck(setBankMosfets(false, false, MOSFET_DISPATCH_BROADCAST), "commande acceptée");
+    const BankMosfetCommand *command = getBankMosfetCommand();
+    hostCheck(command->mode == MOSFET_DISPATCH_PIPELINED, "broadcast désactivé : envoi par adresse");
+
+    runUntilSettled(2000);
+    hostCheck(!isBankMosfetCommandPending(), "commande terminée");
+    hostCheck(hostBroadcasts[0] == 0, "aucune trame à l'adresse 0x00");
+    hostCheck(command->confirmedMask == command->targetMask && __builtin_popcount(command->targetMask) == BATTERIES,
+              "%d/%d batteries confirmées", __builtin_popcount(command->confirmedMask), BATTERIES);
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        hostCheck(hostBms[id].regs[0x52] == 0 && hostBms[id].regs[0x53] == 0, "ID %d : MOSFET ouverts", id);
+    }
+}
+
+static void testSilentBattery()
+{
+    hostBms[2].ackMode = HOST_ACK_SILENT;
+    setBankMosfets(true, true);
+    runUntilSettled(5000);
+    const BankMosfetCommand *command = getBankMosfetCommand();
+    uint32_t bit = 1UL << getBatterySlot(2);
+    hostCheck(!isBankMosfetCommandPending(), "commande terminée malgré une batterie muette");
+    hostCheck(command->failedMask == bit, "seule la batterie muette en échec");
+    hostCheck(command->attempts[getBatterySlot(2)] == MODBUS_MOSFET_RETRIES, "%d tentatives",
+              command->attempts[getBatterySlot(2)]);
+    hostCheck(hostBms[1].regs[0x52] == 1 && hostBms[3].regs[0x53] == 1, "autres batteries commandées");
+}
+
+int main()
+{
+    hostResetBms();
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+        hostAddBms(id, 0);
+    initModbus(hostSerial(0));
+    setModbusPollingEnabled(true);
+    for (unsigned long ms = 0; ms < 20000 && getOnlineBatteryCount() < BATTERIES; ms++)
+    {
+        updateModbusPolling();
+        hostAdvanceMs(1);
+    }
+    hostCheck(getOnlineBatteryCount() == BATTERIES, "%d batteries en ligne", getOnlineBatteryCount());
+
+    testBroadcastDisabled();
+    testSilentBattery();
+    return hostReport("modbus_bank_test");
+}
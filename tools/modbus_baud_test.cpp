@@ -0,0 +1,157 @@
+// Test hôte de la négociation de vitesse (negotiateModbusBaud) et du repli
+// sur MODBUS_BAUD après MODBUS_BAUD_FALLBACK_ERRORS erreurs d'affilée.
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_baud
+//
+// BMS simulés plafonnés en vitesse (HostBms.maxBaud : au-delà, la requête est
+// illisible). Vérifie : première installation sans batterie connue, vitesse
+// négociée à la fin de la première passe de découverte ; vitesse retenue = la
+// plus rapide acceptée par toutes, enregistrée en NVS ; une batterie limitée
+// à 9600 bauds fixe le bus à 9600 ; une batterie débranchée (simples
+// timeouts) ne déclenche pas le repli ; des erreurs CRC ou des timeouts sur
+// toutes les batteries ramènent le bus à 9600, enregistré, et le polling
+// reprend.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+#include <Preferences.h>
+
+static unsigned long storedBaud()
+{
+    Preferences prefs;
+    prefs.begin("modbus", true);
+    unsigned long baud = prefs.getUInt("baud0", 0);
+    prefs.end();
+    return baud;
+}
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        hostAdvanceMs(1);
+    }
+}
+
+static void startFresh()
+{
+    // Première installation : NVS vide, aucune batterie connue
+    hostClearPreferences();
+    hostResetBms();
+    resetBatteryRegistry();
+    initModbus(hostSerial(0));
+}
+
+static void testFreshInstall()
+{
+    startFresh();
+    hostAddBms(1, 0);
+    hostAddBms(2, 0);
+    hostAddBms(3, 0);
+    hostBms[2].maxBaud = 38400;
+
+    // Au démarrage rien n'est découvert : pas de négociation, rien d'enregistré
+    negotiateUnsetModbusBauds();
+    hostCheck(hostBusBaud(0) == MODBUS_BAUD && storedBaud() == 0, "démarrage sans batterie : %lu bauds, rien d'enregistré",
+              hostBusBaud(0));
+
+    setModbusPollingEnabled(true);
+    runLoop(60000);
+    hostCheck(getBusStats(0) && getOnlineBatteryCount() == 3, "3 batteries découvertes");
+    hostCheck(hostBusBaud(0) == 38400 && getModbusBaud(0) == 38400, "vitesse négociée après découverte : %lu bauds",
+              hostBusBaud(0));
+    hostCheck(storedBaud() == 38400, "vitesse enregistrée (%lu)", storedBaud());
+
+    // Négociée une seule fois : les passes suivantes n'y reviennent pas
+    uint32_t requests = hostBms[2].requests;
+    runLoop(MODBUS_SCAN_PERIOD_MS + 10000);
+    hostCheck(getOnlineBatteryCount() == 3 && hostBusBaud(0) == 38400, "polling à 38400 bauds, pas de nouvelle négociation");
+    hostCheck(hostBms[2].requests > requests, "ID 2 toujours interrogée");
+}
+
+static void testSlowBatteryPinsBus()
+{
+    startFresh();
+    hostAddBms(1, 0);
+    hostAddBms(2, 0);
+    hostBms[2].maxBaud = 9600;
+    registerBattery(1, 0);
+    registerBattery(2, 0);
+
+    unsigned long chosen = negotiateModbusBaud(0);
+    hostCheck(chosen == 9600 && hostBusBaud(0) == 9600 && storedBaud() == 9600,
+              "batterie limitée à 9600 : bus à %lu bauds, enregistré %lu", chosen, storedBaud());
+
+    hostBms[2].maxBaud = 0;
+    chosen = negotiateModbusBaud(0);
+    hostCheck(chosen == 115200 && storedBaud() == 115200, "sans limite : %lu bauds", chosen);
+}
+
+static void testUnpluggedBattery()
+{
+    // Vitesse négociée à 38400 (testFreshInstall), une batterie débranchée
+    startFresh();
+    for (uint8_t id = 1; id <= 3; id++)
+    {
+        hostAddBms(id, 0);
+        registerBattery(id, 0);
+    }
+    setModbusBaud(0, 38400, true);
+    runLoop(5000);
+    hostCheck(getOnlineBatteryCount() == 3, "3 batteries en ligne à 38400 bauds");
+
+    hostBms[3].present = false;
+    runLoop(60000);
+    hostCheck(getBatteryLinkState(3) == LINK_OFFLINE, "ID 3 hors ligne");
+    hostCheck(hostBusBaud(0) == 38400 && storedBaud() == 38400, "timeouts d'une seule batterie : bus gardé à %lu bauds",
+              hostBusBaud(0));
+    hostBms[3].present = true;
+    runLoop(MODBUS_BACKOFF_MAX_MS + 5000);
+}
+
+static void testFallback(const char *label, bool corrupt)
+{
+    setModbusBaud(0, 38400, true);
+    runLoop(5000);
+    uint32_t errors = getStatsErrorCount(*getBusStats(0));
+    hostCheck(getOnlineBatteryCount() == 3 && hostBusBaud(0) == 38400, "%s : 3 batteries en ligne à 38400 bauds", label);
+
+    // Liaison dégradée au-delà de 19200 bauds, pour toutes les batteries
+    for (uint8_t id = 1; id <= 3; id++)
+    {
+        if (corrupt)
+            hostBms[id].corruptByte = 4;
+        else
+            hostBms[id].maxBaud = 19200;
+    }
+    unsigned long start = millis();
+    while (hostBusBaud(0) != MODBUS_BAUD && millis() - start < 10000)
+        runLoop(1);
+    errors = getStatsErrorCount(*getBusStats(0)) - errors;
+    hostCheck(hostBusBaud(0) == MODBUS_BAUD && storedBaud() == MODBUS_BAUD, "%s : repli à %lu bauds, enregistré",
+              label, hostBusBaud(0));
+    hostCheck(errors >= MODBUS_BAUD_FALLBACK_ERRORS && errors <= MODBUS_BAUD_FALLBACK_ERRORS + 1,
+              "%s : repli après %lu erreurs", label, (unsigned long)errors);
+
+    // À 9600 les réponses repassent : toutes de retour en ligne
+    for (uint8_t id = 1; id <= 3; id++)
+    {
+        hostBms[id].corruptByte = 0;
+        if (!corrupt)
+            hostBms[id].maxBaud = 0;
+    }
+    runLoop(MODBUS_BACKOFF_MAX_MS + 5000);
+    hostCheck(getOnlineBatteryCount() == 3 && hostBusBaud(0) == MODBUS_BAUD, "%s : polling repris à 9600 bauds", label);
+}
+
+int main()
+{
+    testFreshInstall();
+    testSlowBatteryPinsBus();
+    testUnpluggedBattery();
+    testFallback("CRC", true);
+    testFallback("timeouts", false);
+    return hostReport("modbus_baud_test");
+}
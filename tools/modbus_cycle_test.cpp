@@ -0,0 +1,76 @@
+// Banc hôte du cycle de polling rapide (réception double tampon, décodage
+// pendant la pause entre requêtes).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_cycle
+//
+// 9 batteries sur un bus à 9600 bauds, 20 ms de retournement BMS, chaque
+// caractère écrit sur Serial coûte son temps à 115200 bauds (hostSerialCost).
+// Affiche la durée du balayage rapide face à son plancher (temps fil +
+// retournements + pauses inter-requêtes) et vérifie que le décodage n'y
+// ajoute rien : aucun caractère écrit sur Serial en régime établi, au plus
+// une milliseconde de scrutation de loop() par transaction. Les réponses
+// refusées du polling vont aux statistiques et à la trace, pas sur Serial.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+
+#define BATTERIES 9
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        hostAdvanceMs(1);
+    }
+}
+
+int main()
+{
+    hostResetBms();
+    initModbus(hostSerial(0));
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        hostAddBms(id, 0);
+        registerBattery(id, 0);
+    }
+    setModbusPollingEnabled(true);
+    hostSerialCost = true;
+
+    // Premières lectures et réglages, puis régime établi
+    runLoop(30000);
+    hostCheck(getOnlineBatteryCount() == BATTERIES, "%d batteries en ligne", getOnlineBatteryCount());
+
+    uint32_t bytesBefore = hostSerialBytes;
+    runLoop(10000);
+    uint32_t printed = hostSerialBytes - bytesBefore;
+
+    const PollTierState *fast = getPollTierState(0, TIER_FAST);
+    unsigned long transactions = (unsigned long)BATTERIES * fast->paramCount;
+    unsigned long perTransactionUs = getPollTierWireTimeUs(0, TIER_FAST) / transactions +
+                                     hostBms[1].turnaroundUs + MODBUS_INTER_REQUEST_GAP_MS * 1000UL;
+    // Le balayage se mesure du départ de la première requête à celui de la dernière
+    unsigned long floorMs = (transactions - 1) * perTransactionUs / 1000;
+    printf("Balayage rapide %d batteries: %lu ms (plancher %lu ms, %lu transactions), "
+           "%lu caractères série en 10 s\n",
+           BATTERIES, fast->lastSweepDurationMs, floorMs, transactions, (unsigned long)printed);
+
+    hostCheck(printed == 0, "aucune écriture série pendant le polling (%lu caractères)", (unsigned long)printed);
+    hostCheck(fast->lastSweepDurationMs <= floorMs + transactions,
+              "balayage %lu ms au plus à une scrutation du plancher %lu ms", fast->lastSweepDurationMs, floorMs);
+
+    // Une batterie qui répond mal : causes comptées (statistiques, trace), pas écrites
+    const ModbusStats *stats = getBatteryStats(5);
+    uint32_t functionErrors = stats->functionErrors;
+    hostBms[5].rawFunction = 0x41;
+    hostBms[5].rawLength = 4;
+    bytesBefore = hostSerialBytes;
+    runLoop(5000);
+    printed = hostSerialBytes - bytesBefore;
+    hostCheck(stats->functionErrors > functionErrors, "%lu réponses refusées (fonction)",
+              (unsigned long)(stats->functionErrors - functionErrors));
+    hostCheck(printed <= strlen("Batterie ID=5 hors ligne\n"),
+              "seul le passage hors ligne est écrit (%lu caractères)", (unsigned long)printed);
+    return hostReport("modbus_cycle_test");
+}
@@ -0,0 +1,148 @@
+// Test hôte du suivi de liaison par batterie (recordBatteryResult, sondes
+// de re-connexion, données périmées).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_link
+//
+// Quatre BMS sur le bus 0, les ID 3 et 4 débranchés une fois le polling
+// établi. Vérifie : passage EN LIGNE → SUSPECTE → HORS LIGNE après
+// MODBUS_OFFLINE_AFTER_FAILURES échecs, la batterie suspecte restant
+// interrogée ; sondes réduites à une lecture de REG_HEARTBEAT seul, espacées
+// d'un intervalle doublé jusqu'à MODBUS_BACKOFF_MAX_MS ; balayage rapide
+// raccourci une fois les absentes sautées ; données invalidées au passage
+// hors ligne, et après MODBUS_DATA_STALE_MS sans rafraîchissement ; retour en
+// ligne à la première sonde répondue.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+
+#define REMOVED_ID 3
+
+static std::vector<BatteryLinkState> linkStates; // États successifs de REMOVED_ID
+static unsigned long offlineAt = 0;
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        BatteryLinkState state = getBatteryLinkState(REMOVED_ID);
+        if (linkStates.empty() || linkStates.back() != state)
+        {
+            linkStates.push_back(state);
+            if (state == LINK_OFFLINE)
+                offlineAt = millis();
+        }
+        hostAdvanceMs(1);
+    }
+}
+
+// Requêtes adressées à une batterie depuis l'instant donné
+static std::vector<HostRequest> requestsTo(uint8_t id, unsigned long sinceMs)
+{
+    std::vector<HostRequest> found;
+    for (const HostRequest &request : hostRequestLog)
+    {
+        if (request.id == id && request.us >= (uint64_t)sinceMs * 1000)
+            found.push_back(request);
+    }
+    return found;
+}
+
+static unsigned long sweepBeforeMs = 0;
+
+static void testRemoval()
+{
+    runLoop(20000);
+    hostCheck(getOnlineBatteryCount() == 4, "4 batteries en ligne au départ");
+    sweepBeforeMs = getPollTierState(0, TIER_FAST)->lastSweepDurationMs;
+
+    linkStates.clear();
+    unsigned long removedAt = millis();
+    hostBms[3].present = hostBms[4].present = false;
+    runLoop(5000);
+
+    hostCheck(linkStates.size() == 3 && linkStates[0] == LINK_ONLINE && linkStates[1] == LINK_SUSPECT &&
+                  linkStates[2] == LINK_OFFLINE,
+              "ID %d : en ligne, suspecte puis hors ligne (%u états)", REMOVED_ID, (unsigned)linkStates.size());
+    hostCheck(getOnlineBatteryCount() == 2, "2 batteries en ligne");
+
+    // Jusqu'au passage hors ligne, le polling normal continue (blocs complets)
+    unsigned polled = 0;
+    for (const HostRequest &request : requestsTo(REMOVED_ID, removedAt))
+    {
+        if (request.us < (uint64_t)offlineAt * 1000 && request.count > 1)
+            polled++;
+    }
+    hostCheck(polled >= MODBUS_OFFLINE_AFTER_FAILURES, "batterie suspecte toujours interrogée (%u lectures)", polled);
+    hostCheck(!isBatteryDataValid(REMOVED_ID), "données invalidées au passage hors ligne");
+}
+
+static void testBackoffProbes()
+{
+    runLoop(240000);
+
+    std::vector<HostRequest> probes = requestsTo(REMOVED_ID, offlineAt);
+    bool heartbeatOnly = !probes.empty();
+    for (const HostRequest &probe : probes)
+        heartbeatOnly = heartbeatOnly && probe.function == 0x03 && probe.start == REG_HEARTBEAT && probe.count == 1;
+    hostCheck(heartbeatOnly, "%u sondes, toutes en lecture de REG_HEARTBEAT seul", (unsigned)probes.size());
+
+    // Sonde k partie au plus tôt backoff(k) après l'échec précédent (timeout
+    // de la sonde), au plus tard après la fin d'un balayage rapide
+    unsigned long backoffMs = MODBUS_BACKOFF_MIN_MS;
+    unsigned long failedAt = offlineAt;
+    bool doubling = probes.size() >= 8;
+    for (size_t i = 0; doubling && i < probes.size(); i++)
+    {
+        unsigned long sentAt = (unsigned long)(probes[i].us / 1000);
+        unsigned long waitedMs = sentAt - failedAt;
+        doubling = hostCheck(waitedMs >= backoffMs && waitedMs <= backoffMs + sweepBeforeMs + 50,
+                             "sonde %u après %lu ms (intervalle %lu ms)", (unsigned)(i + 1), waitedMs, backoffMs);
+        failedAt = sentAt + MODBUS_PROBE_TIMEOUT_MS;
+        backoffMs = min(backoffMs * 2, (unsigned long)MODBUS_BACKOFF_MAX_MS);
+    }
+    hostCheck(doubling, "intervalles doublés jusqu'à %d ms", MODBUS_BACKOFF_MAX_MS);
+
+    unsigned long sweepAfterMs = getPollTierState(0, TIER_FAST)->lastSweepDurationMs;
+    hostCheck(sweepAfterMs * 3 < sweepBeforeMs * 2, "balayage rapide %lu -> %lu ms", sweepBeforeMs, sweepAfterMs);
+    hostCheck(getLinkTimeSavedMs() > 0, "temps de bus rendu : %lu ms", getLinkTimeSavedMs());
+}
+
+static void testReconnect()
+{
+    // Rebranchée : la prochaine sonde la remet en ligne, le polling reprend
+    hostBms[3].present = true;
+    runLoop(MODBUS_BACKOFF_MAX_MS + 5000);
+    hostCheck(getBatteryLinkState(REMOVED_ID) == LINK_ONLINE && isBatteryDataValid(REMOVED_ID),
+              "ID %d de retour en ligne, données valides", REMOVED_ID);
+}
+
+static void testStaleData()
+{
+    // Polling suspendu : les données restent valides jusqu'à MODBUS_DATA_STALE_MS
+    setModbusPollingEnabled(false);
+    unsigned long ageMs = millis() - batteries[getBatterySlot(1)].lastUpdate;
+    runLoop(MODBUS_DATA_STALE_MS - ageMs - 100);
+    hostCheck(isBatteryDataValid(1), "données valides %d ms après la dernière lecture", MODBUS_DATA_STALE_MS - 100);
+    runLoop(1000);
+    hostCheck(!isBatteryDataValid(1) && !isBatteryDataValid(2), "données périmées au-delà de %d ms",
+              MODBUS_DATA_STALE_MS);
+    hostCheck(getBatteryLinkState(1) == LINK_ONLINE, "liaison inchangée par la péremption");
+}
+
+int main()
+{
+    hostResetBms();
+    for (uint8_t id = 1; id <= 4; id++)
+        hostAddBms(id, 0);
+    hostLogRequests = true;
+    initModbus(hostSerial(0));
+    setModbusPollingEnabled(true);
+
+    testRemoval();
+    testBackoffProbes();
+    testReconnect();
+    testStaleData();
+    return hostReport("modbus_link_test");
+}
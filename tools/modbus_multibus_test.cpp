@@ -0,0 +1,96 @@
+// Test hôte du polling sur deux bus RS485 (MODBUS_BUS_COUNT 2).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_multibus
+//
+// Deux BMS par bus (ID 1-2 sur le bus 0, ID 3-4 sur le bus 1). Vérifie que la
+// découverte affecte chaque batterie à son bus, que chaque bus n'interroge que
+// ses batteries, que les deux bus travaillent en parallèle et que le balayage
+// rapide d'un bus ne s'allonge pas quand l'autre bus est actif.
+
+// Options: -DMODBUS_BUS_COUNT=2
+
+#include "host/host.h"
+#include "ModbusManager.h"
+
+#if MODBUS_BUS_COUNT != 2
+#error "modbus_multibus_test se compile avec -DMODBUS_BUS_COUNT=2"
+#endif
+
+// Laisse tourner loop() ; renvoie la part du temps d'occupation du bus 0 pendant
+// laquelle le bus 1 est aussi occupé (%)
+static int runLoop(unsigned long durationMs)
+{
+    unsigned long busyMs = 0;
+    unsigned long overlapMs = 0;
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        if (hostBusBusy(0))
+        {
+            busyMs++;
+            if (hostBusBusy(1))
+                overlapMs++;
+        }
+        hostAdvanceMs(1);
+    }
+    return busyMs ? overlapMs * 100 / busyMs : 0;
+}
+
+static void testDiscoveryAndPolling()
+{
+    int overlap = runLoop(20000);
+
+    const uint8_t expectedBus[] = {0, 0, 0, 1, 1};
+    for (uint8_t id = 1; id <= 4; id++)
+    {
+        int8_t slot = getBatterySlot(id);
+        hostCheck(slot >= 0 && batteryBusMap[slot] == expectedBus[id],
+                  "ID %d découverte sur le bus %d", id, slot >= 0 ? batteryBusMap[slot] : -1);
+        hostCheck(slot >= 0 && isBatteryDataValid(batteries[slot]), "ID %d lue", id);
+        hostCheck(hostBms[id].requests > 0, "ID %d interrogée (%u requêtes)", id, hostBms[id].requests);
+    }
+    hostCheck(getOnlineBatteryCount() == 4, "4 batteries en ligne");
+
+    // Chaque BMS ne voit que le bus où il est câblé : ses requêtes y passent toutes
+    hostCheck(hostBms[1].requests + hostBms[2].requests <= hostBusRequests[0] &&
+                  hostBms[3].requests + hostBms[4].requests <= hostBusRequests[1],
+              "requêtes reçues sur le bus de chaque batterie");
+    hostCheck(overlap > 50, "bus 1 occupé pendant %d %% de l'activité du bus 0", overlap);
+}
+
+static void testIndependentSweeps()
+{
+    // Même charge sur les deux bus : durées de balayage rapide comparables, et
+    // identiques à celles d'un bus seul (le bus 1 ne vole pas de temps au bus 0)
+    runLoop(5000);
+    unsigned long sweep0 = getPollTierState(0, TIER_FAST)->lastSweepDurationMs;
+    unsigned long sweep1 = getPollTierState(1, TIER_FAST)->lastSweepDurationMs;
+    hostCheck(sweep0 > 0 && sweep1 > 0, "balayages rapides mesurés (%lu / %lu ms)", sweep0, sweep1);
+
+    unsigned long wire0 = getPollTierWireTimeUs(0, TIER_FAST) / 1000;
+    hostCheck(sweep0 < wire0 * 2 + 2 * 2 * hostBms[1].turnaroundUs / 1000 + 20,
+              "balayage bus 0 %lu ms (temps fil %lu ms)", sweep0, wire0);
+
+    hostBms[3].present = hostBms[4].present = false; // Bus 1 silencieux
+    runLoop(5000);
+    unsigned long alone = getPollTierState(0, TIER_FAST)->lastSweepDurationMs;
+    hostCheck(alone + 5 >= sweep0 && sweep0 + 5 >= alone,
+              "balayage bus 0 inchangé par l'activité du bus 1 (%lu / %lu ms)", sweep0, alone);
+}
+
+int main()
+{
+    hostResetBms();
+    hostAddBms(1, 0);
+    hostAddBms(2, 0);
+    hostAddBms(3, 1);
+    hostAddBms(4, 1);
+    initModbus(hostSerial(0));
+    initModbusBus(1, hostSerial(1), MODBUS2_RX_PIN, MODBUS2_TX_PIN, MODBUS2_DE_RE_PIN);
+    setModbusPollingEnabled(true);
+
+    testDiscoveryAndPolling();
+    testIndependentSweeps();
+    return hostReport("modbus_multibus_test");
+}
@@ -0,0 +1,138 @@
+// Test hôte de la relecture partielle (file de relecture par bus,
+// MODBUS_RETRY_CHUNK_REGS).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_retry
+//
+// Lecture bloquante du bloc temps réel (128 registres) d'un BMS simulé qui
+// altère, coupe ou raccourcit sa réponse. Vérifie : trame corrompue relue par
+// morceaux de MODBUS_RETRY_CHUNK_REGS, un morceau qui passe n'est plus relu,
+// abandon après MODBUS_RETRY_MAX_ATTEMPTS ; réponse tronquée relue par
+// morceaux ; réponse incomplète (trame valide, moins de registres) : seuls
+// les registres manquants sont redemandés ; octets de relecture et coût en
+// blocs complets des statistiques du bus égaux aux octets passés sur le fil.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+#include <string>
+
+#define BLOCK_REGS (ADDR_REALTIME_END - ADDR_REALTIME_START + 1)
+#define CORRUPT_REG 70 // Dans le second morceau
+
+static ModbusStats before;
+
+static bool readBlock()
+{
+    hostRequestLog.clear();
+    before = *getBusStats(0);
+    return readBatteryData(1, DATA_REALTIME);
+}
+
+// Lectures passées sur le fil, "début/nombre" séparés par des espaces
+static std::string readsOnWire()
+{
+    std::string reads;
+    for (const HostRequest &request : hostRequestLog)
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%s%u/%u", reads.empty() ? "" : " ", request.start, request.count);
+        reads += text;
+    }
+    return reads;
+}
+
+// Octets requête + réponse des relectures (tout sauf la première requête)
+static uint32_t retryWireBytes()
+{
+    uint32_t bytes = 0;
+    for (size_t i = 1; i < hostRequestLog.size(); i++)
+        bytes += hostRequestLog[i].length + hostRequestLog[i].replyLength;
+    return bytes;
+}
+
+// Octets d'une lecture complète du bloc
+static uint32_t blockWireBytes()
+{
+    return 8 + 5 + BLOCK_REGS * 2;
+}
+
+static void checkCounters(const char *label, uint32_t retries, uint32_t wholeBlocks, uint32_t abandoned)
+{
+    const ModbusStats &stats = *getBusStats(0);
+    hostCheck(stats.retries - before.retries == retries && hostRequestLog.size() == retries + 1u,
+              "%s : %lu relectures comptées", label, (unsigned long)(stats.retries - before.retries));
+    hostCheck(stats.retryBytes - before.retryBytes == retryWireBytes(), "%s : %lu octets de relecture, %lu sur le fil",
+              label, (unsigned long)(stats.retryBytes - before.retryBytes), (unsigned long)retryWireBytes());
+    hostCheck(stats.wholeBlockBytes - before.wholeBlockBytes == wholeBlocks * blockWireBytes(),
+              "%s : coût en blocs complets %lu octets (%lu blocs)", label,
+              (unsigned long)(stats.wholeBlockBytes - before.wholeBlockBytes), (unsigned long)wholeBlocks);
+    hostCheck(stats.retryAbandoned - before.retryAbandoned == abandoned, "%s : %lu abandons", label,
+              (unsigned long)(stats.retryAbandoned - before.retryAbandoned));
+}
+
+static void testCleanRead()
+{
+    hostCheck(readBlock() && readsOnWire() == "0/128", "lecture intègre : une seule requête (%s)", readsOnWire().c_str());
+    hostCheck(hostRequestLog[0].length + hostRequestLog[0].replyLength == blockWireBytes(), "bloc complet : %lu octets",
+              (unsigned long)blockWireBytes());
+    checkCounters("intègre", 0, 0, 0);
+}
+
+static void testCorruptOnce()
+{
+    // CRC faux une fois : les deux morceaux relus, aucun deux fois
+    hostBms[1].corruptReg = CORRUPT_REG;
+    hostBms[1].corruptReplies = 1;
+    bool ok = readBlock();
+    hostCheck(ok && readsOnWire() == "0/128 0/64 64/64", "corruption passagère : %s", readsOnWire().c_str());
+    checkCounters("corruption passagère", 2, 1, 0);
+}
+
+static void testCorruptChunk()
+{
+    // Le second morceau reste corrompu : lui seul est relu, puis abandonné
+    hostBms[1].corruptReg = CORRUPT_REG;
+    hostBms[1].corruptReplies = 0;
+    bool ok = readBlock();
+    hostBms[1].corruptReg = 0;
+    hostCheck(!ok && readsOnWire() == "0/128 0/64 64/64 64/64", "morceau corrompu : %s", readsOnWire().c_str());
+    checkCounters("morceau corrompu", 3, 2, 1);
+}
+
+static void testTruncated()
+{
+    // Réponse coupée (les morceaux, plus courts, passent)
+    hostBms[1].truncateAfter = blockWireBytes() - 8 - 100;
+    bool ok = readBlock();
+    hostBms[1].truncateAfter = 0;
+    hostCheck(ok && readsOnWire() == "0/128 0/64 64/64", "réponse tronquée : %s", readsOnWire().c_str());
+    hostCheck(hostRequestLog[0].replyLength == blockWireBytes() - 8 - 100, "réponse coupée à %u octets",
+              hostRequestLog[0].replyLength);
+    checkCounters("réponse tronquée", 2, 1, 0);
+}
+
+static void testShortReply()
+{
+    // Trame valide de 100 registres : seuls les 28 manquants sont redemandés
+    hostBms[1].replyRegs = 100;
+    bool ok = readBlock();
+    hostBms[1].replyRegs = 0;
+    hostCheck(ok && readsOnWire() == "0/128 100/28", "réponse incomplète : %s", readsOnWire().c_str());
+    checkCounters("réponse incomplète", 1, 1, 0);
+}
+
+int main()
+{
+    hostResetBms();
+    hostAddBms(1, 0);
+    initModbus(hostSerial(0));
+    registerBattery(1, 0);
+    hostLogRequests = true;
+
+    testCleanRead();
+    testCorruptOnce();
+    testCorruptChunk();
+    testTruncated();
+    testShortReply();
+    return hostReport("modbus_retry_test");
+}
@@ -0,0 +1,172 @@
+// Test hôte du cache des réglages BMS (blocs SETTING1/2/3 gardés en RAM et en
+// NVS, espace "bmsset", clé "set<ID>", FNV-1a).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_settings
+//
+// Trois BMS aux réglages distincts. Vérifie : première lecture unique des
+// trois blocs par batterie, enregistrée ; après redémarrage (initModbus), des
+// réglages disponibles avant tout échange et aucune lecture de réglages sur le
+// bus ; relecture de la seule batterie concernée quand son identité change
+// (nombre de cellules) ou que son heartbeat recule ; enregistrement NVS
+// corrompu (hash faux) écarté au démarrage puis relu.
+
+#include "host/host.h"
+#include "ModbusManager.h"
+#include <Preferences.h>
+
+#define BATTERIES 3
+
+static void runLoop(unsigned long durationMs)
+{
+    for (unsigned long ms = 0; ms < durationMs; ms++)
+    {
+        updateModbusPolling();
+        hostAdvanceMs(1);
+    }
+}
+
+static void reboot()
+{
+    // Emplacements et réglages rechargés depuis la NVS, bus relancés
+    hostRequestLog.clear();
+    memset(batterySettings, 0, sizeof(batterySettings));
+    initModbus(hostSerial(0));
+    setModbusPollingEnabled(true);
+}
+
+// Lectures de blocs de réglages reçues par une batterie (0 = toutes)
+static unsigned settingsReads(uint8_t id)
+{
+    unsigned reads = 0;
+    for (const HostRequest &request : hostRequestLog)
+    {
+        if ((id == 0 || request.id == id) && request.function == 0x03 && request.start >= ADDR_SETTING1_START)
+            reads++;
+    }
+    return reads;
+}
+
+static bool settingsMatchBms(uint8_t id)
+{
+    for (uint16_t reg = ADDR_SETTING1_START; reg <= ADDR_SETTING3_END; reg++)
+    {
+        uint16_t value;
+        if (!getBatterySettingRegister(id, reg, &value) || value != hostBms[id].regs[reg])
+            return false;
+    }
+    return true;
+}
+
+static void testFirstRead()
+{
+    runLoop(40000);
+    hostCheck(getOnlineBatteryCount() == BATTERIES, "%d batteries en ligne", BATTERIES);
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        const BatterySettings *settings = getBatterySettings(id);
+        hostCheck(settings && !settings->restored && settingsMatchBms(id) && settings->cellCount == 16,
+                  "ID %d : réglages lus, identité 16 cellules", id);
+        hostCheck(settingsReads(id) == 3, "ID %d : 3 blocs lus une seule fois (%u lectures)", id, settingsReads(id));
+    }
+
+    Preferences prefs;
+    prefs.begin("bmsset", true);
+    hostCheck(prefs.getBytesLength("set1") > 0 && prefs.getBytesLength("set3") > 0, "réglages enregistrés en NVS");
+    prefs.end();
+}
+
+static void testRestoredAfterReboot()
+{
+    reboot();
+    bool available = true;
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        const BatterySettings *settings = getBatterySettings(id);
+        available = available && settings && settings->restored && settingsMatchBms(id);
+    }
+    hostCheck(available && hostRequestLog.empty(), "réglages disponibles avant tout échange Modbus");
+
+    runLoop(40000);
+    hostCheck(getOnlineBatteryCount() == BATTERIES && settingsReads(0) == 0,
+              "polling repris sans lecture de réglages (%u)", settingsReads(0));
+}
+
+static void testIdentityChange()
+{
+    // Pack remplacé par un 15 cellules aux réglages différents
+    hostRequestLog.clear();
+    hostBms[2].regs[0x3C] = 15;
+    hostBms[2].regs[ADDR_SETTING1_START] = 4242;
+    runLoop(40000);
+    const BatterySettings *settings = getBatterySettings(2);
+    hostCheck(settingsReads(2) == 3 && settings && settings->cellCount == 15 && settingsMatchBms(2),
+              "identité changée : ID 2 relue (%u lectures)", settingsReads(2));
+    hostCheck(settingsReads(1) == 0 && settingsReads(3) == 0, "autres batteries non relues");
+
+    // Changement enregistré : restauré tel quel au redémarrage suivant
+    reboot();
+    settings = getBatterySettings(2);
+    hostCheck(settings && settings->restored && settings->cellCount == 15 && settingsMatchBms(2),
+              "nouveaux réglages restaurés après redémarrage");
+    runLoop(40000);
+    hostCheck(settingsReads(0) == 0, "pas de relecture après redémarrage");
+}
+
+static void testHeartbeatReset()
+{
+    // BMS redémarré : son heartbeat repart en arrière
+    hostBms[1].regs[REG_HEARTBEAT] = 500;
+    runLoop(40000);
+    hostRequestLog.clear();
+    hostBms[1].regs[REG_HEARTBEAT] = 3;
+    runLoop(40000);
+    hostCheck(settingsReads(1) == 3, "heartbeat reculé : ID 1 relue (%u lectures)", settingsReads(1));
+    hostCheck(settingsReads(2) == 0 && settingsReads(3) == 0, "autres batteries non relues");
+}
+
+static void testCorruptRecord()
+{
+    // Un octet des registres modifié en flash : le hash ne correspond plus
+    Preferences prefs;
+    prefs.begin("bmsset", false);
+    size_t length = prefs.getBytesLength("set3");
+    std::vector<uint8_t> record(length);
+    prefs.getBytes("set3", record.data(), length);
+    record[10] ^= 0x5A;
+    prefs.putBytes("set3", record.data(), length);
+    prefs.end();
+
+    reboot();
+    hostCheck(getBatterySettings(3) == nullptr, "enregistrement corrompu écarté au démarrage");
+    hostCheck(getBatterySettings(1) && getBatterySettings(2), "autres batteries restaurées");
+
+    runLoop(40000);
+    hostCheck(settingsReads(3) == 3 && settingsMatchBms(3), "ID 3 relue (%u lectures)", settingsReads(3));
+    hostCheck(settingsReads(1) == 0 && settingsReads(2) == 0, "autres batteries non relues");
+
+    reboot();
+    hostCheck(getBatterySettings(3) && getBatterySettings(3)->restored, "enregistrement réparé en NVS");
+}
+
+int main()
+{
+    hostClearPreferences();
+    hostResetBms();
+    for (uint8_t id = 1; id <= BATTERIES; id++)
+    {
+        hostAddBms(id, 0);
+        for (uint16_t reg = ADDR_SETTING1_START; reg <= ADDR_SETTING3_END; reg++)
+            hostBms[id].regs[reg] = id * 1000 + reg - ADDR_SETTING1_START;
+    }
+    hostLogRequests = true;
+    initModbus(hostSerial(0));
+    setModbusPollingEnabled(true);
+
+    testFirstRead();
+    testRestoredAfterReboot();
+    testIdentityChange();
+    testHeartbeatReset();
+    testCorruptRecord();
+    return hostReport("modbus_settings_test");
+}
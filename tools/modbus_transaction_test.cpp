@@ -0,0 +1,193 @@
+// Test hôte du moteur de transactions Modbus (ModbusManager.cpp).
+//
+// Lancement (depuis la racine du dépôt) :
+//     sh tools/host_tests.sh modbus_transaction
+//
+// Bus simulé à 9600 bauds 8E1, BMS à 20 ms de retournement. Vérifie que
+// pollModbus() ne bloque jamais, les passages d'état (émission, attente,
+// fin sur le dernier octet de CRC, timeout), la fin de trame sur silence
+// T3.5 quand la longueur est inconnue, le polling de fond depuis loop() et la
+// validation des acquittements d'écriture (waitForAck).
+
+#include "host/host.h"
+#include "ModbusManager.h"
+
+static ModbusBus &bus = modbusBuses[0];
+
+// Avance par pas de 20 us jusqu'à la fin de la transaction ; renvoie l'heure de fin
+static uint64_t runUntilDone(uint64_t limitUs)
+{
+    uint64_t end = hostNowUs + limitUs;
+    while (hostNowUs < end)
+    {
+        pollModbus();
+        ModbusTransactionState state = getModbusState(bus);
+        if (state == MODBUS_STATE_COMPLETE || state == MODBUS_STATE_TIMED_OUT)
+            return hostNowUs;
+        hostAdvanceUs(20);
+    }
+    return 0;
+}
+
+static uint64_t wireUs(int bytes)
+{
+    return bytes * (MODBUS_BITS_PER_CHAR * 1000000ULL / MODBUS_BAUD); // Arrondi par caractère
+}
+
+static void testT35()
+{
+    hostCheck(modbusT35Us(9600) == 4010, "T3.5 à 9600 bauds = %lu us", modbusT35Us(9600));
+    hostCheck(modbusT35Us(19200) == 2005, "T3.5 à 19200 bauds = %lu us", modbusT35Us(19200));
+    hostCheck(modbusT35Us(115200) == MODBUS_T35_MIN_US, "T3.5 plancher au-delà de 19200 bauds");
+}
+
+static void testNonBlockingRead()
+{
+    hostAddBms(1, 0);
+    uint64_t start = hostNowUs;
+    hostCheck(startReadTransaction(1, REG_TOTAL_VOLTAGE, 3, MODBUS_PARAM_TIMEOUT_MS), "lecture lancée");
+    hostCheck(getModbusState(bus) == MODBUS_STATE_TRANSMITTING, "état TRANSMITTING après l'envoi");
+
+    // Sans que le temps passe, aucun appel n'avance la transaction ni n'attend
+    for (int i = 0; i < 1000; i++)
+        pollModbus();
+    hostCheck(hostNowUs == start && hostDelayCalls == 0, "pollModbus() ne bloque pas");
+    hostCheck(getModbusState(bus) == MODBUS_STATE_TRANSMITTING, "DE/RE tenu pendant l'émission");
+
+    // Requête de 8 octets : DE/RE relâché une fois le temps fil écoulé
+    hostAdvanceUs(wireUs(8) - 200);
+    pollModbus();
+    hostCheck(getModbusState(bus) == MODBUS_STATE_TRANSMITTING, "toujours en émission avant la fin de trame");
+    hostAdvanceUs(400);
+    pollModbus();
+    hostCheck(getModbusState(bus) == MODBUS_STATE_AWAITING_RESPONSE, "attente de réponse après la trame");
+
+    // Réponse 3 + 6 + 2 octets : fin sur le dernier octet de CRC, sans silence
+    uint64_t lastByteUs = start + wireUs(8) + hostBms[1].turnaroundUs + wireUs(11);
+    uint64_t doneUs = runUntilDone(200000);
+    hostCheck(doneUs >= lastByteUs && doneUs - lastByteUs < 100,
+              "fin %lld us après le dernier octet (attendu < 100)", (long long)(doneUs - lastByteUs));
+    const ModbusTransaction &tx = bus.transaction;
+    hostCheck(tx.state == MODBUS_STATE_COMPLETE && tx.responseLength == 11 && tx.rxCrc == 0,
+              "réponse complète, CRC intègre (%d octets)", tx.responseLength);
+    hostCheck(parseResponse(1, DATA_REALTIME, REG_TOTAL_VOLTAGE), "réponse validée et décodée");
+    hostCheck(batteries[getBatterySlot(1)].voltageDv == 530, "tension décodée 53.0 V");
+    releaseModbusTransaction(bus);
+}
+
+static void testTimeout()
+{
+    registerBattery(2, 0); // Emplacement sans BMS : aucune réponse
+    hostCheck(startReadTransaction(2, REG_TOTAL_VOLTAGE, 3, MODBUS_PARAM_TIMEOUT_MS), "lecture batterie absente");
+    uint64_t sentUs = hostNowUs;
+    uint64_t doneUs = runUntilDone(1000000);
+    uint64_t expectedUs = sentUs + wireUs(8) + MODBUS_PARAM_TIMEOUT_MS * 1000ULL;
+    hostCheck(getModbusState(bus) == MODBUS_STATE_TIMED_OUT, "TIMED_OUT sans réponse");
+    // Échéance comptée en millis() : résolution d'une milliseconde
+    hostCheck(doneUs + 1000 > expectedUs && doneUs < expectedUs + 1000,
+              "timeout à %lld us de l'échéance (attendu ±1 ms)", (long long)doneUs - (long long)expectedUs);
+    releaseModbusTransaction(bus);
+}
+
+static void testT35EndOfFrame()
+{
+    // Fonction inconnue : la longueur ne se déduit pas de l'en-tête
+    HostBms &bms = hostBms[1];
+    bms.rawFunction = 0x41;
+    bms.rawLength = 6;
+    bms.gapAfterByte = 4;
+    bms.gapUs = modbusT35Us(MODBUS_BAUD) / 2; // Silence interne plus court que T3.5
+
+    uint64_t start = hostNowUs;
+    startReadTransaction(1, REG_TOTAL_VOLTAGE, 3, MODBUS_PARAM_TIMEOUT_MS);
+    uint64_t lastByteUs = start + wireUs(8) + bms.turnaroundUs + wireUs(10) + bms.gapUs;
+    uint64_t doneUs = runUntilDone(200000);
+    const ModbusTransaction &tx = bus.transaction;
+    hostCheck(tx.state == MODBUS_STATE_COMPLETE && tx.responseLength == 10,
+              "trame entière malgré un silence < T3.5 (%d/10 octets)", tx.responseLength);
+    hostCheck(doneUs >= lastByteUs + modbusT35Us(MODBUS_BAUD) &&
+                  doneUs < lastByteUs + modbusT35Us(MODBUS_BAUD) + 100,
+              "fin %lld us après le dernier octet (T3.5 = %lu us)", (long long)(doneUs - lastByteUs),
+              modbusT35Us(MODBUS_BAUD));
+    hostCheck(!parseResponse(1, DATA_REALTIME, REG_TOTAL_VOLTAGE), "fonction inattendue refusée");
+    releaseModbusTransaction(bus);
+
+    // Longueur connue mais trame interrompue : abandon au timeout inter-octets
+    bms.rawFunction = 0;
+    bms.gapAfterByte = 5;
+    bms.gapUs = 100000;
+    startReadTransaction(1, REG_TOTAL_VOLTAGE, 3, MODBUS_PARAM_TIMEOUT_MS);
+    runUntilDone(200000);
+    hostCheck(tx.state == MODBUS_STATE_COMPLETE && tx.responseLength == 5,
+              "trame interrompue close après %d octets", tx.responseLength);
+    hostCheck(!parseResponse(1, DATA_REALTIME, REG_TOTAL_VOLTAGE), "trame tronquée refusée");
+    releaseModbusTransaction(bus);
+    bms.gapAfterByte = 0;
+    hostAdvanceMs(200); // Fin de la trame tronquée sur le fil
+}
+
+static void testBackgroundPolling()
+{
+    // loop() : polling de fond, aucune attente dans updateModbusPolling()
+    hostBms[1].regs[REG_SOC] = 725;
+    setModbusPollingEnabled(true);
+    uint64_t longestCallUs = 0;
+    for (int ms = 0; ms < 5000; ms++)
+    {
+        uint64_t before = hostNowUs;
+        updateModbusPolling();
+        longestCallUs = max(longestCallUs, hostNowUs - before);
+        hostAdvanceMs(1);
+    }
+    setModbusPollingEnabled(false);
+    hostCheck(longestCallUs == 0 && hostDelayCalls == 0, "updateModbusPolling() rend la main sans attendre");
+    const BatteryData &battery = batteries[getBatterySlot(1)];
+    hostCheck(isBatteryDataValid(battery) && battery.socRaw == 725, "SOC relu en fond (%u)", battery.socRaw);
+    hostCheck(getBatteryLinkState(2) == LINK_OFFLINE, "batterie absente passée hors ligne");
+}
+
+static void testWriteAck()
+{
+    // Écritures 0x06 et 0x10 : écho complet exigé, exception signalée
+    HostBms &bms = hostBms[1];
+    const struct
+    {
+        HostAckMode mode;
+        bool expected;
+        const char *name;
+    } cases[] = {
+        {HOST_ACK_ECHO, true, "écho conforme"},
+        {HOST_ACK_EXCEPTION, false, "exception"},
+        {HOST_ACK_BAD_FUNCTION, false, "fonction différente"},
+        {HOST_ACK_BAD_ECHO, false, "adresse de registre différente"},
+        {HOST_ACK_SILENT, false, "pas de réponse"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        bms.ackMode = cases[i].mode;
+        bool single = writeBatteryParam(1, 0x0100, 1234);
+        bool multiple = setBatteryMosfets(1, true, false);
+        hostCheck(single == cases[i].expected && multiple == cases[i].expected,
+                  "ACK 0x06/0x10, %s : %d/%d (attendu %d)", cases[i].name, single, multiple, cases[i].expected);
+    }
+    bms.ackMode = HOST_ACK_ECHO;
+    hostCheck(bms.regs[0x0100] == 1234 && bms.regs[0x52] == 1 && bms.regs[0x53] == 0, "écritures appliquées");
+    hostCheck(getBatteryStats(1)->exceptions >= 2 && getBatteryStats(1)->functionErrors >= 2,
+              "exceptions et fonctions incorrectes comptées");
+}
+
+int main()
+{
+    hostResetBms();
+    initModbus(hostSerial(0));
+    setModbusPollingEnabled(false);
+    registerBattery(1, 0);
+
+    testT35();
+    testNonBlockingRead();
+    testTimeout();
+    testT35EndOfFrame();
+    testBackgroundPolling();
+    testWriteAck();
+    return hostReport("modbus_transaction_test");
+}
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Décode un dump du ring de trace (commande série "trace").
+
+Usage :
+    trace_decode.py capture.log                 # texte sur la sortie standard
+    trace_decode.py capture.log --pcap sortie   # + sortie_modbus.pcap / sortie_can.pcap
+
+Le fichier peut contenir d'autres lignes du moniteur série : seules les
+lignes entre "#TRACE" et "#END" sont lues (le dernier dump du fichier).
+
+Les pcap Modbus utilisent LINKTYPE_USER0 (147) : dans Wireshark, associer
+DLT_USER 0 au dissecteur "mbrtu". Les pcap CAN utilisent
+LINKTYPE_CAN_SOCKETCAN (227), décodé directement. Les trames sont tronquées
+aux octets conservés par le ring ; la longueur d'origine est renseignée.
+"""
+
+import argparse
+import struct
+import sys
+
+ENTRY_FORMAT = "<IHHBBBB16s"  # TraceEntry (TraceManager.h)
+ENTRY_SIZE = struct.calcsize(ENTRY_FORMAT)
+FORMAT_VERSION = 1
+
+DIRECTIONS = {0: "MB>", 1: "MB<", 2: "CAN>", 3: "CAN<"}
+RESULTS = {
+    0: "OK",
+    1: "TIMEOUT",
+    2: "TRONQUEE",
+    3: "CRC",
+    4: "ADRESSE",
+    5: "EXCEPTION",
+    6: "ECHEC_TX",
+    7: "FONCTION",
+    8: "LONGUEUR",
+}
+
+LINKTYPE_USER0 = 147
+LINKTYPE_CAN_SOCKETCAN = 227
+
+
+def read_dump(lines):
+    """Retourne (entrées, horloge au moment du dump) du dernier dump complet."""
+    entries, clock, current = None, 0, None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("#TRACE"):
+            fields = line.split()
+            version, size = int(fields[1]), int(fields[2])
+            if version != FORMAT_VERSION or size != ENTRY_SIZE:
+                sys.exit("Format de trace non supporté (version %d, entrée %d octets)" % (version, size))
+            clock, current = int(fields[4]), []
+        elif line == "#END" and current is not None:
+            entries, current = current, None
+        elif line.startswith("T ") and current is not None:
+            current.append(struct.unpack(ENTRY_FORMAT, bytes.fromhex(line[2:])))
+    if entries is None:
+        sys.exit("Aucun dump complet (#TRACE ... #END) trouvé")
+    return entries, clock
+
+
+def unwrap_timestamps(entries):
+    """micros() reboucle toutes les ~71 min : timestamps 64 bits croissants."""
+    result, offset, previous = [], 0, None
+    for entry in entries:
+        stamp = entry[0]
+        if previous is not None and stamp < previous:
+            offset += 1 << 32
+        previous = stamp
+        result.append(stamp + offset)
+    return result
+
+
+def format_text(entries):
+    stamps = unwrap_timestamps(entries)
+    origin = stamps[0] if stamps else 0
+    for entry, stamp in zip(entries, stamps):
+        _, ident, length, direction, bus, battery, result, payload = entry
+        kept = payload[: min(length, len(payload))]
+        data = " ".join("%02X" % b for b in kept)
+        if length > len(kept):
+            data += " ... (%d octets)" % length
+        if direction >= 2:
+            target = "id=0x%03X" % ident
+        else:
+            target = "bus=%d bat=%-2d" % (bus, battery)
+            if ident:
+                target += " reg=0x%04X" % ident
+        yield "%12.3f ms %-4s %-22s %-9s %s" % (
+            (stamp - origin) / 1000.0,
+            DIRECTIONS.get(direction, "?"),
+            target,
+            RESULTS.get(result, str(result)),
+            data,
+        )
+
+
+def write_pcap(path, linktype, packets):
+    with open(path, "wb") as out:
+        out.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, linktype))
+        for stamp, data, original in packets:
+            out.write(struct.pack("<IIII", stamp // 1000000, stamp % 1000000, len(data), original))
+            out.write(data)
+
+
+def export_pcap(entries, prefix):
+    modbus, can = [], []
+    for entry, stamp in zip(entries, unwrap_timestamps(entries)):
+        _, ident, length, direction, _, _, _, payload = entry
+        kept = payload[: min(length, len(payload))]
+        if direction < 2:
+            modbus.append((stamp, kept, length))
+        else:
+            # En-tête SocketCAN : identifiant (big-endian), DLC, 3 octets de bourrage
+            frame = struct.pack(">IB3x", ident, length) + kept.ljust(8, b"\0")[:8]
+            can.append((stamp, frame, len(frame)))
+    write_pcap(prefix + "_modbus.pcap", LINKTYPE_USER0, modbus)
+    write_pcap(prefix + "_can.pcap", LINKTYPE_CAN_SOCKETCAN, can)
+    return len(modbus), len(can)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="capture du moniteur série contenant le dump")
+    parser.add_argument("--pcap", metavar="PREFIXE", help="écrire PREFIXE_modbus.pcap et PREFIXE_can.pcap")
+    args = parser.parse_args()
+
+    with open(args.dump, encoding="utf-8", errors="replace") as handle:
+        entries, _ = read_dump(handle)
+
+    for line in format_text(entries):
+        print(line)
+
+    if args.pcap:
+        modbus, can = export_pcap(entries, args.pcap)
+        print("pcap: %d trames Modbus, %d trames CAN" % (modbus, can), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()